@@ -0,0 +1,247 @@
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANIMATION_SSE2 1
+#endif
+
+// Node hierarchy of a skinned model. Nodes are stored parents first, so one
+// forward pass over the array computes every global transform.
+struct SkeletonNode {
+    std::string name;
+    int parent;                 // Lower index than this node, -1 for the root
+    glm::mat4 bindLocal;        // Local transform for nodes no channel animates
+    int bone;                   // Palette slot, -1 when no vertex references the node
+};
+
+struct Skeleton {
+    std::vector<SkeletonNode> nodes;
+    std::vector<glm::mat4> boneOffsets;     // Mesh space to bone space, per palette slot
+    glm::mat4 globalInverse;                // Undoes the root transform
+
+    int boneCount() const {
+        return static_cast<int>(boneOffsets.size());
+    }
+
+    int findNode(const std::string& name) const {
+        for (size_t i = 0; i < nodes.size(); i++) {
+            if (nodes[i].name == name) return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Gives the node a palette slot if it doesn't have one yet
+    int addBone(int node, const glm::mat4& offset) {
+        if (nodes[node].bone < 0) {
+            nodes[node].bone = boneCount();
+            boneOffsets.push_back(offset);
+        }
+        return nodes[node].bone;
+    }
+};
+
+struct AnimationChannel {
+    int node;
+    std::vector<float> positionTimes, rotationTimes, scaleTimes;    // In ticks
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+};
+
+struct AnimationClip {
+    std::string name;
+    float duration = 0.0f;              // In ticks
+    float ticksPerSecond = 25.0f;
+    std::vector<AnimationChannel> channels;
+};
+
+// out = a * b for column-major matrices, four columns of a scaled and summed
+// per column of b with SSE2 where available
+static void MultiplyMat4(const glm::mat4& a, const glm::mat4& b, glm::mat4& out, bool simd) {
+#ifdef ANIMATION_SSE2
+    if (simd) {
+        const float* pa = &a[0][0];
+        const float* pb = &b[0][0];
+        float* po = &out[0][0];
+        __m128 a0 = _mm_loadu_ps(pa), a1 = _mm_loadu_ps(pa + 4), a2 = _mm_loadu_ps(pa + 8), a3 = _mm_loadu_ps(pa + 12);
+        for (int column = 0; column < 4; column++) {
+            const float* c = pb + 4 * column;
+            __m128 sum = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(c[0])), _mm_mul_ps(a1, _mm_set1_ps(c[1]))),
+                                    _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(c[2])), _mm_mul_ps(a3, _mm_set1_ps(c[3]))));
+            _mm_storeu_ps(po + 4 * column, sum);
+        }
+        return;
+    }
+#endif
+    (void)simd;
+    out = a * b;
+}
+
+// Index of the last key at or before time, keys are sorted
+static size_t FindKey(const std::vector<float>& times, float time) {
+    size_t upper = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+    return upper == 0 ? 0 : upper - 1;
+}
+
+static float KeyBlend(const std::vector<float>& times, size_t key, float time) {
+    if (key + 1 >= times.size()) return 0.0f;
+    float span = times[key + 1] - times[key];
+    return span > 0.0f ? glm::clamp((time - times[key]) / span, 0.0f, 1.0f) : 0.0f;
+}
+
+static glm::vec3 SampleVector(const std::vector<float>& times, const std::vector<glm::vec3>& values, float time) {
+    size_t key = FindKey(times, time);
+    if (key + 1 >= values.size()) return values[key];
+    return glm::mix(values[key], values[key + 1], KeyBlend(times, key, time));
+}
+
+static glm::quat SampleRotation(const std::vector<float>& times, const std::vector<glm::quat>& values, float time) {
+    size_t key = FindKey(times, time);
+    if (key + 1 >= values.size()) return values[key];
+    return glm::normalize(glm::slerp(values[key], values[key + 1], KeyBlend(times, key, time)));
+}
+
+// Local transforms of every node at the given clip time (seconds, wrapped)
+static void SamplePose(const Skeleton& skeleton, const AnimationClip& clip, float seconds,
+                       std::vector<glm::mat4>& locals) {
+    locals.resize(skeleton.nodes.size());
+    for (size_t i = 0; i < skeleton.nodes.size(); i++) {
+        locals[i] = skeleton.nodes[i].bindLocal;
+    }
+
+    float ticks = clip.duration > 0.0f ? fmodf(seconds * clip.ticksPerSecond, clip.duration) : 0.0f;
+    for (const AnimationChannel& channel : clip.channels) {
+        glm::vec3 translation = channel.positions.empty() ? glm::vec3(0.0f)
+                                                          : SampleVector(channel.positionTimes, channel.positions, ticks);
+        glm::quat rotation = channel.rotations.empty() ? glm::quat()
+                                                       : SampleRotation(channel.rotationTimes, channel.rotations, ticks);
+        glm::vec3 scale = channel.scales.empty() ? glm::vec3(1.0f)
+                                                 : SampleVector(channel.scaleTimes, channel.scales, ticks);
+
+        // T * R * S without the matrix products
+        glm::mat3 r = glm::mat3_cast(rotation);
+        glm::mat4& local = locals[channel.node];
+        local[0] = glm::vec4(r[0] * scale.x, 0.0f);
+        local[1] = glm::vec4(r[1] * scale.y, 0.0f);
+        local[2] = glm::vec4(r[2] * scale.z, 0.0f);
+        local[3] = glm::vec4(translation, 1.0f);
+    }
+}
+
+// Globals from locals in one parents-first pass, then the skinning matrix of
+// every bone: globalInverse * global * offset
+static void BuildPalette(const Skeleton& skeleton, const std::vector<glm::mat4>& locals,
+                         std::vector<glm::mat4>& globals, glm::mat4* palette, bool simd) {
+    globals.resize(skeleton.nodes.size());
+    glm::mat4 rootRelative;
+    for (size_t i = 0; i < skeleton.nodes.size(); i++) {
+        const SkeletonNode& node = skeleton.nodes[i];
+        if (node.parent < 0) globals[i] = locals[i];
+        else MultiplyMat4(globals[node.parent], locals[i], globals[i], simd);
+
+        if (node.bone >= 0) {
+            MultiplyMat4(skeleton.globalInverse, globals[i], rootRelative, simd);
+            MultiplyMat4(rootRelative, skeleton.boneOffsets[node.bone], palette[node.bone], simd);
+        }
+    }
+}
+
+struct AnimationStats {
+    int characters = 0;
+    int bones = 0;              // Per character
+    double updateMs = 0.0;
+};
+
+// Plays clips of one skeleton on many characters. Every update samples each
+// character's clip and writes its bone palette into one contiguous array,
+// boneCount() matrices per character, ready to upload in a single call.
+// Characters are independent, so batches of them run on the job system.
+class AnimationSystem {
+public:
+    static const int CHARACTERS_PER_JOB = 16;
+
+    bool useSimd = true;
+    AnimationStats stats;
+
+    void setSkeleton(const Skeleton* newSkeleton, const std::vector<AnimationClip>* newClips) {
+        skeleton = newSkeleton;
+        clips = newClips;
+        characters.clear();
+        palettes.clear();
+    }
+
+    // Returns the character's index, its palette starts at index * boneCount()
+    int addCharacter(int clip, float startSeconds, float speed) {
+        characters.push_back(Character{clip, startSeconds, speed});
+        palettes.resize(characters.size() * boneCount(), glm::mat4(1.0f));
+        return static_cast<int>(characters.size()) - 1;
+    }
+
+    int characterCount() const {
+        return static_cast<int>(characters.size());
+    }
+
+    int boneCount() const {
+        return skeleton ? skeleton->boneCount() : 0;
+    }
+
+    // jobs may be null to animate on the calling thread
+    void update(float deltaSeconds, JobSystem* jobs) {
+        auto start = std::chrono::steady_clock::now();
+        int count = characterCount();
+        if (skeleton && count > 0) {
+            for (Character& character : characters) {
+                character.time += deltaSeconds * character.speed;
+            }
+            if (jobs) {
+                JobCounter animated;
+                jobs->parallelFor(count, CHARACTERS_PER_JOB, [this](int begin, int end) {
+                    animate(begin, end);
+                }, animated);
+                jobs->wait(animated);
+            } else {
+                animate(0, count);
+            }
+        }
+        stats.characters = count;
+        stats.bones = boneCount();
+        stats.updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const std::vector<glm::mat4>& allPalettes() const {
+        return palettes;
+    }
+
+private:
+    struct Character {
+        int clip;
+        float time;             // Seconds
+        float speed;
+    };
+
+    const Skeleton* skeleton = nullptr;
+    const std::vector<AnimationClip>* clips = nullptr;
+    std::vector<Character> characters;
+    std::vector<glm::mat4> palettes;
+
+    // Scratch is per call so concurrent batches never share it. Without
+    // clips every character holds the bind pose.
+    void animate(int begin, int end) {
+        static const AnimationClip bindPose;
+        std::vector<glm::mat4> locals, globals;
+        int bones = boneCount();
+        for (int i = begin; i < end; i++) {
+            const Character& character = characters[i];
+            const AnimationClip& clip = (clips && !clips->empty()) ? (*clips)[character.clip % clips->size()] : bindPose;
+            SamplePose(*skeleton, clip, character.time, locals);
+            BuildPalette(*skeleton, locals, globals, &palettes[i * bones], useSimd);
+        }
+    }
+};
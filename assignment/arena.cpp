@@ -0,0 +1,193 @@
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <new>
+#include <cstdio>
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+
+// Bump allocator over one fixed block. allocate() is lock-free so jobs can
+// fill arena-backed containers in parallel; individual frees are no-ops and
+// everything is released at once by reset(). Requests that don't fit go to
+// the heap and are freed on the next reset. Debug builds poison fresh
+// allocations with 0xCD and released memory with 0xDD so stale pointers into
+// an old frame show up quickly.
+class LinearArena {
+public:
+    explicit LinearArena(size_t capacityBytes)
+            : base(static_cast<char*>(::operator new(capacityBytes))), capacity(capacityBytes), offset(0) {
+#ifndef NDEBUG
+        memset(base, 0xDD, capacity);
+#endif
+    }
+
+    ~LinearArena() {
+        reset();
+        ::operator delete(base);
+    }
+
+    LinearArena(const LinearArena&) = delete;
+    LinearArena& operator=(const LinearArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        size_t current = offset.load(std::memory_order_relaxed);
+        for (;;) {
+            uintptr_t address = reinterpret_cast<uintptr_t>(base) + current;
+            size_t padding = (alignment - address % alignment) % alignment;
+            size_t end = current + padding + bytes;
+            if (end > capacity) {
+                return allocateFallback(bytes);
+            }
+            if (offset.compare_exchange_weak(current, end, std::memory_order_relaxed)) {
+                char* memory = base + current + padding;
+#ifndef NDEBUG
+                memset(memory, 0xCD, bytes);
+#endif
+                return memory;
+            }
+        }
+    }
+
+    // Must not race with allocate()
+    void reset() {
+        size_t used = std::min(offset.load(std::memory_order_relaxed), capacity);
+#ifndef NDEBUG
+        memset(base, 0xDD, used);
+#else
+        (void)used;
+#endif
+        offset.store(0, std::memory_order_relaxed);
+        for (void* block : fallbacks) {
+            ::operator delete(block);
+        }
+        fallbacks.clear();
+        fallbackBytes = 0;
+    }
+
+    size_t usedBytes() const { return std::min(offset.load(std::memory_order_relaxed), capacity); }
+    size_t capacityBytes() const { return capacity; }
+    size_t fallbackCount() const { return fallbacks.size(); }
+    size_t fallbackBytesUsed() const { return fallbackBytes; }
+
+private:
+    char* base;
+    size_t capacity;
+    std::atomic<size_t> offset;
+    std::mutex fallbackMutex;
+    std::vector<void*> fallbacks;
+    size_t fallbackBytes = 0;
+
+    // ::operator new is aligned for any fundamental type
+    void* allocateFallback(size_t bytes) {
+        void* block = ::operator new(bytes);
+        std::lock_guard<std::mutex> lock(fallbackMutex);
+        fallbacks.push_back(block);
+        fallbackBytes += bytes;
+        return block;
+    }
+};
+
+struct FrameArenaStats {
+    size_t capacityBytes = 0;
+    size_t lastFrameBytes = 0;
+    size_t peakFrameBytes = 0;
+    size_t lastFrameFallbacks = 0;      // Heap allocations because the arena was full
+    unsigned long totalFallbacks = 0;
+    size_t totalFallbackBytes = 0;
+};
+
+// Two arenas used on alternate frames. beginFrame() switches to the other one
+// and resets it, so data allocated during frame N stays valid through frame
+// N+1 (e.g. packets still referenced while the next frame is built).
+class FrameArena {
+public:
+    explicit FrameArena(size_t capacityBytes = 1024 * 1024)
+            : even(capacityBytes), odd(capacityBytes) {
+        stats.capacityBytes = capacityBytes;
+    }
+
+    void beginFrame() {
+        LinearArena& finished = current();
+        stats.lastFrameBytes = finished.usedBytes() + finished.fallbackBytesUsed();
+        stats.peakFrameBytes = std::max(stats.peakFrameBytes, stats.lastFrameBytes);
+        stats.lastFrameFallbacks = finished.fallbackCount();
+        stats.totalFallbacks += finished.fallbackCount();
+        stats.totalFallbackBytes += finished.fallbackBytesUsed();
+
+        index ^= 1;
+        current().reset();
+    }
+
+    LinearArena& current() { return index == 0 ? even : odd; }
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+        return current().allocate(bytes, alignment);
+    }
+
+    // printf into frame memory, valid until the arena is reused two frames on
+    const char* format(const char* fmt, ...) {
+        va_list args;
+        va_start(args, fmt);
+        va_list measure;
+        va_copy(measure, args);
+        int length = vsnprintf(nullptr, 0, fmt, measure);
+        va_end(measure);
+        if (length < 0) {
+            va_end(args);
+            return "";
+        }
+        char* text = static_cast<char*>(allocate(length + 1, 1));
+        vsnprintf(text, length + 1, fmt, args);
+        va_end(args);
+        return text;
+    }
+
+    const FrameArenaStats& frameStats() const { return stats; }
+
+private:
+    LinearArena even, odd;
+    int index = 0;
+    FrameArenaStats stats;
+};
+
+// STL allocator over a LinearArena. Without an arena it forwards to the heap,
+// so default-constructed containers keep working.
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    LinearArena* arena;
+
+    ArenaAllocator() : arena(nullptr) {}
+    explicit ArenaAllocator(LinearArena* linearArena) : arena(linearArena) {}
+    explicit ArenaAllocator(FrameArena& frameArena) : arena(&frameArena.current()) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) {
+        if (!arena) return static_cast<T*>(::operator new(count * sizeof(T)));
+        return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* pointer, size_t) {
+        if (!arena) ::operator delete(pointer);
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+using FrameString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
@@ -0,0 +1,392 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Asset pack: every asset in one file, written by tools/packassets and
+// memory-mapped once at startup. Layout, all integers in host byte order:
+//   AssetPackHeader at offset 0
+//   each asset's bytes, starting on an AssetPackAlignment boundary
+//   AssetPackEntry[entryCount] at indexOffset, sorted by name
+//   names, not null-terminated, at namesOffset
+// Names are paths relative to the assignment directory, e.g. "shaders/mesh.vert".
+static const uint32_t AssetPackMagic = 0x4B504141; // "AAPK"
+static const uint32_t AssetPackVersion = 1;
+static const uint64_t AssetPackAlignment = 4096;
+
+struct AssetPackHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t alignment;
+    uint64_t indexOffset;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+};
+
+struct AssetPackEntry {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+};
+
+// What the packing tool bundles by default, relative to the assignment directory
+static const char *AssetPackSources[] = {"assets", "shaders", "facade0.jpg"};
+
+// Pack name of a loader path: the engine asks for "../assignment/shaders/x",
+// which is "shaders/x" in the pack
+static std::string AssetPackName(const std::string &path) {
+    std::string name = path;
+    std::replace(name.begin(), name.end(), '\\', '/');
+    const char *prefixes[] = {"../assignment/", "./"};
+    for (const char *prefix : prefixes) {
+        size_t length = strlen(prefix);
+        if (name.compare(0, length, prefix) == 0) name.erase(0, length);
+    }
+    return name;
+}
+
+// Bundles the given files and directories (recursively), relative to root,
+// into one pack. Returns false if nothing could be written.
+static bool WriteAssetPack(const std::string &output, const std::string &root, const std::vector<std::string> &inputs,
+                           std::ostream &log) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> names;
+    for (const std::string &input : inputs) {
+        fs::path path = fs::path(root) / input;
+        std::error_code error;
+        if (fs::is_directory(path, error)) {
+            for (const auto &file : fs::recursive_directory_iterator(path, error)) {
+                if (file.is_regular_file()) names.push_back(fs::relative(file.path(), root).generic_string());
+            }
+        } else if (fs::is_regular_file(path, error)) {
+            names.push_back(fs::path(input).generic_string());
+        } else {
+            log << "Skipping missing asset " << path.string() << std::endl;
+        }
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+
+    std::ofstream out(output, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        log << "Cannot write asset pack " << output << std::endl;
+        return false;
+    }
+
+    AssetPackHeader header = {AssetPackMagic, AssetPackVersion, 0, static_cast<uint32_t>(AssetPackAlignment), 0, 0, 0};
+    std::vector<AssetPackEntry> entries;
+    std::string nameBlob;
+    std::vector<char> data;
+    uint64_t offset = AssetPackAlignment;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const std::string &name : names) {
+        std::ifstream in(fs::path(root) / name, std::ios::in | std::ios::binary);
+        if (!in.is_open()) {
+            log << "Cannot read asset " << name << std::endl;
+            continue;
+        }
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+        out.seekp(static_cast<std::streamoff>(offset));
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        entries.push_back(AssetPackEntry{offset, data.size(), static_cast<uint32_t>(nameBlob.size()),
+                                         static_cast<uint32_t>(name.size())});
+        nameBlob += name;
+        offset = (offset + data.size() + AssetPackAlignment - 1) / AssetPackAlignment * AssetPackAlignment;
+    }
+
+    header.entryCount = static_cast<uint32_t>(entries.size());
+    header.indexOffset = offset;
+    header.namesOffset = offset + entries.size() * sizeof(AssetPackEntry);
+    header.namesSize = nameBlob.size();
+    out.seekp(static_cast<std::streamoff>(header.indexOffset));
+    out.write(reinterpret_cast<const char *>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(AssetPackEntry)));
+    out.write(nameBlob.data(), static_cast<std::streamsize>(nameBlob.size()));
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (!out.good()) {
+        log << "Failed writing asset pack " << output << std::endl;
+        return false;
+    }
+    log << "Packed " << entries.size() << " assets, " << (header.namesOffset + header.namesSize) / (1024.0 * 1024.0)
+        << " MB, into " << output << std::endl;
+    return true;
+}
+
+// A read-only view of one asset. Views into the pack point straight at the
+// mapping and copy nothing; loose files are read into the view's own buffer.
+struct AssetView {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    bool packed = false;
+    std::vector<uint8_t> owned;
+};
+
+// Where every asset load goes. With a pack open, assets in it are served from
+// the mapping, anything else (or everything, without a pack) from loose files
+// at the path the engine asked for. Views are safe to take from any thread.
+class AssetFiles {
+public:
+    struct Stats {
+        unsigned long packViews = 0;
+        unsigned long looseReads = 0;
+        unsigned long misses = 0;
+        size_t packBytes = 0;       // Served from the mapping
+        size_t looseBytes = 0;
+        double ioMs = 0.0;          // Mapping, page-ins of viewed assets and loose reads
+    };
+
+    ~AssetFiles() {
+        closePack();
+    }
+
+    bool openPack(const std::string &path) {
+        closePack();
+        auto start = std::chrono::steady_clock::now();
+        if (!map(path)) return false;
+
+        const AssetPackHeader *header = reinterpret_cast<const AssetPackHeader *>(mapping);
+        bool valid = mappingSize >= sizeof(AssetPackHeader) && header->magic == AssetPackMagic &&
+                     header->version == AssetPackVersion &&
+                     header->indexOffset + uint64_t(header->entryCount) * sizeof(AssetPackEntry) <= mappingSize &&
+                     header->namesOffset + header->namesSize <= mappingSize;
+        if (valid) {
+            entries = reinterpret_cast<const AssetPackEntry *>(mapping + header->indexOffset);
+            names = reinterpret_cast<const char *>(mapping + header->namesOffset);
+            entryCount = header->entryCount;
+            for (uint32_t i = 0; i < entryCount && valid; i++) {
+                valid = entries[i].offset + entries[i].size <= mappingSize &&
+                        uint64_t(entries[i].nameOffset) + entries[i].nameLength <= header->namesSize;
+            }
+        }
+        if (!valid) {
+            std::cout << "Asset pack " << path << " is not a valid version " << AssetPackVersion << " pack" << std::endl;
+            closePack();
+            return false;
+        }
+        packPath = path;
+        cachedAtOpen = residentFraction();
+        addIo(start);
+        return true;
+    }
+
+    void closePack() {
+        if (!mapping) return;
+#ifdef _WIN32
+        UnmapViewOfFile(mapping);
+#else
+        munmap(const_cast<uint8_t *>(mapping), mappingSize);
+#endif
+        mapping = nullptr;
+        mappingSize = 0;
+        entries = nullptr;
+        names = nullptr;
+        entryCount = 0;
+        packPath.clear();
+    }
+
+    bool isPacked() const {
+        return mapping != nullptr;
+    }
+
+    // -1 without a pack or where the OS cannot tell
+    double cachedFractionAtOpen() const {
+        return isPacked() ? cachedAtOpen : -1.0;
+    }
+
+    std::vector<std::string> packNames() const {
+        std::vector<std::string> result;
+        for (uint32_t i = 0; i < entryCount; i++) result.emplace_back(names + entries[i].nameOffset, entries[i].nameLength);
+        return result;
+    }
+
+    bool inPack(const std::string &path) const {
+        return find(AssetPackName(path)) != nullptr;
+    }
+
+    // The pack entry if there is one, else the whole loose file
+    bool view(const std::string &path, AssetView &out) {
+        auto start = std::chrono::steady_clock::now();
+        if (const AssetPackEntry *entry = find(AssetPackName(path))) {
+            out.data = mapping + entry->offset;
+            out.size = entry->size;
+            out.packed = true;
+            out.owned.clear();
+            // Fault the pages in here so the reads are timed as I/O rather
+            // than showing up inside whichever decoder touches them first
+            touchPages(out.data, out.size);
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.packViews++;
+            stats.packBytes += out.size;
+            stats.ioMs += elapsedMs(start);
+            return true;
+        }
+
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        if (!stream.is_open()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.misses++;
+            return false;
+        }
+        out.owned.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+        out.data = out.owned.data();
+        out.size = out.owned.size();
+        out.packed = false;
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.looseReads++;
+        stats.looseBytes += out.size;
+        stats.ioMs += elapsedMs(start);
+        return true;
+    }
+
+    bool text(const std::string &path, std::string &out) {
+        AssetView asset;
+        if (!view(path, asset)) return false;
+        out.assign(reinterpret_cast<const char *>(asset.data), asset.size);
+        return true;
+    }
+
+    Stats snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    void resetStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats = Stats();
+    }
+
+    // Whether startup read from disk or from the OS file cache: "cold" when
+    // little of the pack was cached when it was mapped, "warm" when most was
+    void printStats(std::ostream &out) {
+        Stats current = snapshot();
+        out << std::fixed << std::setprecision(2);
+        out << "Asset I/O: ";
+        if (isPacked()) {
+            out << packPath << " (" << entryCount << " assets, " << mappingSize / (1024.0 * 1024.0) << " MB mapped";
+            if (cachedAtOpen >= 0.0) {
+                out << ", " << cachedAtOpen * 100.0 << "% cached at open, "
+                    << (cachedAtOpen < 0.1 ? "cold" : cachedAtOpen > 0.9 ? "warm" : "partly warm");
+            }
+            out << "), ";
+        } else {
+            out << "loose files, ";
+        }
+        out << current.packViews << " pack views (" << current.packBytes / (1024.0 * 1024.0) << " MB), "
+            << current.looseReads << " loose reads (" << current.looseBytes / (1024.0 * 1024.0) << " MB), "
+            << current.misses << " missing, " << current.ioMs << " ms in I/O" << std::endl;
+    }
+
+private:
+    const uint8_t *mapping = nullptr;
+    size_t mappingSize = 0;
+    const AssetPackEntry *entries = nullptr;
+    const char *names = nullptr;
+    uint32_t entryCount = 0;
+    std::string packPath;
+    double cachedAtOpen = -1.0;
+    std::mutex mutex;
+    Stats stats;
+    std::atomic<uint8_t> touchSink{0};
+
+    static double elapsedMs(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    void addIo(std::chrono::steady_clock::time_point since) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.ioMs += elapsedMs(since);
+    }
+
+    bool map(const std::string &path) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        HANDLE view = NULL;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+            view = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        }
+        CloseHandle(file);
+        if (!view) return false;
+        mapping = static_cast<const uint8_t *>(MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0));
+        CloseHandle(view);
+        if (!mapping) return false;
+        mappingSize = static_cast<size_t>(size.QuadPart);
+#else
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0) return false;
+        struct stat info;
+        void *address = MAP_FAILED;
+        if (fstat(file, &info) == 0 && info.st_size > 0) {
+            address = mmap(NULL, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        }
+        close(file);
+        if (address == MAP_FAILED) return false;
+        mapping = static_cast<const uint8_t *>(address);
+        mappingSize = static_cast<size_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    // Share of the pack already in the OS page cache, -1 where that cannot be asked
+    double residentFraction() const {
+#if defined(__linux__)
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        std::vector<unsigned char> resident((mappingSize + page - 1) / page);
+        if (mincore(const_cast<uint8_t *>(mapping), mappingSize, resident.data()) != 0) return -1.0;
+        size_t cached = 0;
+        for (unsigned char pageState : resident) cached += pageState & 1;
+        return resident.empty() ? 1.0 : double(cached) / resident.size();
+#else
+        return -1.0;
+#endif
+    }
+
+    void touchPages(const uint8_t *data, size_t size) {
+        uint8_t sum = 0;
+        for (size_t i = 0; i < size; i += AssetPackAlignment) sum ^= data[i];
+        if (size > 0) sum ^= data[size - 1];
+        touchSink.store(sum, std::memory_order_relaxed);
+    }
+
+    // Binary search, entries are sorted by name
+    const AssetPackEntry *find(const std::string &name) const {
+        size_t low = 0, high = entryCount;
+        while (low < high) {
+            size_t middle = (low + high) / 2;
+            const AssetPackEntry &entry = entries[middle];
+            int order = memcmp(names + entry.nameOffset, name.data(), std::min<size_t>(entry.nameLength, name.size()));
+            if (order == 0) order = entry.nameLength < name.size() ? -1 : entry.nameLength > name.size() ? 1 : 0;
+            if (order == 0) return &entry;
+            if (order < 0) low = middle + 1;
+            else high = middle;
+        }
+        return nullptr;
+    }
+};
+
+static AssetFiles assetFiles;
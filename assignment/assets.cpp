@@ -0,0 +1,194 @@
+#include <stb/stb_image.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <functional>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+// Reads and decodes startup assets on the job system before any GL objects
+// are created. Image decodes, shader source reads and model imports run
+// concurrently; the main thread only creates GL objects from the results
+// (TextureStreamer, LoadShadersFromFile and Model pick them up
+// transparently). Every asset records when it was queued, decoded and
+// uploaded, relative to the preloader's creation, for the startup timeline.
+class AssetPreloader {
+public:
+    enum Kind { IMAGE, TEXT, CUSTOM, GL_ONLY };
+
+    explicit AssetPreloader(JobSystem& jobSystem)
+            : jobs(jobSystem), start(std::chrono::steady_clock::now()) {}
+
+    ~AssetPreloader() {
+        for (auto& entry : entries) {
+            if (entry->pixels) stbi_image_free(entry->pixels);
+        }
+    }
+
+    // Decoded with the same 3-channel layout TextureStreamer asks for
+    void requestImage(const std::string& path) {
+        Entry* entry = addEntry(path, IMAGE);
+        if (!entry) return;
+        jobs.run([this, entry] {
+            entry->decodeStart = now();
+            AssetView file;
+            if (assetFiles.view(entry->name, file)) {
+                entry->pixels = stbi_load_from_memory(file.data, static_cast<int>(file.size),
+                                                      &entry->width, &entry->height, &entry->channels, 3);
+            }
+            entry->failed = entry->pixels == nullptr;
+            entry->decodeEnd = now();
+        }, &pending);
+    }
+
+    void requestText(const std::string& path) {
+        Entry* entry = addEntry(path, TEXT);
+        if (!entry) return;
+        jobs.run([this, entry] {
+            entry->decodeStart = now();
+            entry->failed = !assetFiles.text(entry->name, entry->text);
+            entry->decodeEnd = now();
+        }, &pending);
+    }
+
+    // Any other CPU-side load, e.g. a model import, timed under the given name.
+    // decode must not touch GL.
+    void requestCustom(const std::string& name, std::function<bool()> decode) {
+        Entry* entry = addEntry(name, CUSTOM);
+        if (!entry) return;
+        jobs.run([this, entry, decode] {
+            entry->decodeStart = now();
+            entry->failed = !decode();
+            entry->decodeEnd = now();
+        }, &pending);
+    }
+
+    // Main thread helps decode until everything requested so far is ready
+    void wait() {
+        jobs.wait(pending);
+        readyTime = now();
+    }
+
+    // Hands over decoded pixels, the caller frees them with stbi_image_free.
+    // Returns false if the image was never requested.
+    bool takeImage(const std::string& path, unsigned char*& pixels, int& width, int& height) {
+        Entry* entry = find(path, IMAGE);
+        if (!entry) return false;
+        pixels = entry->pixels;
+        width = entry->width;
+        height = entry->height;
+        entry->pixels = nullptr;
+        return true;
+    }
+
+    bool text(const std::string& path, std::string& out) {
+        Entry* entry = find(path, TEXT);
+        if (!entry || entry->failed) return false;
+        out = entry->text;
+        return true;
+    }
+
+    // Marks the start and end of GL object creation for an asset. Names that
+    // were never requested get a GL-only row, e.g. a whole subsystem's setup.
+    void beginUpload(const std::string& name) {
+        auto it = byName.find(name);
+        Entry* entry = it != byName.end() ? it->second : addEntry(name, GL_ONLY);
+        if (entry->kind == GL_ONLY) entry->decodeStart = entry->decodeEnd = entry->queued;
+        if (entry->uploadStart < 0.0) entry->uploadStart = now();
+    }
+
+    void endUpload(const std::string& name) {
+        auto it = byName.find(name);
+        if (it == byName.end()) return;
+        Entry* entry = it->second;
+        if (entry->uploadStart >= 0.0 && entry->uploadEnd < 0.0) entry->uploadEnd = now();
+    }
+
+    void markFirstFrame() {
+        if (firstFrameTime < 0.0) firstFrameTime = now();
+    }
+
+    void printTimeline(std::ostream& out) const {
+        const char* kindNames[] = {"image", "text", "custom", "gl"};
+        out << std::fixed << std::setprecision(2);
+        out << "Startup timeline (ms since preload start)" << std::endl;
+        out << std::left << std::setw(48) << "asset" << std::setw(8) << "kind" << std::right
+            << std::setw(10) << "queued" << std::setw(10) << "wait" << std::setw(10) << "decode"
+            << std::setw(10) << "upload" << std::endl;
+        for (const auto& entry : entries) {
+            out << std::left << std::setw(48) << shortName(entry->name) << std::setw(8) << kindNames[entry->kind]
+                << std::right << std::setw(10) << entry->queued
+                << std::setw(10) << entry->decodeStart - entry->queued
+                << std::setw(10) << entry->decodeEnd - entry->decodeStart;
+            if (entry->uploadEnd >= 0.0) out << std::setw(10) << entry->uploadEnd - entry->uploadStart;
+            else out << std::setw(10) << "-";
+            if (entry->failed) out << "  FAILED";
+            out << std::endl;
+        }
+        out << "all assets decoded at " << readyTime << " ms";
+        if (firstFrameTime >= 0.0) out << ", first frame at " << firstFrameTime << " ms";
+        out << std::endl;
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        Kind kind;
+        bool failed = false;
+        double queued = 0.0, decodeStart = 0.0, decodeEnd = 0.0;
+        double uploadStart = -1.0, uploadEnd = -1.0;
+        unsigned char* pixels = nullptr;
+        int width = 0, height = 0, channels = 0;
+        std::string text;
+    };
+
+    JobSystem& jobs;
+    JobCounter pending;
+    std::chrono::steady_clock::time_point start;
+    std::vector<std::unique_ptr<Entry>> entries;
+    std::unordered_map<std::string, Entry*> byName;
+    double readyTime = 0.0;
+    double firstFrameTime = -1.0;
+
+    double now() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Entries are only added from the main thread
+    Entry* addEntry(const std::string& name, Kind kind) {
+        if (byName.count(name)) return nullptr;
+        entries.emplace_back(new Entry());
+        Entry* entry = entries.back().get();
+        entry->name = name;
+        entry->kind = kind;
+        entry->queued = now();
+        byName[name] = entry;
+        return entry;
+    }
+
+    Entry* find(const std::string& name, Kind kind) {
+        auto it = byName.find(name);
+        return (it != byName.end() && it->second->kind == kind) ? it->second : nullptr;
+    }
+
+    static std::string shortName(const std::string& path) {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+};
+
+// Set while startup assets are being created so loaders can use the decoded data
+static AssetPreloader *activePreloader = nullptr;
+
+static bool PreloadedShaderSource(const char *path, std::string &source) {
+    return activePreloader && activePreloader->text(path, source);
+}
+
+// Startup shaders come from the preloader, later ones from the asset pack or
+// loose files
+inline bool AssetShaderSource(const char *path, std::string &source) {
+    return PreloadedShaderSource(path, source) || assetFiles.text(path, source);
+}
@@ -7,18 +7,39 @@
 #include <stb/stb_image_write.h>
 
 #include <render/shader.h>
+#include <render/glext.h>
 
 #include <vector>
 #include <iostream>
-#include <unordered_map>
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <iomanip>
-
+#include <chrono>
+
+#include "jobs.cpp"
+#include "arena.cpp"
+#include "citygen.cpp"
+#include "assetpack.cpp"
+#include "assets.cpp"
+#include "memtrack.cpp"
+#include "geometrypool.cpp"
+#include "texturestream.cpp"
+#include "scenegraph.cpp"
+#include "lightbinning.cpp"
+#include "clusteredlights.cpp"
 #include "building.cpp"
-#include "floor.cpp"
+#include "terrain.cpp"
+#include "animation.cpp"
+#include "transforms.cpp"
 #include "model.cpp"
 #include "skybox.cpp"
+#include "frustum.cpp"
+#include "bvh.cpp"
+#include "depthimage.cpp"
+#include "occlusion.cpp"
+#include "gpudriven.cpp"
+#include "dynres.cpp"
+#include "chunk.cpp"
 
 static GLFWwindow *window;
 static int windowWidth = 1024;
@@ -56,208 +77,20 @@ static float depthFar = 0.f;
 // Helper flag and function to save depth maps for debugging
 static bool saveDepth = false;
 
-struct Vec2Hash {
-    std::size_t operator()(const glm::vec2& v) const {
-        return std::hash<float>()(v.x) ^ (std::hash<float>()(v.y) << 1);
-    }
-};
+static JobSystem *jobSystem;
+static ChunkManager *chunkManager;
 
-struct Chunk {
-    glm::vec2 position;
-    std::vector<Building> buildings;
-    static const int BUILDINGS_PER_SIDE = 8;
-    static const constexpr float GAP = 200.0f;
-
-    void initialize(const glm::vec2& pos, const glm::vec3& lightPos, const glm::vec3& lightIntensity) {
-        position = pos;
-
-        // Create buildings only if they don't exist yet
-        if (buildings.empty()) {
-            for (int i = 0; i < BUILDINGS_PER_SIDE; i++) {
-                for (int j = 0; j < BUILDINGS_PER_SIDE; j++) {
-                    Building b;
-                    float x = (i - BUILDINGS_PER_SIDE/2) * GAP;
-                    float z = (j - BUILDINGS_PER_SIDE/2) * GAP;
-
-                    float height = 100.0f + ((i * BUILDINGS_PER_SIDE + j) % 3) * 100.0f;
-
-                    glm::vec3 buildingPos(x, 0, z);
-                    b.initialize(buildingPos,
-                                 glm::vec3(20, height, 20),
-                                 lightPos,
-                                 lightIntensity);
-                    buildings.push_back(b);
-                }
-            }
-        }
+// Camera collision
+static const float cameraRadius = 10.0f;
+static AssetPreloader *startupAssets;
 
-        // Update positions based on chunk position
-        updatePosition(pos);
-    }
-
-    void updatePosition(const glm::vec2& newPos) {
-        position = newPos;
-        float chunkWidth = BUILDINGS_PER_SIDE * GAP;
-        float baseX = position.x * chunkWidth;
-        float baseZ = position.y * chunkWidth;
-
-        // Update each building's position
-        for (int i = 0; i < BUILDINGS_PER_SIDE; i++) {
-            for (int j = 0; j < BUILDINGS_PER_SIDE; j++) {
-                int index = i * BUILDINGS_PER_SIDE + j;
-                float x = baseX + (i - BUILDINGS_PER_SIDE/2) * GAP;
-                float z = baseZ + (j - BUILDINGS_PER_SIDE/2) * GAP;
-
-                buildings[index].updatePosition(glm::vec3(x, 0, z));
-            }
-        }
-    }
-
-    void cleanup() {
-        for (Building& b : buildings) {
-            b.cleanup();
-        }
-        buildings.clear();
-    }
-};
-
-class ChunkManager {
-private:
-    std::unordered_map<glm::vec2, Chunk, Vec2Hash> activeChunks;
-    std::vector<Chunk> recycledChunks;  // Pool of chunks to reuse
-    int renderDistance;
-    glm::vec3 lightPosition;
-    glm::vec3 lightIntensity;
-    glm::vec2 lastUpdatePos;
-    float chunkWidth;
-
-public:
-    ChunkManager(int distance, const glm::vec3& lightPos, const glm::vec3& lightInt)
-            : renderDistance(distance),
-              lightPosition(lightPos),
-              lightIntensity(lightInt),
-              lastUpdatePos(glm::vec2(FLT_MAX))
-    {
-        chunkWidth = Chunk::BUILDINGS_PER_SIDE * Chunk::GAP;
-    }
-
-    glm::vec2 worldToChunkCoords(const glm::vec3& worldPos) {
-        return glm::vec2(
-                floor(worldPos.x / chunkWidth),
-                floor(worldPos.z / chunkWidth)
-        );
-    }
-
-    void update(const glm::vec3& cameraPos) {
-        glm::vec2 currentChunk = worldToChunkCoords(cameraPos);
-        if (currentChunk == lastUpdatePos) return;
-
-        glm::vec2 chunkDiff = currentChunk - lastUpdatePos;
-
-        // If first update or large movement, do full reset
-        if (lastUpdatePos.x > 1000000.0f || abs(chunkDiff.x) > renderDistance || abs(chunkDiff.y) > renderDistance) {
-            // Move all chunks to recycled pool
-            for (auto& chunk : activeChunks) {
-                recycledChunks.push_back(std::move(chunk.second));
-            }
-            activeChunks.clear();
-
-            // Create initial chunks, reusing from pool when possible
-            for (int x = -renderDistance; x <= renderDistance; x++) {
-                for (int z = -renderDistance; z <= renderDistance; z++) {
-                    glm::vec2 pos = currentChunk + glm::vec2(x, z);
-
-                    Chunk* chunk;
-                    if (!recycledChunks.empty()) {
-                        activeChunks[pos] = std::move(recycledChunks.back());
-                        recycledChunks.pop_back();
-                        chunk = &activeChunks[pos];
-                    } else {
-                        chunk = &activeChunks[pos];
-                    }
-                    chunk->initialize(pos, lightPosition, lightIntensity);
-                }
-            }
-        } else {
-            // Incremental update - only handle the new edge chunks
-            int dx = static_cast<int>(chunkDiff.x);
-            int dz = static_cast<int>(chunkDiff.y);
-
-            // Move chunks that are now out of range to recycled pool
-            if (dx != 0) {
-                int removeX = dx > 0 ? currentChunk.x - renderDistance - 1 : currentChunk.x + renderDistance + 1;
-                for (int z = currentChunk.y - renderDistance; z <= currentChunk.y + renderDistance; z++) {
-                    auto it = activeChunks.find(glm::vec2(removeX, z));
-                    if (it != activeChunks.end()) {
-                        recycledChunks.push_back(std::move(it->second));
-                        activeChunks.erase(it);
-                    }
-                }
-            }
-            if (dz != 0) {
-                int removeZ = dz > 0 ? currentChunk.y - renderDistance - 1 : currentChunk.y + renderDistance + 1;
-                for (int x = currentChunk.x - renderDistance; x <= currentChunk.x + renderDistance; x++) {
-                    auto it = activeChunks.find(glm::vec2(x, removeZ));
-                    if (it != activeChunks.end()) {
-                        recycledChunks.push_back(std::move(it->second));
-                        activeChunks.erase(it);
-                    }
-                }
-            }
-
-            // Add new chunks that are now in range, reusing from pool
-            if (dx != 0) {
-                int newX = dx > 0 ? currentChunk.x + renderDistance : currentChunk.x - renderDistance;
-                for (int z = currentChunk.y - renderDistance; z <= currentChunk.y + renderDistance; z++) {
-                    glm::vec2 pos(newX, z);
-                    if (activeChunks.find(pos) == activeChunks.end()) {
-                        if (!recycledChunks.empty()) {
-                            activeChunks[pos] = std::move(recycledChunks.back());
-                            recycledChunks.pop_back();
-                        }
-                        activeChunks[pos].initialize(pos, lightPosition, lightIntensity);
-                    }
-                }
-            }
-            if (dz != 0) {
-                int newZ = dz > 0 ? currentChunk.y + renderDistance : currentChunk.y - renderDistance;
-                for (int x = currentChunk.x - renderDistance; x <= currentChunk.x + renderDistance; x++) {
-                    glm::vec2 pos(x, newZ);
-                    if (activeChunks.find(pos) == activeChunks.end()) {
-                        if (!recycledChunks.empty()) {
-                            activeChunks[pos] = std::move(recycledChunks.back());
-                            recycledChunks.pop_back();
-                        }
-                        activeChunks[pos].initialize(pos, lightPosition, lightIntensity);
-                    }
-                }
-            }
-        }
-
-        lastUpdatePos = currentChunk;
-    }
-
-    void render(const glm::mat4& vp) {
-        for (auto& pair : activeChunks) {
-            for (Building& building : pair.second.buildings) {
-                building.render(vp);
-            }
-        }
-    }
-
-    void cleanup() {
-        for (auto& pair : activeChunks) {
-            pair.second.cleanup();
-        }
-        for (auto& chunk : recycledChunks) {
-            chunk.cleanup();
-        }
-        activeChunks.clear();
-        recycledChunks.clear();
-    }
-};
+// Off while --bench-render measures frames, the synchronous queries and the
+// console output would dominate the frame time
+static bool traceGLState = true;
 
 void checkOpenGLState(const char* label) {
+    if (!traceGLState) return;
+
     GLint program, vao, array_buffer, element_buffer;
     glGetIntegerv(GL_CURRENT_PROGRAM, &program);
     glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
@@ -281,11 +114,14 @@ void checkOpenGLState(const char* label) {
 }
 
 // This function retrieves and stores the depth map of the default frame buffer
-// or a particular frame buffer (indicated by FBO ID) to a PNG image.
-static void saveDepthTexture(GLuint fbo, std::string filename) {
-    int width = shadowMapWidth;
-    int height = shadowMapHeight;
-	if (shadowMapWidth == 0 || shadowMapHeight == 0) {
+// or a particular frame buffer (indicated by FBO ID) to a PNG image. A size
+// of 0 reads the whole framebuffer.
+static void saveDepthTexture(GLuint fbo, std::string filename, int width = 0, int height = 0) {
+    if (width == 0 || height == 0) {
+        width = shadowMapWidth;
+        height = shadowMapHeight;
+    }
+	if (width == 0 || height == 0) {
 		width = windowWidth;
 		height = windowHeight;
 	}
@@ -298,38 +134,197 @@ static void saveDepthTexture(GLuint fbo, std::string filename) {
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     std::vector<unsigned char> img(width * height * 3);
-    for (int i = 0; i < width * height; ++i) img[3*i] = img[3*i+1] = img[3*i+2] = depth[i] * 255;
+    ConvertDepthToRgb(depth.data(), width * height, img.data());
 
     stbi_write_png(filename.c_str(), width, height, channels, img.data(), width * channels);
 }
 
-bool isBuildingInView(const glm::vec3 &position, const glm::mat4 &vp) {
-    glm::vec4 clipSpacePos = vp* glm::vec4(position, 1.0f);
+// The planes fly back and forth along z around the view target. They share
+// one Model and are drawn instanced with matrices from the transform system.
+static Model *planeModel = nullptr;
+static TransformSystem planeTransforms;
+static const int NUM_MODELS = 5;
+static const int MODELS_PER_ROW = 100;
+static const float MODEL_SPACING = 200.0f;
 
-    if (clipSpacePos.w != 0.0f) {
-        clipSpacePos /= clipSpacePos.w;
+// --character loads a skinned model and plays its clips on a crowd of
+// instances laid out in a square around the view target
+static Model *character = nullptr;
+static AnimationSystem crowd;
+static const float CROWD_SPACING = 60.0f;
+
+// --bench-render flies the camera along the city for a fixed number of frames
+// on each chunk rendering path (GL 3.3 per-building, then GPU-driven if the
+// context supports it) and reports the average CPU time per frame of each
+struct RenderBenchmark {
+    static const int WARMUP_FRAMES = 60;
+    static const int FRAMES_PER_PATH = 600;
+    static constexpr float SPEED = 20.0f;
+
+    bool active = false;
+    int pathIndex = 0;          // 0 = GL 3.3 path, 1 = GPU-driven path
+    int frame = 0;
+    double chunkCpuMs[2] = {0.0, 0.0};
+    double frameCpuMs[2] = {0.0, 0.0};
+    double frameGpuMs[2] = {0.0, 0.0};
+    double lightBinMs[2] = {0.0, 0.0};
+    unsigned long matricesRecomputed[2] = {0, 0};
+    double buildingsDrawn[2] = {0.0, 0.0};
+    double buildingsCulled[2] = {0.0, 0.0};
+    int cullFrames[2] = {0, 0};     // Frames whose culling results were known
+    int lightCount = 0;
+    int measuredFrames[2] = {0, 0};
+
+    void start() {
+        active = true;
+        traceGLState = false;
+        pathIndex = 0;
+        frame = 0;
+        chunkManager->setGpuDriven(false);
+        resetCamera();
     }
 
-    return (clipSpacePos.x >= -1.0f && clipSpacePos.x <= 1.0f &&
-            clipSpacePos.y >= -1.0f && clipSpacePos.y <= 1.0f &&
-            clipSpacePos.z >= -1.0f && clipSpacePos.z <= 1.0f);
-}
+    void resetCamera() {
+        eye_center = glm::vec3(0, 250, 800);
+        lookat = glm::vec3(0, 200, 0);
+        skybox.pos = glm::vec3(0);
+    }
 
-struct AnimatedModel {
-    Model* model;
-    float offset;  // Offset for animation timing
-    glm::vec3 basePosition; // Store original position for animation
+    void step() {
+        eye_center.z -= SPEED;
+        lookat.z -= SPEED;
+        skybox.pos.z -= SPEED;
+    }
+
+    // Returns false once every path has been measured
+    bool endFrame(double chunkMs, double frameMs, double gpuMs, const LightBinStats& lights) {
+        if (frame >= WARMUP_FRAMES) {
+            chunkCpuMs[pathIndex] += chunkMs;
+            frameCpuMs[pathIndex] += frameMs;
+            frameGpuMs[pathIndex] += gpuMs;
+            lightBinMs[pathIndex] += lights.transformMs + lights.binMs;
+            lightCount = lights.lights;
+            matricesRecomputed[pathIndex] += transformCounters.recomputedThisFrame;
+            const ChunkRenderStats& renderStats = chunkManager->lastRenderStats();
+            if (renderStats.buildingsDrawn >= 0) {
+                buildingsDrawn[pathIndex] += renderStats.buildingsDrawn;
+                buildingsCulled[pathIndex] += renderStats.buildingsCulled;
+                cullFrames[pathIndex]++;
+            }
+            measuredFrames[pathIndex]++;
+        }
+        if (++frame < WARMUP_FRAMES + FRAMES_PER_PATH) return true;
+
+        frame = 0;
+        resetCamera();
+        if (pathIndex == 0 && chunkManager->setGpuDriven(true)) {
+            pathIndex = 1;
+            return true;
+        }
+
+        report();
+        active = false;
+        traceGLState = true;
+        return false;
+    }
 
-    AnimatedModel(Model* m, const glm::vec3& pos, float timeOffset)
-            : model(m), basePosition(pos), offset(timeOffset) {}
+    void report() {
+        const char *names[2] = {"gl33", "gpu-driven"};
+        std::cout << std::fixed << std::setprecision(3);
+        for (int i = 0; i < 2; i++) {
+            if (measuredFrames[i] == 0) {
+                std::cout << "path=" << names[i] << " unavailable" << std::endl;
+                continue;
+            }
+            std::cout << "path=" << names[i]
+                      << " frames=" << measuredFrames[i]
+                      << " chunk_cpu_ms=" << chunkCpuMs[i] / measuredFrames[i]
+                      << " frame_cpu_ms=" << frameCpuMs[i] / measuredFrames[i]
+                      << " frame_gpu_ms=" << frameGpuMs[i] / measuredFrames[i]
+                      << " lights=" << lightCount
+                      << " light_bin_ms=" << lightBinMs[i] / measuredFrames[i]
+                      << " matrices_recomputed_per_frame=" << double(matricesRecomputed[i]) / measuredFrames[i];
+            if (cullFrames[i] > 0)
+                std::cout << " buildings_drawn=" << buildingsDrawn[i] / cullFrames[i]
+                          << " buildings_culled=" << buildingsCulled[i] / cullFrames[i];
+            else
+                std::cout << " buildings_drawn=n/a buildings_culled=n/a";
+            std::cout << std::endl;
+        }
+        std::cout << "memory=";
+        memoryTracker.writeJson(std::cout);
+        std::cout << std::endl;
+    }
 };
 
-static std::vector<AnimatedModel> animatedModels;
-static const int NUM_MODELS = 5;
-static const float MODEL_SPACING = 200.0f;
+static RenderBenchmark renderBenchmark;
+static DynamicResolution dynamicResolution;
+static FrameArena frameArena;
+static ClusteredLighting clusteredLighting;
+
+static void PrintImportStats(const std::string &path, const ModelImportStats &stats) {
+    std::cout << "Model import: " << path << ": " << stats.meshes << " meshes, "
+              << stats.vertices << " vertices, " << stats.indices << " indices, read " << stats.readMs
+              << " ms, convert " << stats.convertMs << " ms on " << stats.threads << " threads, upload "
+              << stats.uploadMs << " ms" << std::endl;
+}
 
-int main(void)
+int main(int argc, char **argv)
 {
+	// --workers N overrides the job system's worker count, for scaling measurements
+	unsigned int workerCount = JobSystem::defaultWorkerCount();
+	bool gpuDriven = false;
+	bool benchRender = false;
+	float frameTargetMs = 16.6f;
+	int lightCount = -1;
+	std::string characterPath;
+	int characterCount = 64;
+	// --model PATH flies another model, e.g. a multi-mesh one, instead of the plane
+	std::string planePath = "../assignment/assets/uploads_files_5572778_PLANE (1).obj";
+	// --mesh-residency keep|gpu-only|compressed: what models keep on the CPU after upload
+	MeshResidency meshResidency = MESH_KEEP_CPU;
+	int modelCount = NUM_MODELS;
+	// --texture-budget MB caps what streamed textures keep resident
+	size_t textureBudgetMB = 96;
+	// --asset-pack PATH loads from that pack instead of assets.pak next to the
+	// executable, --loose-assets ignores any pack
+	std::string assetPackPath;
+	bool looseAssets = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--workers" && i + 1 < argc) {
+			workerCount = static_cast<unsigned int>(atoi(argv[++i]));
+		} else if (arg == "--frame-target-ms" && i + 1 < argc) {
+			frameTargetMs = static_cast<float>(atof(argv[++i]));
+		} else if (arg == "--no-dynres") {
+			dynamicResolution.enabled = false;
+		} else if (arg == "--gpu-driven") {
+			gpuDriven = true;
+		} else if (arg == "--bench-render") {
+			benchRender = true;
+		} else if (arg == "--lights" && i + 1 < argc) {
+			lightCount = atoi(argv[++i]);
+		} else if (arg == "--models" && i + 1 < argc) {
+			modelCount = atoi(argv[++i]);
+		} else if (arg == "--mesh-residency" && i + 1 < argc) {
+			if (!ParseMeshResidency(argv[++i], meshResidency)) {
+				std::cerr << "Unknown mesh residency " << argv[i] << ", keeping CPU copies" << std::endl;
+			}
+		} else if (arg == "--model" && i + 1 < argc) {
+			planePath = argv[++i];
+		} else if (arg == "--character" && i + 1 < argc) {
+			characterPath = argv[++i];
+		} else if (arg == "--characters" && i + 1 < argc) {
+			characterCount = atoi(argv[++i]);
+		} else if (arg == "--texture-budget" && i + 1 < argc) {
+			textureBudgetMB = static_cast<size_t>(atoi(argv[++i]));
+		} else if (arg == "--asset-pack" && i + 1 < argc) {
+			assetPackPath = argv[++i];
+		} else if (arg == "--loose-assets") {
+			looseAssets = true;
+		}
+	}
+
 	// Initialise GLFW
 	if (!glfwInit())
 	{
@@ -337,7 +332,8 @@ int main(void)
 		return -1;
 	}
 
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	// Ask for 4.3 so the GPU-driven city path is available, fall back to 3.3
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // For MacOS
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -345,6 +341,12 @@ int main(void)
 	// Open a window and create its OpenGL context
 	window = glfwCreateWindow(windowWidth, windowHeight, "Lab 3", NULL, NULL);
 	if (window == NULL)
+	{
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		window = glfwCreateWindow(windowWidth, windowHeight, "Lab 3", NULL, NULL);
+	}
+	if (window == NULL)
 	{
 		std::cerr << "Failed to open a GLFW window." << std::endl;
 		glfwTerminate();
@@ -365,6 +367,8 @@ int main(void)
 		std::cerr << "Failed to initialize OpenGL context." << std::endl;
 		return -1;
 	}
+	LoadGLExtensions(version, glfwGetProcAddress);
+	EnableProgramBinaryCache("shader_cache.bin");
 
 	// Prepare shadow map size for shadow mapping. Usually this is the size of the window itself, but on some platforms like Mac this can be 2x the size of the window. Use glfwGetFramebufferSize to get the shadow map size properly.
     glfwGetFramebufferSize(window, &shadowMapWidth, &shadowMapHeight);
@@ -375,29 +379,135 @@ int main(void)
 	glEnable(GL_DEPTH_TEST);
 	glDisable(GL_CULL_FACE);
 
-    glm::vec3 skyboxScale(1300.0f);
-    skybox.initialize(glm::vec3(0,0,0), skyboxScale);
+    // Assets in the pack are read from its mapping, anything else from the
+    // loose files under ../assignment
+    if (assetPackPath.empty()) {
+        std::string executable = argv[0];
+        size_t slash = executable.find_last_of("/\\");
+        assetPackPath = (slash == std::string::npos ? std::string() : executable.substr(0, slash + 1)) + "assets.pak";
+    }
+    if (!looseAssets && !assetFiles.openPack(assetPackPath)) {
+        std::cout << "No asset pack at " << assetPackPath << ", loading loose files" << std::endl;
+    }
 
-    Floor floor;
-    floor.initialize(glm::vec3(0, 0, 100), glm::vec2(5000,5000), lightPosition, lightIntensity);
+    // Decode every startup asset on the job system first, the GL objects
+    // below are then created from memory on this thread
+    jobSystem = new JobSystem(workerCount);
+    startupAssets = new AssetPreloader(*jobSystem);
+    // Model imports convert their meshes on the job system too
+    ModelData planeData;
+    startupAssets->requestCustom(planePath, [&planeData, &planePath] {
+        return Model::importModel(planePath, planeData, jobSystem);
+    });
+    ModelData characterData;
+    if (!characterPath.empty()) {
+        startupAssets->requestCustom(characterPath, [&characterData, &characterPath] {
+            return Model::importModel(characterPath, characterData, jobSystem);
+        });
+    }
+    startupAssets->requestImage("../assignment/assets/cubemap.png");
+    startupAssets->requestImage("../assignment/assets/floor.jpg");
+    for (const char *path : facadeTexturePaths) {
+        startupAssets->requestImage(path);
+    }
+    const char *shaderPaths[] = {
+            "../assignment/shaders/skybox.vert", "../assignment/shaders/skybox.frag",
+            "../assignment/shaders/standardObj.vert", "../assignment/shaders/standardObj.frag",
+            "../assignment/shaders/terrain.vert", "../assignment/shaders/terrain.frag",
+            "../assignment/shaders/bbox.vert", "../assignment/shaders/bbox.frag",
+            "../assignment/shaders/upscale.vert", "../assignment/shaders/upscale.frag",
+            "../assignment/shaders/mesh.vert", "../assignment/shaders/mesh.frag",
+            "../assignment/shaders/clustered_lighting.glsl"
+    };
+    for (const char *path : shaderPaths) {
+        startupAssets->requestText(path);
+    }
+    if (HasGL43()) {
+        startupAssets->requestText("../assignment/shaders/cull.comp");
+        startupAssets->requestText("../assignment/shaders/city.vert");
+        startupAssets->requestText("../assignment/shaders/city.frag");
+    }
+    startupAssets->wait();
 
-    static ChunkManager *chunkManager;
-    chunkManager = new ChunkManager(1, lightPosition, lightIntensity);
+    activePreloader = startupAssets;
+    SetShaderSourceProvider(AssetShaderSource);
+    textureStreamer.initialize(*jobSystem, textureBudgetMB);
 
-    std::vector<Model*> modelInstances;
-    for (int i = 0; i < NUM_MODELS; i++) {
-        float xPos = (i - NUM_MODELS/2) * MODEL_SPACING;  // Spread models along x-axis
-        glm::vec3 position(xPos, 400, 0);
+    startupAssets->beginUpload("dynamic resolution");
+    dynamicResolution.initialize(shadowMapWidth, shadowMapHeight, frameTargetMs);
+    startupAssets->endUpload("dynamic resolution");
 
-        Model* newModel = new Model(
-                "../assignment/assets/uploads_files_5572778_PLANE (1).obj",
-                position,
-                glm::vec3(5)
-        );
-        modelInstances.push_back(newModel);
+    startupAssets->beginUpload("skybox");
+    glm::vec3 skyboxScale(1300.0f);
+    skybox.initialize(glm::vec3(0,0,0), skyboxScale);
+    startupAssets->endUpload("skybox");
+
+    startupAssets->beginUpload("lights");
+    clusteredLighting.initialize();
+    startupAssets->endUpload("lights");
+
+    startupAssets->beginUpload("terrain");
+    ClipmapTerrain terrain;
+    terrain.initialize(lightPosition, lightIntensity, *jobSystem);
+    terrain.update(eye_center);
+    startupAssets->endUpload("terrain");
+
+    startupAssets->beginUpload("chunks");
+    chunkManager = new ChunkManager(1, lightPosition, lightIntensity, *jobSystem);
+    chunkManager->setFrameArena(&frameArena);
+    // --lights N spreads N point lights over the chunk window
+    if (lightCount >= 0) {
+        chunkManager->setLightsPerChunk(lightCount / chunkManager->windowChunkCount());
+    }
+    if (gpuDriven && !chunkManager->setGpuDriven(true)) {
+        std::cout << "GPU-driven rendering needs a GL 4.3 context, using the GL 3.3 path" << std::endl;
+    }
+    startupAssets->endUpload("chunks");
+
+    // The plane is imported once and shared by every instance
+    startupAssets->beginUpload(planePath);
+    Model::sharedShader();
+    planeModel = new Model(std::move(planeData), glm::vec3(0), glm::vec3(5), meshResidency);
+    PrintImportStats(planePath, planeModel->importStats);
+    int rowLength = glm::min(modelCount, MODELS_PER_ROW);
+    for (int i = 0; i < modelCount; i++) {
+        // Spread models along the x-axis, further rows behind the first
+        glm::vec3 position((i % MODELS_PER_ROW - rowLength/2) * MODEL_SPACING, 400, -(i / MODELS_PER_ROW) * MODEL_SPACING);
+        int instance = planeTransforms.add(position, glm::radians(180.0f), glm::vec3(5));
 
         float timeOffset = i * 0.5f;  // Offset animation timing for each model
-        animatedModels.emplace_back(newModel, position, timeOffset);
+        planeTransforms.setOscillation(instance, glm::vec3(0, 0, 1), 100.0f, 2.0f, timeOffset);
+    }
+    startupAssets->endUpload(planePath);
+
+    if (!characterData.meshes.empty()) {
+        startupAssets->beginUpload(characterPath);
+        character = new Model(std::move(characterData), glm::vec3(0), glm::vec3(1), meshResidency);
+        PrintImportStats(characterPath, character->importStats);
+        crowd.setSkeleton(&character->skeleton, &character->clips);
+        for (int i = 0; i < characterCount; i++) {
+            crowd.addCharacter(i, i * 0.37f, 0.8f + 0.4f * (i % 5) / 4.0f);
+        }
+        std::cout << "Character: " << character->meshes.size() << " meshes, "
+                  << character->skeleton.boneCount() << " bones, " << character->clips.size() << " clips"
+                  << (character->skinned ? "" : " (not skinned)") << std::endl;
+        startupAssets->endUpload(characterPath);
+    }
+
+    // Anything loaded from here on comes from the pack or loose files
+    activePreloader = nullptr;
+
+    meshResidencyStats.print(std::cout);
+    geometryPool.print(std::cout);
+    FlushProgramBinaryCache();
+    ProgramCacheStats programCache = GetProgramCacheStats();
+    std::cout << "Program binary cache: " << programCache.hits << " hits, " << programCache.misses << " misses, "
+              << programCache.invalidated << " invalidated, " << programCache.stored << " stored" << std::endl;
+    assetFiles.printStats(std::cout);
+
+    if (benchRender) {
+        glfwSwapInterval(0);
+        renderBenchmark.start();
     }
 
 	// Camera setup
@@ -419,16 +529,31 @@ int main(void)
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
 	do {
+        auto frameStart = std::chrono::steady_clock::now();
+        frameArena.beginFrame();
+        transformCounters.beginFrame();
+        if (renderBenchmark.active) {
+            renderBenchmark.step();
+        }
+
         double currentTime = glfwGetTime();
         float deltaTime = float(currentTime - lastTime);
         lastTime = currentTime;
 
         time += deltaTime;
 
+        dynamicResolution.beginFrame();
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         viewMatrix = glm::lookAt(eye_center, lookat, up);
         glm::mat4 vp = projectionMatrix * viewMatrix;
+        textureStreamer.setView(projectionMatrix, dynamicResolution.renderHeight);
+
+        // Lights follow the chunk window as of the last update, so they lag
+        // one frame behind when a new row of chunks streams in
+        clusteredLighting.update(chunkManager->pointLights(), viewMatrix, glm::radians(FoV),
+                                 (float)windowWidth / windowHeight, zNear, zFar,
+                                 dynamicResolution.renderWidth, dynamicResolution.renderHeight, jobSystem);
 
         // Render objects here
 
@@ -442,29 +567,42 @@ int main(void)
         //glDisable(GL_DEPTH_TEST);
         checkOpenGLState("After skybox");
 
-        checkOpenGLState("Before floor");
-        floor.render(vp);
-        floor.updatePosition(glm::vec3(eye_center.x, 0, eye_center.z));
-        checkOpenGLState("After floor");
+        checkOpenGLState("Before terrain");
+        terrain.update(eye_center);
+        terrain.render(vp);
+        checkOpenGLState("After terrain");
 
         checkOpenGLState("Before buildings");
+        auto chunkStart = std::chrono::steady_clock::now();
         chunkManager->update(eye_center);
-        chunkManager->render(vp);
+        chunkManager->render(vp, eye_center);
+        double chunkCpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - chunkStart).count();
         checkOpenGLState("After buildings");
 
         checkOpenGLState("Before model");
-        for (auto& anim : animatedModels) {
-            // Calculate new position with z-axis animation
-            glm::vec3 newPos = anim.basePosition;
-            newPos.z += sin(time * 2.0f + anim.offset) * 100.0f + lookat.z;
-            newPos.x += lookat.x;
-
-            // Update model's modelMatrix for the new position
-            anim.model->pos = newPos;
-            anim.model->Draw(vp);
+        planeTransforms.origin = glm::vec3(lookat.x, 0.0f, lookat.z);
+        planeTransforms.update(time, jobSystem);
+        const std::vector<glm::mat4>& planeMatrices = planeTransforms.worldMatrices();
+        planeModel->DrawInstanced(vp, planeMatrices.data(), planeTransforms.size());
+
+        if (character) {
+            crowd.update(deltaTime, jobSystem);
+            skinningPalettes.upload(crowd.allPalettes());
+            int side = static_cast<int>(ceil(sqrt(float(crowd.characterCount()))));
+            for (int i = 0; i < crowd.characterCount(); i++) {
+                character->pos = glm::vec3(lookat.x + (i % side - side / 2) * CROWD_SPACING, 20.0f,
+                                           lookat.z + (i / side - side / 2) * CROWD_SPACING);
+                character->paletteOffset = i * crowd.boneCount();
+                character->Draw(vp);
+            }
         }
         checkOpenGLState("After model");
 
+        // Everything has asked for its texture detail by now
+        textureStreamer.update();
+
+        dynamicResolution.endFrame();
+
         // FPS tracking
         // Count number of frames over a few seconds and take average
         frames++;
@@ -474,20 +612,101 @@ int main(void)
             frames = 0;
             fTime = 0;
 
-            std::stringstream stream;
-            stream << std::fixed << std::setprecision(2) << "Frames per second (FPS): " << fps;
-            glfwSetWindowTitle(window, stream.str().c_str());
+            glfwSetWindowTitle(window, frameArena.format("Frames per second (FPS): %.2f", fps));
+
+            const OcclusionStats& occlusionStats = chunkManager->occlusionStats();
+            std::cout << "Occlusion: " << occlusionStats.queriesIssued << " queries issued, "
+                      << occlusionStats.chunksSkipped << " chunks skipped, "
+                      << occlusionStats.conditionalDraws << " conditional draws, "
+                      << occlusionStats.chunksDrawn << " chunks drawn" << std::endl;
+
+            const ChunkRenderStats& renderStats = chunkManager->lastRenderStats();
+            std::cout << "Chunk render (" << (chunkManager->isGpuDriven() ? "GPU-driven" : "GL 3.3") << "): classify " << renderStats.classifyMs << " ms, build "
+                      << renderStats.buildMs << " ms on " << jobSystem->workerCount() << " workers, submit "
+                      << renderStats.submitMs << " ms, ";
+            if (renderStats.buildingsDrawn < 0)
+                std::cout << "culling results pending" << std::endl;
+            else
+                std::cout << renderStats.buildingsDrawn << " buildings drawn, " << renderStats.buildingsCulled << " culled" << std::endl;
+
+            const ChunkCacheStats& cacheStats = chunkManager->cacheStats();
+            std::cout << "Chunk cache: " << cacheStats.hitRate() * 100.0f << "% hit rate, "
+                      << cacheStats.entries << " chunks, "
+                      << cacheStats.residentBytes / (1024.0f * 1024.0f) << " MB resident, "
+                      << cacheStats.evictions << " evictions" << std::endl;
+
+            const ChunkBvhStats& bvhStats = chunkManager->spatialStats();
+            std::cout << "Chunk BVH: " << bvhStats.chunks << " chunks, " << bvhStats.nodes << " nodes, "
+                      << bvhStats.chunkTrees << " chunk trees built, top level " << bvhStats.topLevelMs << " ms" << std::endl;
+
+            const ResolutionController& resolution = dynamicResolution.controller;
+            std::cout << "Resolution: scale " << dynamicResolution.scale()
+                      << " (" << dynamicResolution.renderWidth << "x" << dynamicResolution.renderHeight << "), gpu "
+                      << dynamicResolution.lastGpuMs << " ms, target " << resolution.targetMs << " ms, last decision "
+                      << resolution.decisionName() << ", " << resolution.lowered << " lowered, "
+                      << resolution.raised << " raised, " << resolution.held << " held"
+                      << (dynamicResolution.enabled ? "" : " (disabled)") << std::endl;
+
+            const LightBinStats& lightStats = clusteredLighting.stats();
+            std::cout << "Lights: " << lightStats.lights << " total, " << lightStats.lightsVisible << " in view, "
+                      << lightStats.indices << " cluster entries (max " << lightStats.maxPerCluster
+                      << " per cluster), binned in " << lightStats.transformMs + lightStats.binMs << " ms" << std::endl;
+
+            std::cout << "World matrices: " << transformCounters.recomputedThisFrame << " recomputed this frame, "
+                      << transformCounters.recomputedTotal << " in total" << std::endl;
+
+            std::cout << "Transforms: " << planeTransforms.stats.instances << " planes in "
+                      << planeTransforms.stats.updateMs << " ms ("
+                      << planeTransforms.stats.transformsPerSecond() / 1.0e6 << " M transforms/s)" << std::endl;
+
+            if (character) {
+                std::cout << "Animation: " << crowd.stats.characters << " characters x " << crowd.stats.bones
+                          << " bones in " << crowd.stats.updateMs << " ms ("
+                          << crowd.stats.characters / glm::max(crowd.stats.updateMs, 1e-3) << " characters/ms)" << std::endl;
+            }
+
+            std::cout << "Terrain: " << terrain.stats.triangles << " triangles, "
+                      << terrain.stats.texelsUpdated << " height texels streamed last frame in "
+                      << terrain.stats.updateMs << " ms" << std::endl;
+
+            const FrameArenaStats& arenaStats = frameArena.frameStats();
+            std::cout << "Frame arena: " << arenaStats.lastFrameBytes / 1024.0f << " KB last frame, peak "
+                      << arenaStats.peakFrameBytes / 1024.0f << " KB of " << arenaStats.capacityBytes / 1024.0f
+                      << " KB, " << arenaStats.totalFallbacks << " heap fallbacks ("
+                      << arenaStats.totalFallbackBytes / 1024.0f << " KB)" << std::endl;
+
+            std::cout << "Textures: " << textureStreamer.residentBytes() / (1024.0f * 1024.0f) << " MB resident of "
+                      << textureStreamer.budgetBytes / (1024.0f * 1024.0f) << " MB budget, "
+                      << textureStreamer.loadsInFlight() << " loads in flight, average streaming latency "
+                      << textureStreamer.averageLatencyMs() << " ms" << std::endl;
+
+            std::cout << "Memory: GPU " << memoryTracker.gpuBytes() / (1024.0f * 1024.0f) << " MB (peak "
+                      << memoryTracker.gpuPeakBytes() / (1024.0f * 1024.0f) << " MB), CPU tracked "
+                      << memoryTracker.cpuBytes() / (1024.0f * 1024.0f) << " MB, M for details" << std::endl;
         }
 
 		if (saveDepth) {
             std::string filename = "depth_camera.png";
-            saveDepthTexture(0, filename);
+            // Only the current render size of the offscreen target holds this frame
+            if (dynamicResolution.enabled)
+                saveDepthTexture(dynamicResolution.framebufferID, filename,
+                                 dynamicResolution.renderWidth, dynamicResolution.renderHeight);
+            else
+                saveDepthTexture(0, filename);
             std::cout << "Depth texture saved to " << filename << std::endl;
             saveDepth = false;
         }
 
+		if (renderBenchmark.active) {
+			double frameCpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+			if (!renderBenchmark.endFrame(chunkCpuMs, frameCpuMs, dynamicResolution.lastGpuMs, clusteredLighting.stats())) {
+				glfwSetWindowShouldClose(window, GL_TRUE);
+			}
+		}
+
 		// Swap buffers
 		glfwSwapBuffers(window);
+		startupAssets->markFirstFrame();
 		glfwPollEvents();
 
 
@@ -496,18 +715,54 @@ int main(void)
 
 	// Clean up here
 
+    dynamicResolution.cleanup();
+
     skybox.cleanup();
 
-    floor.cleanup();
+    terrain.cleanup();
+
+    clusteredLighting.cleanup();
 
     chunkManager->cleanup();
 
+    planeModel->cleanup();
+    delete planeModel;
+    if (character) {
+        character->cleanup();
+        delete character;
+    }
+    skinningPalettes.cleanup();
+    glDeleteProgram(Model::sharedShader()->ID);
+    geometryPool.cleanup();
+    textureStreamer.cleanup();
+    FlushProgramBinaryCache();
+
+    startupAssets->printTimeline(std::cout);
+    delete startupAssets;
+
+    memoryTracker.printReport(std::cout);
+    memoryTracker.reportLeaks(std::cout);
+
+    delete jobSystem;
+
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
 
 	return 0;
 }
 
+// Moves the camera as a small sphere, sliding along buildings instead of
+// passing through them
+static void moveCamera(const glm::vec3 &delta)
+{
+	glm::vec3 moved = delta;
+	if (chunkManager)
+		moved = chunkManager->moveSphere(eye_center, delta, cameraRadius) - eye_center;
+	eye_center += moved;
+	lookat += moved;
+	skybox.pos += moved;
+}
+
 static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode)
 {
     float movementSpeed = 20.0f;
@@ -521,30 +776,22 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
 
 	if (key == GLFW_KEY_W && (action == GLFW_REPEAT || action == GLFW_PRESS))
 	{
-		eye_center.z -= movementSpeed;
-        lookat.z -= movementSpeed;
-        skybox.pos.z -= movementSpeed;
+		moveCamera(glm::vec3(0.0f, 0.0f, -movementSpeed));
 	}
 
 	if (key == GLFW_KEY_S && (action == GLFW_REPEAT || action == GLFW_PRESS))
 	{
-		eye_center.z += movementSpeed;
-        lookat.z += movementSpeed;
-        skybox.pos.z += movementSpeed;
+		moveCamera(glm::vec3(0.0f, 0.0f, movementSpeed));
 	}
 
 	if (key == GLFW_KEY_A && (action == GLFW_REPEAT || action == GLFW_PRESS))
 	{
-		eye_center.x -= movementSpeed;
-        lookat.x -= movementSpeed;
-        skybox.pos.x -= movementSpeed;
+		moveCamera(glm::vec3(-movementSpeed, 0.0f, 0.0f));
 	}
 
 	if (key == GLFW_KEY_D && (action == GLFW_REPEAT || action == GLFW_PRESS))
 	{
-		eye_center.x += movementSpeed;
-        lookat.x += movementSpeed;
-        skybox.pos.x += movementSpeed;
+		moveCamera(glm::vec3(movementSpeed, 0.0f, 0.0f));
 	}
 
 //	if (key == GLFW_KEY_UP && (action == GLFW_REPEAT || action == GLFW_PRESS))
@@ -557,6 +804,44 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
 //		lightPosition.z += 20.0f;
 //	}
 
+	if (key == GLFW_KEY_O && action == GLFW_PRESS)
+	{
+		chunkManager->occlusionEnabled = !chunkManager->occlusionEnabled;
+		std::cout << "Occlusion queries " << (chunkManager->occlusionEnabled ? "enabled" : "disabled") << std::endl;
+	}
+
+	if (key == GLFW_KEY_G && action == GLFW_PRESS)
+	{
+		bool enabled = chunkManager->setGpuDriven(!chunkManager->isGpuDriven());
+		std::cout << "Chunk rendering path: " << (enabled ? "GPU-driven" : "GL 3.3") << std::endl;
+	}
+
+	if (key == GLFW_KEY_V && action == GLFW_PRESS)
+	{
+		dynamicResolution.enabled = !dynamicResolution.enabled;
+		std::cout << "Dynamic resolution " << (dynamicResolution.enabled ? "enabled" : "disabled") << std::endl;
+	}
+
+	if (key == GLFW_KEY_F && action == GLFW_PRESS)
+	{
+		dynamicResolution.sharpen = !dynamicResolution.sharpen;
+		std::cout << "Upscale filter: " << (dynamicResolution.sharpen ? "sharpen" : "bilinear") << std::endl;
+	}
+
+	if (key == GLFW_KEY_M && action == GLFW_PRESS)
+	{
+		memoryTracker.printReport(std::cout);
+		meshResidencyStats.print(std::cout);
+		geometryPool.print(std::cout);
+		textureStreamer.print(std::cout);
+	}
+
+	if (key == GLFW_KEY_T && action == GLFW_PRESS)
+	{
+		startupAssets->printTimeline(std::cout);
+		assetFiles.printStats(std::cout);
+	}
+
 	if (key == GLFW_KEY_SPACE && (action == GLFW_REPEAT || action == GLFW_PRESS))
     {
         saveDepth = true;
@@ -583,4 +868,21 @@ static void cursor_callback(GLFWwindow *window, double xpos, double ypos) {
 	lightPosition.y = y * scale + 278;
 
 	//std::cout << lightPosition.x << " " << lightPosition.y << " " << lightPosition.z << std::endl;
+
+	// Highlight the building under the cursor, picked with a ray through the
+	// near and far planes
+	if (!chunkManager)
+		return;
+	glm::mat4 projection = glm::perspective(glm::radians(FoV), (float)windowWidth / windowHeight, zNear, zFar);
+	glm::mat4 inverseVp = glm::inverse(projection * glm::lookAt(eye_center, lookat, up));
+	glm::vec4 nearPoint = inverseVp * glm::vec4(x, y, -1.0f, 1.0f);
+	glm::vec4 farPoint = inverseVp * glm::vec4(x, y, 1.0f, 1.0f);
+	glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+	CityHit hit;
+	if (chunkManager->raycast(origin, direction, zFar - zNear, hit))
+		chunkManager->setHighlight(hit.chunk, hit.building);
+	else
+		chunkManager->setHighlight(glm::ivec2(0), -1);
 }
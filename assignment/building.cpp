@@ -12,161 +12,229 @@
 #include <render/shader.h>
 
 
-static GLuint LoadTextureTileBox(const char *texture_file_path) {
-    int w, h, channels;
-    uint8_t* img = stbi_load(texture_file_path, &w, &h, &channels, 3);
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    if (img) {
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, img);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    } else {
-        std::cout << "Failed to load texture " << texture_file_path << std::endl;
+// Facade textures are shared by every building, indexed by CityGenerator's facade id
+static const char *facadeTexturePaths[CityGenerator::FACADE_COUNT] = {
+        "../assignment/assets/building.jpg",
+        "../assignment/assets/building2.png",
+        "../assignment/facade0.jpg",
+        "../assignment/assets/emerald.jpg"
+};
+
+// Every facade is resampled to this size to become one layer of the array
+static const int FACADE_SIZE = 1024;
+static StreamedTexture *facadeTexture = nullptr;
+
+// All facades as layers of one streamed GL_TEXTURE_2D_ARRAY, so buildings with
+// different facades share a texture binding and a draw call. A facade that
+// fails to load is left mid-grey.
+static StreamedTexture *GetFacadeTexture() {
+    if (!facadeTexture) {
+        std::vector<std::string> paths(facadeTexturePaths, facadeTexturePaths + CityGenerator::FACADE_COUNT);
+        facadeTexture = textureStreamer.create("facades", paths, GL_TEXTURE_2D_ARRAY, FACADE_SIZE);
     }
-    stbi_image_free(img);
+    return facadeTexture;
+}
+
+static GLuint GetFacadeTextureArray() {
+    return GetFacadeTexture()->textureID;
+}
+
+static void ReleaseFacadeTextures() {
+    textureStreamer.release(facadeTexture);
+    facadeTexture = nullptr;
+}
 
-    return texture;
+// Interleaved position, uv and normal at the locations standardObj.vert reads
+static int BuildingGeometryFormat() {
+    static const int format = geometryPool.registerFormat(GeometryFormat{"buildings", 8 * sizeof(GLfloat), 3, {
+            {0, 3, GL_FLOAT, false, 0},
+            {1, 2, GL_FLOAT, false, 3 * sizeof(GLfloat)},
+            {2, 3, GL_FLOAT, false, 5 * sizeof(GLfloat)}}});
+    return format;
 }
 
+// Unit cube shared by every building, four vertices per face so each face
+// has its own normal. The facade repeats once across a face and five times up.
+static const GLfloat cubeVertices[72] = {
+        -1.0f, -1.0f, 1.0f,  1.0f, -1.0f, 1.0f,  1.0f, 1.0f, 1.0f,  -1.0f, 1.0f, 1.0f,
+        1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, 1.0f, -1.0f,  1.0f, 1.0f, -1.0f,
+        -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, 1.0f, -1.0f, 1.0f, 1.0f, -1.0f, 1.0f, -1.0f,
+        1.0f, -1.0f, 1.0f,  1.0f, -1.0f, -1.0f,  1.0f, 1.0f, -1.0f,  1.0f, 1.0f, 1.0f,
+        -1.0f, 1.0f, 1.0f,   1.0f, 1.0f, 1.0f,   1.0f, 1.0f, -1.0f,  -1.0f, 1.0f, -1.0f,
+        -1.0f, -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f
+};
+
+static const GLfloat cubeUVs[48] = {
+        0.0f, 5.0f,  1.0f, 5.0f,  1.0f, 0.0f,  0.0f, 0.0f,
+        0.0f, 5.0f,  1.0f, 5.0f,  1.0f, 0.0f,  0.0f, 0.0f,
+        0.0f, 5.0f,  1.0f, 5.0f,  1.0f, 0.0f,  0.0f, 0.0f,
+        0.0f, 5.0f,  1.0f, 5.0f,  1.0f, 0.0f,  0.0f, 0.0f,
+        0.0f, 5.0f,  1.0f, 5.0f,  1.0f, 0.0f,  0.0f, 0.0f,
+        0.0f, 5.0f,  1.0f, 5.0f,  1.0f, 0.0f,  0.0f, 0.0f
+};
+
+static const GLuint cubeIndices[36] = {
+        0, 1, 2,  0, 2, 3,  4, 5, 6,  4, 6, 7,
+        8, 9, 10, 8, 10, 11, 12, 13, 14, 12, 14, 15,
+        16, 17, 18, 16, 18, 19, 20, 21, 22, 20, 22, 23
+};
+
+static const GLfloat cubeNormals[72] = {
+        0.0f, 0.0f, 1.0f,   0.0f, 0.0f, 1.0f,   0.0f, 0.0f, 1.0f,   0.0f, 0.0f, 1.0f,
+        0.0f, 0.0f, -1.0f,  0.0f, 0.0f, -1.0f,  0.0f, 0.0f, -1.0f,  0.0f, 0.0f, -1.0f,
+        -1.0f, 0.0f, 0.0f,  -1.0f, 0.0f, 0.0f,  -1.0f, 0.0f, 0.0f,  -1.0f, 0.0f, 0.0f,
+        1.0f, 0.0f, 0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f,   0.0f, 1.0f, 0.0f,   0.0f, 1.0f, 0.0f,   0.0f, 1.0f, 0.0f,
+        0.0f, -1.0f, 0.0f,  0.0f, -1.0f, 0.0f,  0.0f, -1.0f, 0.0f,  0.0f, -1.0f, 0.0f
+};
+
+// Placement and facade of one building. The geometry is the same unit cube
+// for every building, BuildingRenderer owns it and draws buildings in batches.
 struct Building {
-    glm::vec3 position;
+    glm::vec3 position;     // World-space centre, for culling
     glm::vec3 scale;
-    glm::vec3 lightPosition, lightIntensity;
+    int facade = 0;         // Layer of the facade texture array
+    TransformNode transform;    // Relative to the owning chunk
 
     void updatePosition(glm::vec3 newPos) {
         position = newPos;
     }
 
-    GLfloat vertex_buffer_data[72] = {
-            -1.0f, -1.0f, 1.0f,  1.0f, -1.0f, 1.0f,  1.0f, 1.0f, 1.0f,  -1.0f, 1.0f, 1.0f,
-            1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, 1.0f, -1.0f,  1.0f, 1.0f, -1.0f,
-            -1.0f, -1.0f, -1.0f, -1.0f, -1.0f, 1.0f, -1.0f, 1.0f, 1.0f, -1.0f, 1.0f, -1.0f,
-            1.0f, -1.0f, 1.0f,  1.0f, -1.0f, -1.0f,  1.0f, 1.0f, -1.0f,  1.0f, 1.0f, 1.0f,
-            -1.0f, 1.0f, 1.0f,   1.0f, 1.0f, 1.0f,   1.0f, 1.0f, -1.0f,  -1.0f, 1.0f, -1.0f,
-            -1.0f, -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f
-    };
-
-    GLfloat uv_buffer_data[48] = {
-            0.0f, 1.0f,  1.0f, 1.0f,  1.0f, 0.0f,  0.0f, 0.0f,
-            0.0f, 1.0f,  1.0f, 1.0f,  1.0f, 0.0f,  0.0f, 0.0f,
-            0.0f, 1.0f,  1.0f, 1.0f,  1.0f, 0.0f,  0.0f, 0.0f,
-            0.0f, 1.0f,  1.0f, 1.0f,  1.0f, 0.0f,  0.0f, 0.0f,
-            0.0f, 1.0f,  1.0f, 1.0f,  1.0f, 0.0f,  0.0f, 0.0f,
-            0.0f, 1.0f,  1.0f, 1.0f,  1.0f, 0.0f,  0.0f, 0.0f
-    };
-
-    GLuint index_buffer_data[36] = {
-            0, 1, 2,  0, 2, 3,  4, 5, 6,  4, 6, 7,
-            8, 9, 10, 8, 10, 11, 12, 13, 14, 12, 14, 15,
-            16, 17, 18, 16, 18, 19, 20, 21, 22, 20, 22, 23
-    };
-
-    GLfloat normal_buffer_data[72] = {
-            0.0f, 0.0f, 1.0f,   0.0f, 0.0f, 1.0f,   0.0f, 0.0f, 1.0f,   0.0f, 0.0f, 1.0f,
-            0.0f, 0.0f, -1.0f,  0.0f, 0.0f, -1.0f,  0.0f, 0.0f, -1.0f,  0.0f, 0.0f, -1.0f,
-            -1.0f, 0.0f, 0.0f,  -1.0f, 0.0f, 0.0f,  -1.0f, 0.0f, 0.0f,  -1.0f, 0.0f, 0.0f,
-            1.0f, 0.0f, 0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 0.0f, 0.0f,   1.0f, 0.0f, 0.0f,
-            0.0f, 1.0f, 0.0f,   0.0f, 1.0f, 0.0f,   0.0f, 1.0f, 0.0f,   0.0f, 1.0f, 0.0f,
-            0.0f, -1.0f, 0.0f,  0.0f, -1.0f, 0.0f,  0.0f, -1.0f, 0.0f,  0.0f, -1.0f, 0.0f
-    };
-
-    GLuint vertexArrayID, vertexBufferID, indexBufferID, uvBufferID, normalBufferID;
-    GLuint textureID, textureSamplerID, programID, mvpMatrixID, lightPositionID, lightIntensityID;
-
-    void initialize(glm::vec3 pos, glm::vec3 scl, glm::vec3 __lightPosition, glm::vec3 __lightIntensity) {
-        for (int i = 0; i < 24; ++i) uv_buffer_data[2*i+1] *= 5;
+    void setFacade(int newFacade) {
+        facade = newFacade;
+    }
 
+    void initialize(glm::vec3 pos, glm::vec3 scl) {
         position = pos;
         scale = scl;
-        lightPosition = __lightPosition;
-        lightIntensity = __lightIntensity;
-
-        glGenVertexArrays(1, &vertexArrayID);
-        glBindVertexArray(vertexArrayID);
-
-        glGenBuffers(1, &vertexBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
+    }
 
-        glGenBuffers(1, &uvBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data, GL_STATIC_DRAW);
+    // Cached, valid once the owning chunk has updated its transforms
+    const glm::mat4 &modelMatrix() const {
+        return transform.world;
+    }
+};
+
+// What the instanced building draw reads per instance. Position and scale
+// place the unit cube in the world for lighting, as on the GPU-driven path.
+struct BuildingInstance {
+    glm::mat4 mvp;
+    glm::vec3 position;     // World-space centre
+    GLfloat layer;          // Facade, as a float attribute
+    glm::vec3 scale;        // Half extents
+    GLfloat highlight;      // 1 for the building picked under the cursor
+};
+
+// Draws buildings as instances of one cube in the geometry pool. The facade
+// is a per-instance layer of the facade array, so buildings of every facade
+// share one program, one texture binding and one draw call per batch.
+// Callers fill instances, upload() once per frame, then issue ranges of it
+// between begin() and end().
+struct BuildingRenderer {
+    std::vector<BuildingInstance> instances;
+    GeometryHandle geometry = -1;
+    GLuint programID = 0, instanceBufferID = 0;
+    size_t instanceCapacity = 0;
+    GLuint textureSamplerID, lightPositionID, lightIntensityID;
+    glm::vec3 lightPosition, lightIntensity;
 
-        glGenBuffers(1, &normalBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(normal_buffer_data), normal_buffer_data, GL_STATIC_DRAW);
+    void initialize(glm::vec3 __lightPosition, glm::vec3 __lightIntensity) {
+        lightPosition = __lightPosition;
+        lightIntensity = __lightIntensity;
 
-        glGenBuffers(1, &indexBufferID);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
+        GLfloat interleaved[24 * 8];
+        for (int i = 0; i < 24; i++) {
+            GLfloat *vertex = &interleaved[8 * i];
+            for (int j = 0; j < 3; j++) vertex[j] = cubeVertices[3 * i + j];
+            for (int j = 0; j < 2; j++) vertex[3 + j] = cubeUVs[2 * i + j];
+            for (int j = 0; j < 3; j++) vertex[5 + j] = cubeNormals[3 * i + j];
+        }
+        geometry = geometryPool.allocate(BuildingGeometryFormat(), interleaved, 24, cubeIndices, 36);
+        glGenBuffers(1, &instanceBufferID);
+        GetFacadeTextureArray();
 
-        textureID = LoadTextureTileBox("../assignment/assets/building.jpg");
         programID = LoadShadersFromFile("../assignment/shaders/standardObj.vert",
                                         "../assignment/shaders/standardObj.frag");
-
         if (programID == 0) {
             std::cerr << "Failed to load shaders." << std::endl;
         }
+        SetupClusteredLightingProgram(programID);
 
-        mvpMatrixID = glGetUniformLocation(programID, "MVP");
-        textureSamplerID = glGetUniformLocation(programID, "textureSampler");
+        textureSamplerID = glGetUniformLocation(programID, "facadeSampler");
         lightPositionID = glGetUniformLocation(programID, "lightPosition");
         lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
 
         GLenum errorCode = glGetError();
         if (errorCode != 0) {
-            std::cout << "Building object error initializing: " << errorCode << std::endl;
+            std::cout << "Building renderer error initializing: " << errorCode << std::endl;
         }
     }
 
-    void render(glm::mat4 cameraMatrix) {
-        glUseProgram(programID);
-
-        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), position);
-        modelMatrix = glm::scale(modelMatrix, scale);
-        glm::mat4 mvp = cameraMatrix * modelMatrix;
+    void upload() {
+        if (instances.empty()) return;
+        size_t bytes = instances.size() * sizeof(BuildingInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+        if (bytes > instanceCapacity) {
+            instanceCapacity = glm::max(bytes, instanceCapacity * 2);
+            glBufferData(GL_ARRAY_BUFFER, instanceCapacity, NULL, GL_STREAM_DRAW);
+            memoryTracker.trackBuffer("buildings", instanceBufferID, instanceCapacity);
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, instances.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 
-        glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
+    void begin() {
+        glUseProgram(programID);
         glUniform3fv(lightPositionID, 1, &lightPosition[0]);
         glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
 
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
-        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, GetFacadeTextureArray());
         glUniform1i(textureSamplerID, 0);
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        geometryPool.bind(BuildingGeometryFormat());
+        for (GLuint location = 3; location <= 10; location++) {
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+    }
+
+    // Instances [first, first + count) of the last upload. Without a base
+    // instance in GL 3.3 the instance attributes are re-pointed per range.
+    void draw(size_t first, int count) {
+        if (count <= 0) return;
+        size_t offset = first * sizeof(BuildingInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+        for (int column = 0; column < 4; column++) {
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(BuildingInstance),
+                                  (void*)(offset + column * sizeof(glm::vec4)));
+        }
+        glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(BuildingInstance),
+                              (void*)(offset + offsetof(BuildingInstance, layer)));
+        glVertexAttribPointer(8, 3, GL_FLOAT, GL_FALSE, sizeof(BuildingInstance),
+                              (void*)(offset + offsetof(BuildingInstance, position)));
+        glVertexAttribPointer(9, 3, GL_FLOAT, GL_FALSE, sizeof(BuildingInstance),
+                              (void*)(offset + offsetof(BuildingInstance, scale)));
+        glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, sizeof(BuildingInstance),
+                              (void*)(offset + offsetof(BuildingInstance, highlight)));
+        geometryPool.drawInstanced(geometry, count);
+    }
 
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+    void end() {
+        for (GLuint location = 3; location <= 10; location++) {
+            glDisableVertexAttribArray(location);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
     }
 
+    // The facade array is shared, ReleaseFacadeTextures deletes it
     void cleanup() {
-        glDeleteBuffers(1, &vertexBufferID);
-        glDeleteBuffers(1, &uvBufferID);
-        glDeleteBuffers(1, &indexBufferID);
-        glDeleteBuffers(1, &normalBufferID);
-        glDeleteVertexArrays(1, &vertexArrayID);
+        geometryPool.release(geometry);
+        memoryTracker.releaseBuffer(instanceBufferID);
+        glDeleteBuffers(1, &instanceBufferID);
         glDeleteProgram(programID);
+        instanceBufferID = programID = 0;
+        instanceCapacity = 0;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,288 @@
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BVH_SSE2 1
+#endif
+
+struct BvhBox {
+    glm::vec3 min, max;
+};
+
+// A ray, or a sphere of the given radius swept along it. Direction must be
+// normalised so distances come out in world units. The per-axis terms of the
+// slab test are set up once here rather than for every box.
+struct BvhRay {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float radius;
+    float invDir[3];
+    int nearSide[3];            // 0 if the ray enters a box through its min plane, 1 through its max
+    float nearOrigin[3];        // Origin shifted so the near plane test covers the radius
+    float farOrigin[3];
+
+    BvhRay(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, float sphereRadius = 0.0f)
+            : origin(rayOrigin), direction(rayDirection), radius(sphereRadius) {
+        for (int axis = 0; axis < 3; axis++) {
+            // Keeps zero components finite, so empty slots and planes the
+            // origin lies on never produce 0 * inf
+            float d = direction[axis];
+            if (fabsf(d) < 1e-20f) d = d < 0.0f ? -1e-20f : 1e-20f;
+            invDir[axis] = 1.0f / d;
+            nearSide[axis] = d < 0.0f ? 1 : 0;
+            float grow = d < 0.0f ? radius : -radius;
+            nearOrigin[axis] = origin[axis] - grow;
+            farOrigin[axis] = origin[axis] + grow;
+        }
+    }
+};
+
+// Slab test of a ray against a box grown by the ray's radius. Boxes the ray
+// starts inside are ignored, so a camera that ended up in a building can
+// still leave it. On a hit closer than tMax, t is the entry distance and
+// normal the face entered through. Growing the box rather than rounding its
+// edges makes sphere sweeps slightly conservative at the corners.
+static bool RayBoxHit(const BvhRay& ray, const glm::vec3& boxMin, const glm::vec3& boxMax, float tMax,
+                      float& t, glm::vec3& normal) {
+    float tNear = 0.0f, tFar = tMax;
+    int nearAxis = -1;
+    for (int axis = 0; axis < 3; axis++) {
+        float nearPlane = ray.nearSide[axis] ? boxMax[axis] : boxMin[axis];
+        float farPlane = ray.nearSide[axis] ? boxMin[axis] : boxMax[axis];
+        float t0 = (nearPlane - ray.nearOrigin[axis]) * ray.invDir[axis];
+        float t1 = (farPlane - ray.farOrigin[axis]) * ray.invDir[axis];
+        if (t0 > tNear) {
+            tNear = t0;
+            nearAxis = axis;
+        }
+        tFar = glm::min(tFar, t1);
+    }
+    if (nearAxis < 0 || tNear > tFar) return false;
+
+    t = tNear;
+    normal = glm::vec3(0.0f);
+    normal[nearAxis] = ray.nearSide[nearAxis] ? 1.0f : -1.0f;
+    return true;
+}
+
+// Four children per node, their boxes stored axis by axis so one SSE2 slab
+// test covers the whole node. Unused slots hold inverted boxes that no ray
+// can enter.
+struct BvhNode {
+    float bounds[6][4];     // minX, minY, minZ, maxX, maxY, maxZ of each child
+    int32_t child[4];       // Node index, or the first primitive of a leaf
+    int32_t count[4];       // Primitives in a leaf child, 0 for a node or unused slot
+};
+
+// Bounding volume hierarchy over a fixed set of boxes. Built top down by
+// splitting at the median centroid along the longest axis, twice per node to
+// fill its four slots, until ranges are small enough for a leaf. Queries
+// visit children nearest first and call back for each primitive of a leaf
+// the ray reaches, the callback shrinks tMax on a hit to prune the rest.
+class BoxBvh {
+public:
+    static const int LEAF_SIZE = 4;
+    static const int MAX_DEPTH = 64;
+
+    void build(const std::vector<BvhBox>& boxes) {
+        nodes.clear();
+        primitives.resize(boxes.size());
+        centroids.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++) {
+            primitives[i] = static_cast<int>(i);
+            centroids[i] = boxes[i].min + boxes[i].max;
+        }
+        if (!boxes.empty()) {
+            buildNode(boxes, 0, static_cast<int>(boxes.size()));
+        }
+        centroids.clear();
+        centroids.shrink_to_fit();
+    }
+
+    void clear() {
+        nodes.clear();
+        primitives.clear();
+    }
+
+    bool empty() const {
+        return nodes.empty();
+    }
+
+    size_t bytes() const {
+        return nodes.capacity() * sizeof(BvhNode) + primitives.capacity() * sizeof(int);
+    }
+
+    int nodeCount() const {
+        return static_cast<int>(nodes.size());
+    }
+
+    // leaf(primitive, tMax) is called with indices into the boxes build() was given
+    template <typename LeafFn>
+    void traverse(const BvhRay& ray, float& tMax, bool useSimd, LeafFn&& leaf) const {
+        if (nodes.empty()) return;
+
+        int stack[MAX_DEPTH * 3 + 1];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const BvhNode& node = nodes[stack[--top]];
+            float entry[4];
+            int hits;
+#ifdef BVH_SSE2
+            if (useSimd) {
+                hits = intersectSse2(node, ray, tMax, entry);
+            } else
+#endif
+            {
+                hits = intersectScalar(node, ray, tMax, entry);
+            }
+            if (!hits) continue;
+
+            // Nearest child last on the stack so it is visited first
+            int order[4], ordered = 0;
+            for (int i = 0; i < 4; i++) {
+                if (!(hits & (1 << i))) continue;
+                int j = ordered++;
+                while (j > 0 && entry[order[j - 1]] < entry[i]) {
+                    order[j] = order[j - 1];
+                    j--;
+                }
+                order[j] = i;
+            }
+            for (int k = 0; k < ordered; k++) {
+                int i = order[k];
+                if (node.count[i] > 0) continue;
+                stack[top++] = node.child[i];
+            }
+            for (int k = ordered - 1; k >= 0; k--) {
+                int i = order[k];
+                if (node.count[i] == 0 || entry[i] > tMax) continue;
+                for (int p = node.child[i]; p < node.child[i] + node.count[i]; p++) {
+                    leaf(primitives[p], tMax);
+                }
+            }
+        }
+    }
+
+private:
+    std::vector<BvhNode> nodes;
+    std::vector<int> primitives;        // Box indices, leaves cover contiguous ranges
+    std::vector<glm::vec3> centroids;   // Twice the centre, only during build
+
+    struct Range {
+        int first, count;
+    };
+
+    BvhBox rangeBounds(const std::vector<BvhBox>& boxes, int first, int count) const {
+        BvhBox box = {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+        for (int i = first; i < first + count; i++) {
+            box.min = glm::min(box.min, boxes[primitives[i]].min);
+            box.max = glm::max(box.max, boxes[primitives[i]].max);
+        }
+        return box;
+    }
+
+    // Median split along the longest axis of the range's centroids
+    Range splitRange(Range& range) {
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (int i = range.first; i < range.first + range.count; i++) {
+            lo = glm::min(lo, centroids[primitives[i]]);
+            hi = glm::max(hi, centroids[primitives[i]]);
+        }
+        glm::vec3 extent = hi - lo;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+        int half = range.count / 2;
+        int* begin = primitives.data() + range.first;
+        const std::vector<glm::vec3>& c = centroids;
+        std::nth_element(begin, begin + half, begin + range.count,
+                         [&c, axis](int a, int b) { return c[a][axis] < c[b][axis]; });
+        Range upper = {range.first + half, range.count - half};
+        range.count = half;
+        return upper;
+    }
+
+    int buildNode(const std::vector<BvhBox>& boxes, int first, int count) {
+        int index = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+
+        // Keep splitting the largest range until the four slots are used
+        Range ranges[4] = {{first, count}};
+        int rangeCount = 1;
+        while (rangeCount < 4) {
+            int largest = -1;
+            for (int i = 0; i < rangeCount; i++) {
+                if (ranges[i].count > LEAF_SIZE && (largest < 0 || ranges[i].count > ranges[largest].count)) {
+                    largest = i;
+                }
+            }
+            if (largest < 0) break;
+            ranges[rangeCount++] = splitRange(ranges[largest]);
+        }
+
+        for (int i = 0; i < 4; i++) {
+            BvhBox box = {glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+            int child = -1, leafCount = 0;
+            if (i < rangeCount) {
+                box = rangeBounds(boxes, ranges[i].first, ranges[i].count);
+                if (ranges[i].count <= LEAF_SIZE) {
+                    child = ranges[i].first;
+                    leafCount = ranges[i].count;
+                } else {
+                    child = buildNode(boxes, ranges[i].first, ranges[i].count);
+                }
+            }
+            // nodes may have grown in the recursion above
+            BvhNode& node = nodes[index];
+            for (int axis = 0; axis < 3; axis++) {
+                node.bounds[axis][i] = box.min[axis];
+                node.bounds[axis + 3][i] = box.max[axis];
+            }
+            node.child[i] = child;
+            node.count[i] = leafCount;
+        }
+        return index;
+    }
+
+    // Entry distances of the four children, returns a mask of those the ray
+    // reaches before tMax. The SSE2 version below does exactly the same.
+    static int intersectScalar(const BvhNode& node, const BvhRay& ray, float tMax, float entry[4]) {
+        int hits = 0;
+        for (int i = 0; i < 4; i++) {
+            float tNear = 0.0f, tFar = tMax;
+            for (int axis = 0; axis < 3; axis++) {
+                int nearRow = ray.nearSide[axis] * 3 + axis;
+                int farRow = (1 - ray.nearSide[axis]) * 3 + axis;
+                tNear = glm::max(tNear, (node.bounds[nearRow][i] - ray.nearOrigin[axis]) * ray.invDir[axis]);
+                tFar = glm::min(tFar, (node.bounds[farRow][i] - ray.farOrigin[axis]) * ray.invDir[axis]);
+            }
+            entry[i] = tNear;
+            if (tNear <= tFar) hits |= 1 << i;
+        }
+        return hits;
+    }
+
+#ifdef BVH_SSE2
+    static int intersectSse2(const BvhNode& node, const BvhRay& ray, float tMax, float entry[4]) {
+        __m128 tNear = _mm_setzero_ps();
+        __m128 tFar = _mm_set1_ps(tMax);
+        for (int axis = 0; axis < 3; axis++) {
+            int nearRow = ray.nearSide[axis] * 3 + axis;
+            int farRow = (1 - ray.nearSide[axis]) * 3 + axis;
+            __m128 inv = _mm_set1_ps(ray.invDir[axis]);
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[nearRow]), _mm_set1_ps(ray.nearOrigin[axis])), inv);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.bounds[farRow]), _mm_set1_ps(ray.farOrigin[axis])), inv);
+            tNear = _mm_max_ps(tNear, t0);
+            tFar = _mm_min_ps(tFar, t1);
+        }
+        _mm_storeu_ps(entry, tNear);
+        return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+    }
+#endif
+};
@@ -0,0 +1,796 @@
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <list>
+#include <chrono>
+#include <unordered_map>
+#include <iostream>
+#include <cfloat>
+#include <math.h>
+
+struct Chunk {
+    glm::ivec2 position;                // Integer chunk coordinates
+    bool active = false;                // Whether this slot holds a chunk yet
+    ChunkLayout layout;                 // Generated building placement for this chunk
+    std::vector<Building> buildings;
+    glm::vec3 boundsMin, boundsMax;     // World-space box around every building
+    float facadeSpan;                   // Smallest world span of one facade repeat, for texture streaming
+    BoxBvh bvh;                         // Over the building boxes, kept while the chunk is cached
+    ChunkOcclusion occlusion;
+    TransformNode transform;            // Chunk origin, parent of the buildings' transforms
+
+    void initialize(const ChunkLayout& newLayout) {
+        layout = newLayout;
+
+        // Create buildings only if they don't exist yet
+        if (buildings.empty()) {
+            for (int i = 0; i < ChunkLayout::BUILDING_COUNT; i++) {
+                Building b;
+                b.initialize(glm::vec3(0), glm::vec3(1));
+                buildings.push_back(b);
+            }
+        }
+
+        for (int i = 0; i < ChunkLayout::BUILDING_COUNT; i++) {
+            buildings[i].scale = layout.buildings[i].scale;
+            buildings[i].setFacade(layout.buildings[i].facade);
+        }
+
+        // Update positions based on chunk position
+        updatePosition(layout.coord);
+        occlusion.reset();
+        active = true;
+    }
+
+    void updatePosition(const glm::ivec2& newPos) {
+        position = newPos;
+        glm::vec3 base(position.x * CityGenerator::CHUNK_WIDTH, 0, position.y * CityGenerator::CHUNK_WIDTH);
+
+        // Update each building's position
+        transform.setTranslation(base);
+        for (int i = 0; i < ChunkLayout::BUILDING_COUNT; i++) {
+            buildings[i].updatePosition(base + layout.buildings[i].offset);
+            buildings[i].transform.setTranslation(layout.buildings[i].offset);
+            buildings[i].transform.setScale(buildings[i].scale);
+        }
+
+        boundsMin = glm::vec3(FLT_MAX);
+        boundsMax = glm::vec3(-FLT_MAX);
+        facadeSpan = FLT_MAX;
+        std::vector<BvhBox> boxes;
+        boxes.reserve(buildings.size());
+        for (const Building& b : buildings) {
+            boxes.push_back({b.position - b.scale, b.position + b.scale});
+            boundsMin = glm::min(boundsMin, b.position - b.scale);
+            boundsMax = glm::max(boundsMax, b.position + b.scale);
+            // The facade repeats once across a face and five times up it
+            facadeSpan = glm::min(facadeSpan, glm::min(2.0f * glm::min(b.scale.x, b.scale.z), 0.4f * b.scale.y));
+        }
+        bvh.build(boxes);
+    }
+
+    // Recomputes only the world matrices whose node or parent changed
+    void updateTransforms(const glm::mat4& parentWorld, bool parentChanged) {
+        bool changed = transform.update(parentWorld, parentChanged);
+        for (Building& b : buildings) {
+            b.transform.update(transform.world, changed);
+        }
+    }
+
+    // Buildings are placement only, their geometry is shared by BuildingRenderer
+    size_t cpuBytes() const {
+        return sizeof(Chunk) + buildings.capacity() * sizeof(Building) + bvh.bytes();
+    }
+
+    // Buildings share BuildingRenderer's geometry, a chunk holds no GL memory
+    size_t residentBytes() const {
+        return cpuBytes();
+    }
+
+    void cleanup() {
+        buildings.clear();
+        bvh.clear();
+        active = false;
+    }
+};
+
+struct ChunkCacheStats {
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+    unsigned long evictions = 0;
+    size_t residentBytes = 0;
+    size_t entries = 0;
+
+    float hitRate() const {
+        unsigned long lookups = hits + misses;
+        return lookups ? float(hits) / lookups : 0.0f;
+    }
+};
+
+// std::hash<uint64_t> is the identity on common standard libraries, so a
+// packed (x, z) key would pick its bucket from x + z * 2^32 and a square of
+// neighbouring chunks would pile up along a few diagonals. SplitMix64 mixes
+// both halves into every bit first.
+struct ChunkKeyHash {
+    size_t operator()(uint64_t key) const {
+        return static_cast<size_t>(CityRandom::splitMix64(key));
+    }
+};
+
+// Chunks that recently left the render window, still baked (layout applied,
+// buildings placed, BVH built and transforms computed) and keyed by chunk
+// coordinate. Flying back over a street swaps the cached chunk straight back
+// into the grid instead of regenerating it. Entries are kept in most-recently-used order and the oldest are evicted
+// once the resident size exceeds the budget.
+class ChunkCache {
+private:
+    std::list<Chunk> entries;           // Front is most recently used
+    std::unordered_map<uint64_t, std::list<Chunk>::iterator, ChunkKeyHash> lookup;
+    size_t budgetBytes;
+
+public:
+    static uint64_t key(const glm::ivec2& pos) {
+        return static_cast<uint64_t>(static_cast<uint32_t>(pos.x))
+               | (static_cast<uint64_t>(static_cast<uint32_t>(pos.y)) << 32);
+    }
+
+    ChunkCacheStats stats;
+
+    explicit ChunkCache(size_t budgetMB) : budgetBytes(budgetMB * 1024 * 1024) {}
+
+    void setBudgetMB(size_t budgetMB) {
+        budgetBytes = budgetMB * 1024 * 1024;
+    }
+
+    bool overBudget() const {
+        return !entries.empty() && stats.residentBytes > budgetBytes;
+    }
+
+    // Moves the cached chunk at pos into out, if there is one
+    bool take(const glm::ivec2& pos, Chunk& out) {
+        auto it = lookup.find(key(pos));
+        if (it == lookup.end()) {
+            stats.misses++;
+            return false;
+        }
+
+        stats.hits++;
+        stats.residentBytes -= it->second->residentBytes();
+        out = std::move(*it->second);
+        entries.erase(it->second);
+        lookup.erase(it);
+        stats.entries = entries.size();
+        return true;
+    }
+
+    void put(Chunk&& chunk) {
+        stats.residentBytes += chunk.residentBytes();
+        entries.push_front(std::move(chunk));
+        lookup[key(entries.front().position)] = entries.begin();
+        stats.entries = entries.size();
+    }
+
+    Chunk popLeastRecent() {
+        Chunk victim = std::move(entries.back());
+        stats.residentBytes -= victim.residentBytes();
+        lookup.erase(key(victim.position));
+        entries.pop_back();
+        stats.entries = entries.size();
+        stats.evictions++;
+        return victim;
+    }
+
+    std::list<Chunk>& chunks() {
+        return entries;
+    }
+
+    void clear() {
+        entries.clear();
+        lookup.clear();
+        stats.residentBytes = 0;
+        stats.entries = 0;
+    }
+};
+
+// Everything the GL thread needs to draw one chunk, filled in on a worker
+struct DrawPacket {
+    OcclusionCuller::Decision decision = OcclusionCuller::SKIP;
+    bool inFrustum = false;
+    FrameVector<BuildingInstance> items;    // Frame arena memory when the manager has one
+    int buildingsCulled = 0;
+};
+
+struct ChunkRenderStats {
+    double classifyMs = 0.0;    // GL thread: frustum test and occlusion results (instance upload when GPU-driven)
+    double buildMs = 0.0;       // Workers: per-building culling and matrices
+    double submitMs = 0.0;      // GL thread: draw calls and new queries
+    int buildingsDrawn = 0;     // GPU-driven: from a cull pass a few frames back, -1 until one is read
+    int buildingsCulled = 0;
+};
+
+// Nearest building found by a ray cast or sphere sweep
+struct CityHit {
+    float distance = 0.0f;      // Along the ray, to the sphere centre for sweeps
+    glm::vec3 point;
+    glm::vec3 normal;           // Of the face entered through
+    glm::ivec2 chunk;
+    int building = -1;
+};
+
+struct ChunkBvhStats {
+    int chunkTrees = 0;         // Chunks whose own tree was built in the last update
+    int chunks = 0;             // Leaves of the top-level tree
+    int nodes = 0;              // Top-level plus every active chunk's nodes
+    double topLevelMs = 0.0;
+};
+
+// The active set is always the (2r+1)^2 window of chunks around the camera, so
+// chunks live in a fixed toroidal grid indexed by chunk coordinate modulo the
+// window size. Moving the window by one chunk maps the row or column that falls
+// off one edge onto the same slots as the one that appears on the other edge,
+// so those slots are re-initialised in place and nothing is hashed or allocated
+// after the first update. Chunks leaving the window go to a ChunkCache and come
+// back from it if the camera returns; layouts for the remaining misses are
+// generated in parallel on the job system, the GL side is then updated on
+// this thread.
+class ChunkManager {
+private:
+    std::vector<Chunk> grid;
+    int renderDistance;
+    int windowSize;
+    glm::vec3 lightPosition;
+    glm::vec3 lightIntensity;
+    glm::ivec2 lastUpdatePos;
+    bool hasUpdated;
+    float chunkWidth;
+    OcclusionCuller occlusion;
+    CityGenerator generator;
+    JobSystem& jobs;
+    std::vector<ChunkLayout> layouts;   // Generation output, one per grid slot
+    std::vector<int> staleSlots;
+    std::vector<int> missSlots;
+    ChunkCache cache;
+    std::vector<DrawPacket> packets;    // One per grid slot, reused every frame
+    ChunkRenderStats renderStats;
+    BuildingRenderer buildingRenderer;
+    GpuCityRenderer gpuRenderer;
+    std::vector<GpuInstance> gpuInstances;
+    bool gpuInstancesDirty = true;
+    bool gpuDriven = false;
+    FrameArena* frameArena = nullptr;
+    std::vector<PointLight> lights;
+    TransformNode scene;                // Root of the chunk transforms
+    bool lightsDirty = true;
+    int lightsPerChunk = ChunkLayout::BUILDING_COUNT;
+    BoxBvh chunkBvh;                    // Over the active chunks' bounds, leaves are grid slots
+    std::vector<BvhBox> chunkBoxes;
+    std::vector<int> chunkBvhSlots;
+    ChunkBvhStats bvhStats;
+    glm::ivec2 highlightChunk = glm::ivec2(0);
+    int highlightBuilding = -1;
+
+    static int wrap(int value, int size) {
+        int m = value % size;
+        return m < 0 ? m + size : m;
+    }
+
+    int slotIndex(const glm::ivec2& pos) const {
+        return wrap(pos.y, windowSize) * windowSize + wrap(pos.x, windowSize);
+    }
+
+    // Moves a chunk out of its slot, leaving an empty one behind that no longer
+    // owns the occlusion query
+    static Chunk takeChunk(Chunk& slot) {
+        Chunk chunk = std::move(slot);
+        slot = Chunk();
+        return chunk;
+    }
+
+    void destroyChunk(Chunk& chunk) {
+        occlusion.releaseQuery(chunk.occlusion);
+        chunk.cleanup();
+    }
+
+    // Worker side of rendering: culls the chunk's buildings against the frustum
+    // and computes their MVPs. Touches no GL state.
+    static void buildPacket(Chunk& chunk, DrawPacket& packet, const Frustum& frustum, const glm::mat4& vp,
+                            int highlighted, LinearArena* arena) {
+        // A new frame's arena leaves last frame's items in the other buffer,
+        // nothing to free. Without an arena, or within the same one, the
+        // storage is kept so the heap is only touched while it grows.
+        ArenaAllocator<BuildingInstance> allocator(arena);
+        if (packet.items.get_allocator() != allocator) {
+            packet.items = FrameVector<BuildingInstance>(allocator);
+        } else {
+            packet.items.clear();
+        }
+        packet.buildingsCulled = 0;
+        if (packet.decision == OcclusionCuller::SKIP) return;
+
+        packet.items.reserve(chunk.buildings.size());
+
+        for (int i = 0; i < static_cast<int>(chunk.buildings.size()); i++) {
+            const Building& building = chunk.buildings[i];
+            if (!frustum.intersectsBox(building.position - building.scale, building.position + building.scale)) {
+                packet.buildingsCulled++;
+                continue;
+            }
+            packet.items.push_back(BuildingInstance{vp * building.modelMatrix(), building.position,
+                                                    GLfloat(building.facade), building.scale,
+                                                    i == highlighted ? 1.0f : 0.0f});
+        }
+    }
+
+    // One light in front of each building, then street lights up to count.
+    // Like the layout this depends only on the seed and the chunk coordinate.
+    static void generateLights(const CityGenerator& generator, const ChunkLayout& layout, int count,
+                               std::vector<PointLight>& lights) {
+        CityRandom rng(CityRandom::splitMix64(generator.chunkSeed(layout.coord) ^ 0x4C49474854ull));
+        glm::vec3 base(layout.coord.x * CityGenerator::CHUNK_WIDTH, 0, layout.coord.y * CityGenerator::CHUNK_WIDTH);
+        const glm::vec3 warm(1.0f, 0.72f, 0.38f), cool(0.55f, 0.7f, 1.0f);
+
+        for (int i = 0; i < count; i++) {
+            PointLight light;
+            if (i < ChunkLayout::BUILDING_COUNT) {
+                const BuildingLayout& b = layout.buildings[i];
+                glm::vec3 entrance = base + b.offset + glm::vec3(0.0f, 18.0f, b.scale.z + 8.0f);
+                light.positionRadius = glm::vec4(entrance, rng.range(80.0f, 140.0f));
+                light.color = glm::vec4(glm::mix(warm, cool, rng.nextFloat() * 0.3f) * rng.range(2.0f, 4.0f), 0.0f);
+            } else {
+                glm::vec3 street = base + glm::vec3(rng.range(0.0f, CityGenerator::CHUNK_WIDTH), 30.0f,
+                                                    rng.range(0.0f, CityGenerator::CHUNK_WIDTH));
+                light.positionRadius = glm::vec4(street, rng.range(120.0f, 180.0f));
+                light.color = glm::vec4(warm * rng.range(2.5f, 3.5f), 0.0f);
+            }
+            lights.push_back(light);
+        }
+    }
+
+    void trackCpuMemory() {
+        size_t gridBytes = grid.capacity() * sizeof(Chunk);
+        for (const Chunk& chunk : grid) {
+            gridBytes += chunk.cpuBytes() - sizeof(Chunk);
+        }
+        size_t cacheBytes = 0;
+        for (const Chunk& chunk : cache.chunks()) {
+            cacheBytes += chunk.cpuBytes();
+        }
+        memoryTracker.setCpu("chunks", gridBytes);
+        memoryTracker.setCpu("chunk cache", cacheBytes);
+        memoryTracker.setCpu("chunk layouts", layouts.capacity() * sizeof(ChunkLayout));
+        memoryTracker.setCpu("lights", lights.capacity() * sizeof(PointLight));
+        memoryTracker.setCpu("chunk bvh", chunkBvh.bytes() + chunkBoxes.capacity() * sizeof(BvhBox)
+                                          + chunkBvhSlots.capacity() * sizeof(int));
+    }
+
+    // Facade detail for a visible chunk, from its nearest point to the camera
+    static void requestFacadeDetail(const Chunk& chunk, const glm::vec3& cameraPos) {
+        glm::vec3 nearest = glm::clamp(cameraPos, chunk.boundsMin, chunk.boundsMax);
+        textureStreamer.request(GetFacadeTexture(), chunk.facadeSpan, glm::length(nearest - cameraPos));
+    }
+
+    static double elapsedMs(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    // Each chunk's own tree is built with its layout and kept through the
+    // cache, so after a window move only the new chunks have built one. The
+    // top level over at most a few hundred chunk boxes is simply rebuilt.
+    void rebuildChunkBvh() {
+        auto start = std::chrono::steady_clock::now();
+        chunkBoxes.clear();
+        chunkBvhSlots.clear();
+        bvhStats.nodes = 0;
+        for (int index = 0; index < static_cast<int>(grid.size()); index++) {
+            const Chunk& chunk = grid[index];
+            if (!chunk.active || chunk.bvh.empty()) continue;
+            chunkBoxes.push_back({chunk.boundsMin, chunk.boundsMax});
+            chunkBvhSlots.push_back(index);
+            bvhStats.nodes += chunk.bvh.nodeCount();
+        }
+        chunkBvh.build(chunkBoxes);
+        bvhStats.chunks = static_cast<int>(chunkBoxes.size());
+        bvhStats.nodes += chunkBvh.nodeCount();
+        bvhStats.topLevelMs = elapsedMs(start);
+    }
+
+public:
+    bool occlusionEnabled = true;
+    bool bvhUseSimd = true;
+
+    ChunkManager(int distance, const glm::vec3& lightPos, const glm::vec3& lightInt,
+                 JobSystem& jobSystem, uint64_t citySeed = 1337, size_t cacheBudgetMB = 32)
+            : renderDistance(distance),
+              windowSize(2 * distance + 1),
+              lightPosition(lightPos),
+              lightIntensity(lightInt),
+              lastUpdatePos(0),
+              hasUpdated(false),
+              generator(citySeed),
+              jobs(jobSystem),
+              cache(cacheBudgetMB)
+    {
+        chunkWidth = CityGenerator::CHUNK_WIDTH;
+        grid.resize(windowSize * windowSize);
+        layouts.resize(windowSize * windowSize);
+        packets.resize(windowSize * windowSize);
+        for (DrawPacket& packet : packets) {
+            packet.items.reserve(ChunkLayout::BUILDING_COUNT);
+        }
+        staleSlots.reserve(windowSize * windowSize);
+        missSlots.reserve(windowSize * windowSize);
+        occlusion.initialize();
+        gpuInstances.reserve(windowSize * windowSize * ChunkLayout::BUILDING_COUNT);
+        buildingRenderer.initialize(lightPosition, lightIntensity);
+        gpuRenderer.initialize(windowSize * windowSize * ChunkLayout::BUILDING_COUNT, lightPosition, lightIntensity);
+    }
+
+    bool gpuDrivenAvailable() const {
+        return gpuRenderer.available;
+    }
+
+    bool isGpuDriven() const {
+        return gpuDriven;
+    }
+
+    // Switches between the GL 3.3 per-building path and the GL 4.3 compute
+    // culled multi-draw-indirect path, if the context supports the latter
+    bool setGpuDriven(bool enabled) {
+        gpuDriven = enabled && gpuRenderer.available;
+        gpuInstancesDirty = true;
+        return gpuDriven;
+    }
+
+    const OcclusionStats& occlusionStats() const {
+        return occlusion.stats;
+    }
+
+    const ChunkRenderStats& lastRenderStats() const {
+        return renderStats;
+    }
+
+    const ChunkCacheStats& cacheStats() const {
+        return cache.stats;
+    }
+
+    const ChunkBvhStats& spatialStats() const {
+        return bvhStats;
+    }
+
+    // Draw packets are built in this arena, it must outlive the manager
+    void setFrameArena(FrameArena* arena) {
+        frameArena = arena;
+    }
+
+    int windowChunkCount() const {
+        return windowSize * windowSize;
+    }
+
+    void setLightsPerChunk(int count) {
+        lightsPerChunk = glm::max(count, 0);
+        lightsDirty = true;
+    }
+
+    // Point lights of every active chunk, regathered when the window moves
+    const std::vector<PointLight>& pointLights() {
+        if (lightsDirty) {
+            lights.clear();
+            for (const Chunk& chunk : grid) {
+                if (chunk.active) generateLights(generator, chunk.layout, lightsPerChunk, lights);
+            }
+            lightsDirty = false;
+            trackCpuMemory();
+        }
+        return lights;
+    }
+
+    void setCacheBudgetMB(size_t budgetMB) {
+        cache.setBudgetMB(budgetMB);
+        while (cache.overBudget()) {
+            Chunk victim = cache.popLeastRecent();
+            destroyChunk(victim);
+        }
+    }
+
+    glm::ivec2 worldToChunkCoords(const glm::vec3& worldPos) const {
+        return glm::ivec2(
+                static_cast<int>(floor(worldPos.x / chunkWidth)),
+                static_cast<int>(floor(worldPos.z / chunkWidth))
+        );
+    }
+
+    // Returns the active chunk at the given coordinates, or nullptr if it is
+    // outside the current window
+    Chunk* findChunk(const glm::ivec2& pos) {
+        Chunk& slot = grid[slotIndex(pos)];
+        return (slot.active && slot.position == pos) ? &slot : nullptr;
+    }
+
+    void update(const glm::vec3& cameraPos) {
+        glm::ivec2 currentChunk = worldToChunkCoords(cameraPos);
+        if (hasUpdated && currentChunk == lastUpdatePos && !scene.dirty) return;
+
+        // Any slot not already holding the chunk that now maps onto it is
+        // recycled in place. After a one-chunk move that is exactly the new
+        // edge row/column; after a large jump it is the whole window.
+        staleSlots.clear();
+        for (int z = -renderDistance; z <= renderDistance; z++) {
+            for (int x = -renderDistance; x <= renderDistance; x++) {
+                glm::ivec2 pos = currentChunk + glm::ivec2(x, z);
+                int index = slotIndex(pos);
+                if (!grid[index].active || grid[index].position != pos) {
+                    layouts[index].coord = pos;
+                    staleSlots.push_back(index);
+                }
+            }
+        }
+
+        // Swap cached chunks back in, the chunks they replace go to the cache
+        missSlots.clear();
+        for (int index : staleSlots) {
+            Chunk evicted = takeChunk(grid[index]);
+            if (cache.take(layouts[index].coord, grid[index])) {
+                grid[index].occlusion.reset();
+            } else {
+                missSlots.push_back(index);
+            }
+            if (evicted.active) {
+                cache.put(std::move(evicted));
+            }
+        }
+
+        // Misses reuse the building and BVH storage of the least recently used
+        // entry once the cache is full, otherwise they allocate their own and
+        // the cache grows
+        for (int index : missSlots) {
+            if (cache.overBudget()) {
+                grid[index] = cache.popLeastRecent();
+            }
+        }
+        while (cache.overBudget()) {
+            Chunk victim = cache.popLeastRecent();
+            destroyChunk(victim);
+        }
+
+        JobCounter generated;
+        for (int index : missSlots) {
+            ChunkLayout* layout = &layouts[index];
+            const CityGenerator* gen = &generator;
+            jobs.run([gen, layout] { gen->generate(layout->coord, *layout); }, &generated);
+        }
+        jobs.wait(generated);
+
+        for (int index : missSlots) {
+            grid[index].initialize(layouts[index]);
+        }
+        bvhStats.chunkTrees = static_cast<int>(missSlots.size());
+        rebuildChunkBvh();
+
+        // Chunks swapped back in from the cache keep their cached matrices
+        bool sceneChanged = scene.update();
+        for (Chunk& chunk : grid) {
+            if (chunk.active) chunk.updateTransforms(scene.world, sceneChanged);
+        }
+        gpuInstancesDirty = true;
+        lightsDirty = true;
+        trackCpuMemory();
+
+        lastUpdatePos = currentChunk;
+        hasUpdated = true;
+    }
+
+    // Nearest building along a normalised direction within maxDistance. A
+    // non-zero radius sweeps a sphere instead, distance is then where its
+    // centre stops. Buildings the ray starts inside are ignored.
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, CityHit& hit,
+                 float radius = 0.0f) const {
+        BvhRay ray(origin, direction, radius);
+        float nearest = maxDistance;
+        bool found = false;
+        chunkBvh.traverse(ray, nearest, bvhUseSimd, [&](int leaf, float& tMax) {
+            const Chunk& chunk = grid[chunkBvhSlots[leaf]];
+            chunk.bvh.traverse(ray, tMax, bvhUseSimd, [&](int building, float& tMax) {
+                const Building& b = chunk.buildings[building];
+                float t;
+                glm::vec3 normal;
+                if (RayBoxHit(ray, b.position - b.scale, b.position + b.scale, tMax, t, normal)) {
+                    tMax = t;
+                    hit.distance = t;
+                    hit.normal = normal;
+                    hit.chunk = chunk.position;
+                    hit.building = building;
+                    found = true;
+                }
+            });
+        });
+        if (found) hit.point = origin + direction * hit.distance;
+        return found;
+    }
+
+    // Draws one building tinted, e.g. the one picked under the cursor. A
+    // building of -1 clears it.
+    void setHighlight(const glm::ivec2& chunk, int building) {
+        if (chunk == highlightChunk && building == highlightBuilding) return;
+        highlightChunk = chunk;
+        highlightBuilding = building;
+        gpuInstancesDirty = true;
+    }
+
+    // Moves a sphere by delta, stopping short of buildings and sliding along
+    // the faces it touches for what is left of the move
+    glm::vec3 moveSphere(const glm::vec3& from, const glm::vec3& delta, float radius) const {
+        const float SKIN = 0.01f;
+        glm::vec3 position = from;
+        glm::vec3 remaining = delta;
+        for (int i = 0; i < 3; i++) {
+            float length = glm::length(remaining);
+            if (length < 1e-4f) break;
+            glm::vec3 direction = remaining / length;
+            CityHit hit;
+            if (!raycast(position, direction, length, hit, radius)) {
+                position += remaining;
+                break;
+            }
+            float travel = glm::max(hit.distance - SKIN, 0.0f);
+            position += direction * travel;
+            remaining -= direction * travel;
+            remaining -= hit.normal * glm::dot(remaining, hit.normal);
+        }
+        return position;
+    }
+
+    // Rendering runs in three phases. Classify reads occlusion results and
+    // frustum-tests whole chunks on the GL thread, build fills one DrawPacket
+    // per chunk in parallel on the job system, and submit consumes the packets
+    // on the GL thread and issues the next round of occlusion queries.
+    void render(const glm::mat4& vp, const glm::vec3& cameraPos) {
+        if (gpuDriven) {
+            renderGpuDriven(vp, cameraPos);
+            return;
+        }
+
+        auto phaseStart = std::chrono::steady_clock::now();
+        occlusion.beginFrame();
+        Frustum frustum(vp);
+
+        for (size_t i = 0; i < grid.size(); i++) {
+            Chunk& chunk = grid[i];
+            DrawPacket& packet = packets[i];
+            packet.inFrustum = chunk.active && frustum.intersectsBox(chunk.boundsMin, chunk.boundsMax);
+            if (!packet.inFrustum) {
+                packet.decision = OcclusionCuller::SKIP;
+                continue;
+            }
+            // Occluded chunks count too, their facades may be back next frame
+            requestFacadeDetail(chunk, cameraPos);
+            if (occlusionEnabled) {
+                packet.decision = occlusion.classify(chunk.occlusion, chunk.boundsMin, chunk.boundsMax, cameraPos);
+            } else {
+                packet.decision = OcclusionCuller::DRAW;
+            }
+        }
+        renderStats.classifyMs = elapsedMs(phaseStart);
+
+        phaseStart = std::chrono::steady_clock::now();
+        JobCounter built;
+        LinearArena* arena = frameArena ? &frameArena->current() : nullptr;
+        jobs.parallelFor(static_cast<int>(grid.size()), 1, [this, &frustum, &vp, arena](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                int highlighted = grid[i].position == highlightChunk ? highlightBuilding : -1;
+                buildPacket(grid[i], packets[i], frustum, vp, highlighted, arena);
+            }
+        }, built);
+        jobs.wait(built);
+        renderStats.buildMs = elapsedMs(phaseStart);
+
+        phaseStart = std::chrono::steady_clock::now();
+        renderStats.buildingsDrawn = 0;
+        renderStats.buildingsCulled = 0;
+        // Buildings of unconditionally drawn chunks go first and out in one
+        // instanced draw, each conditionally rendered chunk follows as its own
+        // range so it can sit inside its query's conditional render
+        std::vector<BuildingInstance>& instances = buildingRenderer.instances;
+        instances.clear();
+        for (const DrawPacket& packet : packets) {
+            renderStats.buildingsCulled += packet.buildingsCulled;
+            if (packet.decision == OcclusionCuller::DRAW) {
+                instances.insert(instances.end(), packet.items.begin(), packet.items.end());
+            }
+        }
+        size_t unconditional = instances.size();
+        for (const DrawPacket& packet : packets) {
+            if (packet.decision == OcclusionCuller::DRAW_CONDITIONAL) {
+                instances.insert(instances.end(), packet.items.begin(), packet.items.end());
+            }
+        }
+        renderStats.buildingsDrawn = static_cast<int>(instances.size());
+
+        buildingRenderer.upload();
+        buildingRenderer.begin();
+        buildingRenderer.draw(0, static_cast<int>(unconditional));
+        size_t first = unconditional;
+        for (size_t i = 0; i < grid.size(); i++) {
+            const DrawPacket& packet = packets[i];
+            if (packet.decision != OcclusionCuller::DRAW_CONDITIONAL || packet.items.empty()) continue;
+            glBeginConditionalRender(grid[i].occlusion.queryID, GL_QUERY_NO_WAIT);
+            buildingRenderer.draw(first, static_cast<int>(packet.items.size()));
+            glEndConditionalRender();
+            first += packet.items.size();
+        }
+        buildingRenderer.end();
+
+        // Test proxy boxes against the finished depth buffer for next frame
+        if (occlusionEnabled) {
+            occlusion.beginQueries(vp);
+            for (size_t i = 0; i < grid.size(); i++) {
+                Chunk& chunk = grid[i];
+                if (packets[i].inFrustum && occlusion.needsQuery(chunk.occlusion)) {
+                    occlusion.issueQuery(chunk.occlusion, chunk.boundsMin, chunk.boundsMax);
+                }
+            }
+            occlusion.endQueries();
+        }
+        renderStats.submitMs = elapsedMs(phaseStart);
+    }
+
+    // All culling happens on the GPU, the CPU only gathers instances when the
+    // set of active chunks changes
+    void renderGpuDriven(const glm::mat4& vp, const glm::vec3& cameraPos) {
+        auto phaseStart = std::chrono::steady_clock::now();
+        Frustum frustum(vp);
+        for (const Chunk& chunk : grid) {
+            if (chunk.active && frustum.intersectsBox(chunk.boundsMin, chunk.boundsMax)) {
+                requestFacadeDetail(chunk, cameraPos);
+            }
+        }
+        if (gpuInstancesDirty) {
+            gpuInstances.clear();
+            for (const Chunk& chunk : grid) {
+                if (!chunk.active) continue;
+                for (int i = 0; i < ChunkLayout::BUILDING_COUNT; i++) {
+                    const Building& b = chunk.buildings[i];
+                    bool highlighted = chunk.position == highlightChunk && i == highlightBuilding;
+                    gpuInstances.push_back(GpuInstance{glm::vec4(b.position, highlighted ? 1.0f : 0.0f),
+                                                       glm::vec4(b.scale, float(chunk.layout.buildings[i].facade))});
+                }
+            }
+            gpuRenderer.uploadInstances(gpuInstances);
+            gpuInstancesDirty = false;
+        }
+        renderStats.classifyMs = elapsedMs(phaseStart);
+        renderStats.buildMs = 0.0;
+
+        phaseStart = std::chrono::steady_clock::now();
+        gpuRenderer.render(vp);
+        renderStats.submitMs = elapsedMs(phaseStart);
+
+        // Visibility is decided on the GPU and read back a few frames later
+        int visible = gpuRenderer.visibleCount;
+        renderStats.buildingsDrawn = visible;
+        renderStats.buildingsCulled = visible < 0 ? -1 : glm::max(gpuRenderer.instanceCount - visible, 0);
+    }
+
+    void cleanup() {
+        if (gpuRenderer.available) {
+            gpuRenderer.cleanup();
+        }
+        for (Chunk& chunk : grid) {
+            destroyChunk(chunk);
+        }
+        for (Chunk& chunk : cache.chunks()) {
+            destroyChunk(chunk);
+        }
+        cache.clear();
+        chunkBvh.clear();
+        chunkBoxes.clear();
+        chunkBvhSlots.clear();
+        occlusion.cleanup();
+        buildingRenderer.cleanup();
+        ReleaseFacadeTextures();
+        trackCpuMemory();
+        hasUpdated = false;
+    }
+};
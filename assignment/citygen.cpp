@@ -0,0 +1,121 @@
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+// Small deterministic RNG. Only integer arithmetic is used to derive values,
+// so a given seed produces the same city on every platform and thread.
+struct CityRandom {
+    uint64_t state;
+
+    static uint64_t splitMix64(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    explicit CityRandom(uint64_t seed) : state(seed) {}
+
+    uint32_t next() {
+        state = splitMix64(state);
+        return static_cast<uint32_t>(state >> 32);
+    }
+
+    // Uniform in [0, 1)
+    float nextFloat() {
+        return (next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    float range(float lo, float hi) {
+        return lo + (hi - lo) * nextFloat();
+    }
+
+    int nextInt(int n) {
+        return static_cast<int>((static_cast<uint64_t>(next()) * n) >> 32);
+    }
+};
+
+struct BuildingLayout {
+    glm::vec3 offset;       // Centre relative to the chunk origin
+    glm::vec3 scale;        // Half extents of the box
+    int facade;             // Index into the facade texture set
+};
+
+struct ChunkLayout {
+    static const int LOTS_PER_SIDE = 8;
+    static const int BUILDING_COUNT = LOTS_PER_SIDE * LOTS_PER_SIDE;
+
+    glm::ivec2 coord;
+    BuildingLayout buildings[BUILDING_COUNT];
+};
+
+// Generates the buildings of a chunk purely from the city seed and the chunk's
+// integer coordinates. generate() touches no shared state, so any number of
+// chunks can be generated concurrently.
+struct CityGenerator {
+    static constexpr float LOT_SIZE = 200.0f;
+    static constexpr float CHUNK_WIDTH = ChunkLayout::LOTS_PER_SIDE * LOT_SIZE;
+    static const int FACADE_COUNT = 4;
+
+    uint64_t seed;
+
+    explicit CityGenerator(uint64_t citySeed = 1337) : seed(citySeed) {}
+
+    uint64_t chunkSeed(const glm::ivec2 &coord) const {
+        uint64_t key = static_cast<uint64_t>(static_cast<uint32_t>(coord.x))
+                       | (static_cast<uint64_t>(static_cast<uint32_t>(coord.y)) << 32);
+        return CityRandom::splitMix64(seed ^ CityRandom::splitMix64(key));
+    }
+
+    void generate(const glm::ivec2 &coord, ChunkLayout &layout) const {
+        CityRandom rng(chunkSeed(coord));
+        layout.coord = coord;
+
+        // Street spacing varies per chunk: each row and column of lots gets a
+        // random width, normalised so the lots still tile the chunk exactly
+        float lotX[ChunkLayout::LOTS_PER_SIDE + 1], lotZ[ChunkLayout::LOTS_PER_SIDE + 1];
+        splitLots(rng, lotX);
+        splitLots(rng, lotZ);
+
+        for (int i = 0; i < ChunkLayout::LOTS_PER_SIDE; i++) {
+            for (int j = 0; j < ChunkLayout::LOTS_PER_SIDE; j++) {
+                BuildingLayout &b = layout.buildings[i * ChunkLayout::LOTS_PER_SIDE + j];
+                float lotWidth = lotX[i + 1] - lotX[i];
+                float lotDepth = lotZ[j + 1] - lotZ[j];
+
+                // Footprint leaves at least 15% of the lot free for the street
+                float halfX = rng.range(12.0f, 0.35f * lotWidth);
+                float halfZ = rng.range(12.0f, 0.35f * lotDepth);
+
+                // Mostly low-rise with the occasional tower
+                float t = rng.nextFloat();
+                float height = 60.0f + 440.0f * t * t * t;
+
+                float slackX = 0.5f * lotWidth - halfX - 0.15f * lotWidth;
+                float slackZ = 0.5f * lotDepth - halfZ - 0.15f * lotDepth;
+                float x = 0.5f * (lotX[i] + lotX[i + 1]) + rng.range(-1.0f, 1.0f) * glm::max(slackX, 0.0f);
+                float z = 0.5f * (lotZ[j] + lotZ[j + 1]) + rng.range(-1.0f, 1.0f) * glm::max(slackZ, 0.0f);
+
+                b.offset = glm::vec3(x, 0, z);
+                b.scale = glm::vec3(halfX, height, halfZ);
+                b.facade = rng.nextInt(FACADE_COUNT);
+            }
+        }
+    }
+
+private:
+    static void splitLots(CityRandom &rng, float *edges) {
+        float widths[ChunkLayout::LOTS_PER_SIDE];
+        float total = 0.0f;
+        for (int i = 0; i < ChunkLayout::LOTS_PER_SIDE; i++) {
+            widths[i] = rng.range(0.7f, 1.3f);
+            total += widths[i];
+        }
+
+        edges[0] = 0.0f;
+        for (int i = 0; i < ChunkLayout::LOTS_PER_SIDE; i++) {
+            edges[i + 1] = edges[i] + widths[i] * (CHUNK_WIDTH / total);
+        }
+        edges[ChunkLayout::LOTS_PER_SIDE] = CHUNK_WIDTH;
+    }
+};
@@ -0,0 +1,157 @@
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <iostream>
+
+// Must match the ClusterParams block in the lit fragment shaders (std140)
+struct ClusterParams {
+    glm::mat4 view;
+    glm::vec4 screen;           // xy = render target size in pixels
+    glm::ivec4 dims;            // x, y = tiles, z = depth slices, w = light count
+    glm::vec4 depth;            // x = slice scale, y = slice bias, over log(view depth)
+};
+
+// Texture units and uniform block binding reserved for clustered lighting.
+// Every lit program samples the same three buffers, so they are bound once
+// per frame and never touched by the per-object draws (which use units 0-3).
+static const int CLUSTER_LIGHTS_UNIT = 4;
+static const int CLUSTER_GRID_UNIT = 5;
+static const int CLUSTER_INDICES_UNIT = 6;
+static const GLuint CLUSTER_PARAMS_BINDING = 0;
+
+// Points a lit program's cluster samplers and parameter block at the shared
+// bindings. Programs without clustered lighting are left alone.
+static void SetupClusteredLightingProgram(GLuint programID) {
+    GLuint blockIndex = glGetUniformBlockIndex(programID, "ClusterParams");
+    if (blockIndex == GL_INVALID_INDEX) return;
+    glUniformBlockBinding(programID, blockIndex, CLUSTER_PARAMS_BINDING);
+
+    glUseProgram(programID);
+    glUniform1i(glGetUniformLocation(programID, "clusterLights"), CLUSTER_LIGHTS_UNIT);
+    glUniform1i(glGetUniformLocation(programID, "clusterGrid"), CLUSTER_GRID_UNIT);
+    glUniform1i(glGetUniformLocation(programID, "clusterIndices"), CLUSTER_INDICES_UNIT);
+    glUseProgram(0);
+}
+
+// Clustered forward shading for the city's point lights. Each frame the
+// lights are binned into view-space clusters on the job system (LightBinner)
+// and the result is uploaded into three texture buffers: the lights, an
+// (offset, count) pair per cluster and the flat index list. Fragment shaders
+// find their cluster from gl_FragCoord and view depth and only loop over the
+// lights in it. Everything is GL 3.3 (texture buffers and a uniform block).
+struct ClusteredLighting {
+    GLuint lightBufferID = 0, gridBufferID = 0, indexBufferID = 0, paramsBufferID = 0;
+    GLuint lightTextureID = 0, gridTextureID = 0, indexTextureID = 0;
+    size_t lightCapacity = 0, indexCapacity = 0;
+
+    LightBinner binner;
+
+    void initialize() {
+        glGenBuffers(1, &lightBufferID);
+        glGenBuffers(1, &gridBufferID);
+        glGenBuffers(1, &indexBufferID);
+        glGenTextures(1, &lightTextureID);
+        glGenTextures(1, &gridTextureID);
+        glGenTextures(1, &indexTextureID);
+
+        // The grid never changes size
+        glBindBuffer(GL_TEXTURE_BUFFER, gridBufferID);
+        glBufferData(GL_TEXTURE_BUFFER, binner.clusters.size() * sizeof(uint32_t), NULL, GL_STREAM_DRAW);
+        memoryTracker.trackBuffer("lights", gridBufferID, binner.clusters.size() * sizeof(uint32_t));
+        reserve(lightBufferID, lightCapacity, 1024 * sizeof(PointLight));
+        reserve(indexBufferID, indexCapacity, 16 * 1024 * sizeof(uint32_t));
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        glBindTexture(GL_TEXTURE_BUFFER, lightTextureID);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightBufferID);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTextureID);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, gridBufferID);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTextureID);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, indexBufferID);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        glGenBuffers(1, &paramsBufferID);
+        glBindBuffer(GL_UNIFORM_BUFFER, paramsBufferID);
+        ClusterParams params = {};
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(ClusterParams), &params, GL_STREAM_DRAW);
+        memoryTracker.trackBuffer("lights", paramsBufferID, sizeof(ClusterParams));
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        GLenum errorCode = glGetError();
+        if (errorCode != 0) {
+            std::cout << "Clustered lighting error initializing: " << errorCode << std::endl;
+        }
+    }
+
+    // Bins the lights for this frame's camera, uploads the cluster data and
+    // binds it for every lit draw that follows. Call after the render target
+    // size for the frame is known.
+    void update(const std::vector<PointLight>& lights, const glm::mat4& view, float fovY, float aspect,
+                float zNear, float zFar, int renderWidth, int renderHeight, JobSystem* jobs) {
+        binner.bin(lights, view, fovY, aspect, zNear, zFar, jobs);
+
+        glBindBuffer(GL_TEXTURE_BUFFER, lightBufferID);
+        reserve(lightBufferID, lightCapacity, lights.size() * sizeof(PointLight));
+        if (!lights.empty()) {
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, lights.size() * sizeof(PointLight), lights.data());
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, gridBufferID);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, binner.clusters.size() * sizeof(uint32_t), binner.clusters.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, indexBufferID);
+        reserve(indexBufferID, indexCapacity, binner.indices.size() * sizeof(uint32_t));
+        if (!binner.indices.empty()) {
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, binner.indices.size() * sizeof(uint32_t), binner.indices.data());
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        ClusterParams params;
+        params.view = view;
+        params.screen = glm::vec4(float(renderWidth), float(renderHeight), 0.0f, 0.0f);
+        params.dims = glm::ivec4(LightBinner::TILES_X, LightBinner::TILES_Y, LightBinner::SLICES,
+                                 static_cast<int>(lights.size()));
+        params.depth = glm::vec4(binner.sliceScale, binner.sliceBias, zNear, zFar);
+        glBindBuffer(GL_UNIFORM_BUFFER, paramsBufferID);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(ClusterParams), &params);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+        glBindBufferBase(GL_UNIFORM_BUFFER, CLUSTER_PARAMS_BINDING, paramsBufferID);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_LIGHTS_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, lightTextureID);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_GRID_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, gridTextureID);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_INDICES_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, indexTextureID);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    const LightBinStats& stats() const {
+        return binner.stats;
+    }
+
+    void cleanup() {
+        for (GLuint buffer : {lightBufferID, gridBufferID, indexBufferID, paramsBufferID}) {
+            memoryTracker.releaseBuffer(buffer);
+        }
+        glDeleteBuffers(1, &lightBufferID);
+        glDeleteBuffers(1, &gridBufferID);
+        glDeleteBuffers(1, &indexBufferID);
+        glDeleteBuffers(1, &paramsBufferID);
+        glDeleteTextures(1, &lightTextureID);
+        glDeleteTextures(1, &gridTextureID);
+        glDeleteTextures(1, &indexTextureID);
+    }
+
+private:
+    // Grows a buffer bound to GL_TEXTURE_BUFFER to at least bytes, doubling so
+    // a slowly growing light count doesn't reallocate every frame. The buffer
+    // texture follows the new storage automatically.
+    static void reserve(GLuint bufferID, size_t& capacity, size_t bytes) {
+        if (bytes <= capacity) return;
+        capacity = glm::max(bytes, capacity * 2);
+        glBindBuffer(GL_TEXTURE_BUFFER, bufferID);
+        glBufferData(GL_TEXTURE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        memoryTracker.trackBuffer("lights", bufferID, capacity);
+    }
+};
@@ -0,0 +1,7 @@
+#include <stddef.h>
+
+// Depth values in [0, 1] to grey RGB bytes, as written by saveDepthTexture.
+// rgb must hold 3 * count bytes.
+static void ConvertDepthToRgb(const float *depth, int count, unsigned char *rgb) {
+    for (int i = 0; i < count; ++i) rgb[3*i] = rgb[3*i+1] = rgb[3*i+2] = depth[i] * 255;
+}
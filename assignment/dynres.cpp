@@ -0,0 +1,223 @@
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <iostream>
+#include <math.h>
+
+#include <render/shader.h>
+
+// Picks the next frame's resolution scale from measured GPU time. Time scales
+// roughly with pixel count, so a frame that is over budget is corrected by
+// the square root of the ratio. Scaling back up is done in small steps and
+// only with clear headroom, so the scale doesn't oscillate around the target.
+struct ResolutionController {
+    enum Decision { HOLD, LOWER, RAISE };
+
+    float targetMs;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    float scale = 1.0f;
+    float smoothedMs = 0.0f;
+
+    Decision lastDecision = HOLD;
+    unsigned long lowered = 0, raised = 0, held = 0;
+
+    explicit ResolutionController(float frameTargetMs = 16.6f) : targetMs(frameTargetMs) {}
+
+    void update(float gpuMs) {
+        smoothedMs = smoothedMs == 0.0f ? gpuMs : smoothedMs * 0.8f + gpuMs * 0.2f;
+
+        float newScale = scale;
+        if (smoothedMs > targetMs * 1.05f) {
+            newScale = scale * glm::max(sqrtf(targetMs / smoothedMs), 0.9f);
+        } else if (smoothedMs < targetMs * 0.8f) {
+            newScale = scale + 0.02f;
+        }
+        newScale = glm::clamp(newScale, minScale, maxScale);
+
+        if (newScale < scale) {
+            lastDecision = LOWER;
+            lowered++;
+        } else if (newScale > scale) {
+            lastDecision = RAISE;
+            raised++;
+        } else {
+            lastDecision = HOLD;
+            held++;
+        }
+        scale = newScale;
+    }
+
+    const char *decisionName() const {
+        switch (lastDecision) {
+            case LOWER: return "lower";
+            case RAISE: return "raise";
+            default: return "hold";
+        }
+    }
+};
+
+// Renders the scene into an offscreen framebuffer at a fraction of the window
+// size and upscales it to the backbuffer. The colour texture is allocated at
+// full size once and the scene only uses its lower-left corner, so changing
+// the scale never reallocates. GPU time is measured with timer queries read
+// back a few frames later, never stalling on the current frame.
+struct DynamicResolution {
+    static const int QUERY_LATENCY = 3;
+
+    bool enabled = true;
+    bool sharpen = true;
+    float sharpness = 0.5f;
+    ResolutionController controller;
+
+    int width = 0, height = 0;          // Full framebuffer size
+    int renderWidth = 0, renderHeight = 0;
+    float lastGpuMs = 0.0f;
+
+    GLuint framebufferID, colorTextureID, depthBufferID;
+    GLuint vertexArrayID, programID;
+    GLuint sceneSamplerID, uvScaleID, texelSizeID, sharpenID, sharpnessID;
+    GLuint timerQueries[QUERY_LATENCY];
+    bool queryPending[QUERY_LATENCY] = {false};
+    unsigned long frameIndex = 0;
+
+    void initialize(int framebufferWidth, int framebufferHeight, float frameTargetMs) {
+        width = framebufferWidth;
+        height = framebufferHeight;
+        controller.targetMs = frameTargetMs;
+
+        glGenTextures(1, &colorTextureID);
+        glBindTexture(GL_TEXTURE_2D, colorTextureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+        memoryTracker.trackTexture("dynres", colorTextureID, TextureBytes(width, height, 3, false));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenRenderbuffers(1, &depthBufferID);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBufferID);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        // Drivers store 24-bit depth padded to four bytes (D24X8)
+        memoryTracker.trackRenderbuffer("dynres", depthBufferID, TextureBytes(width, height, 4, false));
+
+        glGenFramebuffers(1, &framebufferID);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTextureID, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBufferID);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Dynamic resolution framebuffer is incomplete, rendering at full size." << std::endl;
+            enabled = false;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // The fullscreen triangle is generated in the vertex shader, but core
+        // profile still needs a vertex array bound to draw
+        glGenVertexArrays(1, &vertexArrayID);
+
+        programID = LoadShadersFromFile("../assignment/shaders/upscale.vert",
+                                        "../assignment/shaders/upscale.frag");
+        if (programID == 0) {
+            std::cerr << "Failed to load shaders." << std::endl;
+            enabled = false;
+        }
+
+        sceneSamplerID = glGetUniformLocation(programID, "sceneSampler");
+        uvScaleID = glGetUniformLocation(programID, "uvScale");
+        texelSizeID = glGetUniformLocation(programID, "texelSize");
+        sharpenID = glGetUniformLocation(programID, "sharpen");
+        sharpnessID = glGetUniformLocation(programID, "sharpness");
+
+        glGenQueries(QUERY_LATENCY, timerQueries);
+
+        GLenum errorCode = glGetError();
+        if (errorCode != 0) {
+            std::cout << "Dynamic resolution error initializing: " << errorCode << std::endl;
+        }
+    }
+
+    float scale() const {
+        return enabled ? controller.scale : 1.0f;
+    }
+
+    // Call before clearing and drawing the scene
+    void beginFrame() {
+        collectTimings();
+
+        renderWidth = glm::max(1, int(width * scale()));
+        renderHeight = glm::max(1, int(height * scale()));
+
+        int slot = frameIndex % QUERY_LATENCY;
+        if (!queryPending[slot]) {
+            glBeginQuery(GL_TIME_ELAPSED, timerQueries[slot]);
+        }
+
+        if (enabled) {
+            glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+        }
+        glViewport(0, 0, renderWidth, renderHeight);
+    }
+
+    // Call once the scene is drawn, upscales it into the backbuffer
+    void endFrame() {
+        int slot = frameIndex % QUERY_LATENCY;
+        if (!queryPending[slot]) {
+            glEndQuery(GL_TIME_ELAPSED);
+            queryPending[slot] = true;
+        }
+        frameIndex++;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+        if (!enabled) return;
+
+        glDisable(GL_DEPTH_TEST);
+        glUseProgram(programID);
+        glBindVertexArray(vertexArrayID);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, colorTextureID);
+        glUniform1i(sceneSamplerID, 0);
+        glUniform2f(uvScaleID, float(renderWidth) / width, float(renderHeight) / height);
+        glUniform2f(texelSizeID, 1.0f / width, 1.0f / height);
+        glUniform1i(sharpenID, sharpen ? 1 : 0);
+        glUniform1f(sharpnessID, sharpness);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        glBindVertexArray(0);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    void cleanup() {
+        glDeleteQueries(QUERY_LATENCY, timerQueries);
+        memoryTracker.releaseTexture(colorTextureID);
+        memoryTracker.releaseRenderbuffer(depthBufferID);
+        glDeleteFramebuffers(1, &framebufferID);
+        glDeleteTextures(1, &colorTextureID);
+        glDeleteRenderbuffers(1, &depthBufferID);
+        glDeleteVertexArrays(1, &vertexArrayID);
+        glDeleteProgram(programID);
+    }
+
+private:
+    // Reads back every timer query that has finished and feeds the controller
+    void collectTimings() {
+        for (int i = 0; i < QUERY_LATENCY; i++) {
+            if (!queryPending[i]) continue;
+
+            GLint available = 0;
+            glGetQueryObjectiv(timerQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+
+            GLuint64 elapsedNs = 0;
+            glGetQueryObjectui64v(timerQueries[i], GL_QUERY_RESULT, &elapsedNs);
+            queryPending[i] = false;
+
+            lastGpuMs = elapsedNs / 1.0e6f;
+            if (enabled) {
+                controller.update(lastGpuMs);
+            }
+        }
+    }
+};
@@ -0,0 +1,51 @@
+#include <glm/glm.hpp>
+
+// View frustum as six inward-facing planes (xyz = normal, w = distance),
+// extracted from a view-projection matrix.
+struct Frustum {
+    glm::vec4 planes[6];
+
+    Frustum() {}
+
+    explicit Frustum(const glm::mat4 &vp) {
+        // glm is column-major, row i of the matrix is (vp[0][i], vp[1][i], vp[2][i], vp[3][i])
+        glm::vec4 row0(vp[0][0], vp[1][0], vp[2][0], vp[3][0]);
+        glm::vec4 row1(vp[0][1], vp[1][1], vp[2][1], vp[3][1]);
+        glm::vec4 row2(vp[0][2], vp[1][2], vp[2][2], vp[3][2]);
+        glm::vec4 row3(vp[0][3], vp[1][3], vp[2][3], vp[3][3]);
+
+        planes[0] = row3 + row0;    // Left
+        planes[1] = row3 - row0;    // Right
+        planes[2] = row3 + row1;    // Bottom
+        planes[3] = row3 - row1;    // Top
+        planes[4] = row3 + row2;    // Near
+        planes[5] = row3 - row2;    // Far
+    }
+
+    // Conservative box test: false only if the box is entirely outside one plane
+    bool intersectsBox(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const {
+        for (const glm::vec4 &plane : planes) {
+            // Corner furthest along the plane normal
+            glm::vec3 corner(plane.x >= 0.0f ? boxMax.x : boxMin.x,
+                             plane.y >= 0.0f ? boxMax.y : boxMin.y,
+                             plane.z >= 0.0f ? boxMax.z : boxMin.z);
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Point test of a building's centre against the clip volume
+bool isBuildingInView(const glm::vec3 &position, const glm::mat4 &vp) {
+    glm::vec4 clipSpacePos = vp* glm::vec4(position, 1.0f);
+
+    if (clipSpacePos.w != 0.0f) {
+        clipSpacePos /= clipSpacePos.w;
+    }
+
+    return (clipSpacePos.x >= -1.0f && clipSpacePos.x <= 1.0f &&
+            clipSpacePos.y >= -1.0f && clipSpacePos.y <= 1.0f &&
+            clipSpacePos.z >= -1.0f && clipSpacePos.z <= 1.0f);
+}
@@ -0,0 +1,433 @@
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+// First-fit suballocator over [0, capacity) in elements. Free ranges are kept
+// sorted by offset and merged with their neighbours on release.
+struct RangeAllocator {
+    struct Range {
+        size_t offset, size;
+    };
+
+    std::vector<Range> freeRanges;
+    size_t capacity = 0;
+    size_t used = 0;
+
+    // Everything below usedPrefix is taken, the rest is one free range
+    void reset(size_t newCapacity, size_t usedPrefix = 0) {
+        freeRanges.clear();
+        capacity = newCapacity;
+        used = usedPrefix;
+        if (usedPrefix < newCapacity) freeRanges.push_back(Range{usedPrefix, newCapacity - usedPrefix});
+    }
+
+    bool allocate(size_t size, size_t &offset) {
+        for (size_t i = 0; i < freeRanges.size(); i++) {
+            Range &range = freeRanges[i];
+            if (range.size < size) continue;
+            offset = range.offset;
+            range.offset += size;
+            range.size -= size;
+            if (range.size == 0) freeRanges.erase(freeRanges.begin() + i);
+            used += size;
+            return true;
+        }
+        return false;
+    }
+
+    void release(size_t offset, size_t size) {
+        auto next = std::lower_bound(freeRanges.begin(), freeRanges.end(), offset,
+                                     [](const Range &range, size_t value) { return range.offset < value; });
+        used -= size;
+        bool joinsPrevious = next != freeRanges.begin() && (next - 1)->offset + (next - 1)->size == offset;
+        bool joinsNext = next != freeRanges.end() && offset + size == next->offset;
+        if (joinsPrevious && joinsNext) {
+            (next - 1)->size += size + next->size;
+            freeRanges.erase(next);
+        } else if (joinsPrevious) {
+            (next - 1)->size += size;
+        } else if (joinsNext) {
+            next->offset = offset;
+            next->size += size;
+        } else {
+            freeRanges.insert(next, Range{offset, size});
+        }
+    }
+
+    size_t freeTotal() const {
+        return capacity - used;
+    }
+
+    size_t largestFree() const {
+        size_t largest = 0;
+        for (const Range &range : freeRanges) largest = glm::max(largest, range.size);
+        return largest;
+    }
+
+    // Free space below the last allocation, only a compaction gets it back in one piece
+    size_t holes() const {
+        size_t tail = (!freeRanges.empty() && freeRanges.back().offset + freeRanges.back().size == capacity)
+                      ? freeRanges.back().size : 0;
+        return freeTotal() - tail;
+    }
+};
+
+// One vertex attribute of a pool format, as passed to glVertexAttrib(I)Pointer
+struct GeometryAttribute {
+    GLuint location;
+    GLint components;
+    GLenum type;
+    bool integer;
+    size_t offset;
+};
+
+// Interleaved vertex layout shared by every allocation of a format
+struct GeometryFormat {
+    static const int MAX_ATTRIBUTES = 4;
+
+    const char *name;
+    GLsizei stride;
+    int attributeCount;
+    GeometryAttribute attributes[MAX_ATTRIBUTES];
+};
+
+typedef int GeometryHandle;     // Index into the pool's allocation table, -1 for none
+
+// Shared vertex and index buffers, one pair and one VAO per vertex format.
+// Meshes, buildings and the skybox hold handles to ranges in them instead of
+// their own buffers, so everything of a format draws from one binding with a
+// base vertex, and a model's meshes go out in one glMultiDrawElementsBaseVertex.
+// Indices are stored relative to the allocation's first vertex.
+//
+// Buffers grow by doubling. Growing and defragmenting both copy the live
+// ranges into fresh buffers on the GPU (glCopyBufferSubData) packed to the
+// front and update the allocation table, so handles stay valid.
+struct GeometryPool {
+    static constexpr size_t MIN_VERTICES = 4096;
+    static constexpr size_t MIN_INDICES = 8192;
+    static constexpr size_t DEFRAGMENT_MIN_BYTES = 64 * 1024;
+
+    struct Allocation {
+        int format;
+        size_t firstVertex, vertexCount;
+        size_t firstIndex, indexCount;
+        bool live;
+    };
+
+    struct Arena {
+        GeometryFormat format;
+        GLuint vertexArrayID = 0, vertexBufferID = 0, indexBufferID = 0;
+        RangeAllocator vertices, indices;
+        int allocations = 0;
+        unsigned long grows = 0;
+        unsigned long defragmentations = 0;
+
+        size_t bytesInUse() const {
+            return vertices.used * format.stride + indices.used * sizeof(GLuint);
+        }
+
+        size_t capacityBytes() const {
+            return vertices.capacity * format.stride + indices.capacity * sizeof(GLuint);
+        }
+
+        // Share of the free bytes outside the largest free range, 0 when all
+        // free space is in one piece
+        float fragmentation() const {
+            size_t free = vertices.freeTotal() * format.stride + indices.freeTotal() * sizeof(GLuint);
+            if (free == 0) return 0.0f;
+            size_t largest = vertices.largestFree() * format.stride + indices.largestFree() * sizeof(GLuint);
+            return 1.0f - float(largest) / float(free);
+        }
+    };
+
+    std::vector<Arena> arenas;
+    std::vector<Allocation> allocations;
+    std::vector<GeometryHandle> freeHandles;
+
+    // Formats stay registered across cleanup(), the buffers are created on
+    // first allocation
+    int registerFormat(const GeometryFormat &format) {
+        Arena arena;
+        arena.format = format;
+        arenas.push_back(arena);
+        return static_cast<int>(arenas.size()) - 1;
+    }
+
+    // -1 for empty geometry, which draws nothing
+    GeometryHandle allocate(int format, const void *vertexData, size_t vertexCount,
+                            const GLuint *indexData, size_t indexCount) {
+        if (vertexCount == 0 || indexCount == 0) return -1;
+        Arena &arena = arenas[format];
+
+        size_t firstVertex = 0, firstIndex = 0;
+        bool fits = arena.vertices.allocate(vertexCount, firstVertex);
+        if (fits && !arena.indices.allocate(indexCount, firstIndex)) {
+            arena.vertices.release(firstVertex, vertexCount);
+            fits = false;
+        }
+        if (!fits) {
+            // Either way the live ranges end up packed, so both fit at the end
+            if (arena.vertices.freeTotal() >= vertexCount && arena.indices.freeTotal() >= indexCount) {
+                defragment(format);
+            } else {
+                size_t vertexCapacity = glm::max(glm::max(arena.vertices.capacity * 2, MIN_VERTICES),
+                                                 arena.vertices.used + vertexCount);
+                size_t indexCapacity = glm::max(glm::max(arena.indices.capacity * 2, MIN_INDICES),
+                                                arena.indices.used + indexCount);
+                repack(format, vertexCapacity, indexCapacity);
+                arena.grows++;
+            }
+            arena.vertices.allocate(vertexCount, firstVertex);
+            arena.indices.allocate(indexCount, firstIndex);
+        }
+
+        // The copy targets leave the element buffer binding of whatever VAO
+        // is bound alone
+        glBindBuffer(GL_COPY_WRITE_BUFFER, arena.vertexBufferID);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, firstVertex * arena.format.stride, vertexCount * arena.format.stride, vertexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, arena.indexBufferID);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, firstIndex * sizeof(GLuint), indexCount * sizeof(GLuint), indexData);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        GeometryHandle handle;
+        if (!freeHandles.empty()) {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+        } else {
+            handle = static_cast<GeometryHandle>(allocations.size());
+            allocations.push_back(Allocation());
+        }
+        allocations[handle] = Allocation{format, firstVertex, vertexCount, firstIndex, indexCount, true};
+        arena.allocations++;
+        return handle;
+    }
+
+    void release(GeometryHandle &handle) {
+        if (handle < 0) return;
+        Allocation &allocation = allocations[handle];
+        Arena &arena = arenas[allocation.format];
+        arena.vertices.release(allocation.firstVertex, allocation.vertexCount);
+        arena.indices.release(allocation.firstIndex, allocation.indexCount);
+        arena.allocations--;
+        allocation.live = false;
+        freeHandles.push_back(handle);
+        handle = -1;
+    }
+
+    const Allocation &get(GeometryHandle handle) const {
+        return allocations[handle];
+    }
+
+    size_t allocationBytes(GeometryHandle handle) const {
+        if (handle < 0) return 0;
+        const Allocation &allocation = allocations[handle];
+        return allocation.vertexCount * arenas[allocation.format].format.stride + allocation.indexCount * sizeof(GLuint);
+    }
+
+    // Once per batch, draw() and the like then only issue the draw call
+    void bind(int format) {
+        glBindVertexArray(arenas[format].vertexArrayID);
+    }
+
+    void draw(GeometryHandle handle) {
+        if (handle < 0) return;
+        const Allocation &allocation = allocations[handle];
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(allocation.indexCount), GL_UNSIGNED_INT,
+                                 (void*)(allocation.firstIndex * sizeof(GLuint)), static_cast<GLint>(allocation.firstVertex));
+    }
+
+    void drawInstanced(GeometryHandle handle, int instances) {
+        if (handle < 0) return;
+        const Allocation &allocation = allocations[handle];
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(allocation.indexCount), GL_UNSIGNED_INT,
+                                          (void*)(allocation.firstIndex * sizeof(GLuint)), instances,
+                                          static_cast<GLint>(allocation.firstVertex));
+    }
+
+    // Every handle must belong to the bound format
+    void multiDraw(const GeometryHandle *handles, int count) {
+        drawCounts.clear();
+        drawOffsets.clear();
+        drawBaseVertices.clear();
+        for (int i = 0; i < count; i++) {
+            if (handles[i] < 0) continue;
+            const Allocation &allocation = allocations[handles[i]];
+            drawCounts.push_back(static_cast<GLsizei>(allocation.indexCount));
+            drawOffsets.push_back((void*)(allocation.firstIndex * sizeof(GLuint)));
+            drawBaseVertices.push_back(static_cast<GLint>(allocation.firstVertex));
+        }
+        if (drawCounts.empty()) return;
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, drawCounts.data(), GL_UNSIGNED_INT, drawOffsets.data(),
+                                      static_cast<GLsizei>(drawCounts.size()), drawBaseVertices.data());
+    }
+
+    // Packs the format's live ranges to the front of its buffers
+    void defragment(int format) {
+        Arena &arena = arenas[format];
+        repack(format, arena.vertices.capacity, arena.indices.capacity);
+        arena.defragmentations++;
+    }
+
+    // Call after releasing allocations. Holes are reused by allocations of
+    // the same size, so only compact once they hold a good share of the pool.
+    void maybeDefragment() {
+        for (int format = 0; format < static_cast<int>(arenas.size()); format++) {
+            const Arena &arena = arenas[format];
+            size_t holeBytes = arena.vertices.holes() * arena.format.stride + arena.indices.holes() * sizeof(GLuint);
+            if (holeBytes >= DEFRAGMENT_MIN_BYTES && holeBytes * 4 >= arena.bytesInUse()) {
+                defragment(format);
+            }
+        }
+    }
+
+    size_t bytesInUse() const {
+        size_t bytes = 0;
+        for (const Arena &arena : arenas) bytes += arena.bytesInUse();
+        return bytes;
+    }
+
+    size_t capacityBytes() const {
+        size_t bytes = 0;
+        for (const Arena &arena : arenas) bytes += arena.capacityBytes();
+        return bytes;
+    }
+
+    void print(std::ostream &out) const {
+        out << "Geometry pool: " << bytesInUse() / 1024.0 << " KB in use of " << capacityBytes() / 1024.0 << " KB" << std::endl;
+        for (const Arena &arena : arenas) {
+            if (arena.vertices.capacity == 0) continue;
+            out << "  " << arena.format.name << ": " << arena.allocations << " allocations, "
+                << arena.bytesInUse() / 1024.0 << " / " << arena.capacityBytes() / 1024.0 << " KB, fragmentation "
+                << arena.fragmentation() << ", " << arena.grows << " grows, "
+                << arena.defragmentations << " defragmentations" << std::endl;
+        }
+    }
+
+    // The GL context and every object in it are gone, forget all buffers and
+    // allocations without deleting anything. Owners allocate again.
+    void contextLost() {
+        for (Arena &arena : arenas) {
+            memoryTracker.releaseBuffer(arena.vertexBufferID);
+            memoryTracker.releaseBuffer(arena.indexBufferID);
+            arena.vertexArrayID = arena.vertexBufferID = arena.indexBufferID = 0;
+            arena.vertices.reset(0);
+            arena.indices.reset(0);
+            arena.allocations = 0;
+        }
+        allocations.clear();
+        freeHandles.clear();
+    }
+
+    void cleanup() {
+        for (Arena &arena : arenas) {
+            memoryTracker.releaseBuffer(arena.vertexBufferID);
+            memoryTracker.releaseBuffer(arena.indexBufferID);
+            glDeleteBuffers(1, &arena.vertexBufferID);
+            glDeleteBuffers(1, &arena.indexBufferID);
+            glDeleteVertexArrays(1, &arena.vertexArrayID);
+        }
+        contextLost();
+    }
+
+private:
+    std::vector<GLsizei> drawCounts;
+    std::vector<void*> drawOffsets;
+    std::vector<GLint> drawBaseVertices;
+    std::vector<std::pair<size_t*, size_t>> liveRanges;
+
+    // Moves the live vertex (or index) ranges of a format to the front of the
+    // destination buffer, merging ranges that were already adjacent into one copy
+    size_t compact(GLuint source, GLuint destination, size_t elementSize, bool vertexRanges, int format) {
+        liveRanges.clear();
+        for (Allocation &allocation : allocations) {
+            if (!allocation.live || allocation.format != format) continue;
+            if (vertexRanges) liveRanges.push_back(std::make_pair(&allocation.firstVertex, allocation.vertexCount));
+            else liveRanges.push_back(std::make_pair(&allocation.firstIndex, allocation.indexCount));
+        }
+        std::sort(liveRanges.begin(), liveRanges.end(),
+                  [](const std::pair<size_t*, size_t> &a, const std::pair<size_t*, size_t> &b) { return *a.first < *b.first; });
+
+        glBindBuffer(GL_COPY_READ_BUFFER, source);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, destination);
+        size_t end = 0, runSource = 0, runDestination = 0, runLength = 0;
+        for (auto &range : liveRanges) {
+            if (runLength > 0 && *range.first != runSource + runLength) {
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, runSource * elementSize,
+                                    runDestination * elementSize, runLength * elementSize);
+                runLength = 0;
+            }
+            if (runLength == 0) {
+                runSource = *range.first;
+                runDestination = end;
+            }
+            *range.first = end;
+            end += range.second;
+            runLength += range.second;
+        }
+        if (runLength > 0) {
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, runSource * elementSize,
+                                runDestination * elementSize, runLength * elementSize);
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return end;
+    }
+
+    // New buffers of the given capacity with every live range packed to the
+    // front, then the VAO is pointed at them
+    void repack(int format, size_t vertexCapacity, size_t indexCapacity) {
+        Arena &arena = arenas[format];
+        GLuint oldVertexBuffer = arena.vertexBufferID, oldIndexBuffer = arena.indexBufferID;
+        GLuint buffers[2];
+        glGenBuffers(2, buffers);
+        arena.vertexBufferID = buffers[0];
+        arena.indexBufferID = buffers[1];
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, arena.vertexBufferID);
+        glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * arena.format.stride, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, arena.indexBufferID);
+        glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+        memoryTracker.trackBuffer("geometry pool", arena.vertexBufferID, vertexCapacity * arena.format.stride);
+        memoryTracker.trackBuffer("geometry pool", arena.indexBufferID, indexCapacity * sizeof(GLuint));
+
+        size_t vertexEnd = 0, indexEnd = 0;
+        if (oldVertexBuffer != 0) {
+            vertexEnd = compact(oldVertexBuffer, arena.vertexBufferID, arena.format.stride, true, format);
+            indexEnd = compact(oldIndexBuffer, arena.indexBufferID, sizeof(GLuint), false, format);
+            memoryTracker.releaseBuffer(oldVertexBuffer);
+            memoryTracker.releaseBuffer(oldIndexBuffer);
+            glDeleteBuffers(1, &oldVertexBuffer);
+            glDeleteBuffers(1, &oldIndexBuffer);
+        }
+        arena.vertices.reset(vertexCapacity, vertexEnd);
+        arena.indices.reset(indexCapacity, indexEnd);
+
+        if (arena.vertexArrayID == 0) glGenVertexArrays(1, &arena.vertexArrayID);
+        glBindVertexArray(arena.vertexArrayID);
+        glBindBuffer(GL_ARRAY_BUFFER, arena.vertexBufferID);
+        for (int i = 0; i < arena.format.attributeCount; i++) {
+            const GeometryAttribute &attribute = arena.format.attributes[i];
+            glEnableVertexAttribArray(attribute.location);
+            if (attribute.integer) {
+                glVertexAttribIPointer(attribute.location, attribute.components, attribute.type, arena.format.stride,
+                                       (void*)attribute.offset);
+            } else {
+                glVertexAttribPointer(attribute.location, attribute.components, attribute.type, GL_FALSE,
+                                      arena.format.stride, (void*)attribute.offset);
+            }
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.indexBufferID);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        GLenum errorCode = glGetError();
+        if (errorCode != 0) {
+            std::cout << "Geometry pool error resizing " << arena.format.name << ": " << errorCode << std::endl;
+        }
+    }
+};
+
+static GeometryPool geometryPool;
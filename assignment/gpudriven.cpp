@@ -0,0 +1,263 @@
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <iostream>
+
+#include <render/shader.h>
+#include <render/glext.h>
+
+// Layout shared with cull.comp and city.vert
+struct GpuInstance {
+    glm::vec4 position;     // xyz = building centre, w = 1 if highlighted
+    glm::vec4 scale;        // xyz = half extents, w = facade
+};
+
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Optional GL 4.3 path for the city. Every active building lives in one
+// instance buffer; a compute shader frustum-culls them, compacts the survivors
+// into a second buffer and counts them into an indirect draw command, then
+// the whole city is drawn with a single glMultiDrawElementsIndirect. The CPU
+// only re-uploads instances when chunks change.
+//
+// The surviving count is copied out of the draw command into a ring of small
+// buffers, each fenced, and read once its fence has passed a few frames later,
+// so reporting it never stalls the pipeline.
+struct GpuCityRenderer {
+    static const int WORKGROUP_SIZE = 64;
+    static const int READBACK_LATENCY = 3;
+
+    bool available = false;
+    int capacity = 0;
+    int instanceCount = 0;
+    int visibleCount = -1;      // Survivors of a recent cull pass, -1 until one has been read back
+
+    GLuint vertexArrayID, vertexBufferID, uvBufferID, normalBufferID, indexBufferID;
+    GLuint instanceBufferID, visibleBufferID, commandBufferID;
+    GLuint readbackBufferIDs[READBACK_LATENCY] = {};
+    GLsync readbackFences[READBACK_LATENCY] = {};
+    int readbackFrame = 0;
+    GLuint cullProgramID, drawProgramID;
+    GLuint frustumPlanesID, instanceCountID;
+    GLuint vpMatrixID, lightPositionID, lightIntensityID;
+    GLuint facadeSamplerID;
+    glm::vec3 lightPosition, lightIntensity;
+
+    bool initialize(int maxInstances, const glm::vec3& __lightPosition, const glm::vec3& __lightIntensity) {
+        if (!HasGL43()) {
+            return false;
+        }
+
+        capacity = maxInstances;
+        lightPosition = __lightPosition;
+        lightIntensity = __lightIntensity;
+
+        // Same box geometry and UV tiling as BuildingRenderer
+
+        glGenVertexArrays(1, &vertexArrayID);
+        glBindVertexArray(vertexArrayID);
+
+        glGenBuffers(1, &vertexBufferID);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertices), cubeVertices, GL_STATIC_DRAW);
+        memoryTracker.trackBuffer("gpu-driven", vertexBufferID, sizeof(cubeVertices));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glGenBuffers(1, &uvBufferID);
+        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(cubeUVs), cubeUVs, GL_STATIC_DRAW);
+        memoryTracker.trackBuffer("gpu-driven", uvBufferID, sizeof(cubeUVs));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glGenBuffers(1, &normalBufferID);
+        glBindBuffer(GL_ARRAY_BUFFER, normalBufferID);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(cubeNormals), cubeNormals, GL_STATIC_DRAW);
+        memoryTracker.trackBuffer("gpu-driven", normalBufferID, sizeof(cubeNormals));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glGenBuffers(1, &indexBufferID);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cubeIndices), cubeIndices, GL_STATIC_DRAW);
+        memoryTracker.trackBuffer("gpu-driven", indexBufferID, sizeof(cubeIndices));
+
+        // All buildings, uploaded from the CPU when chunks change
+        glGenBuffers(1, &instanceBufferID);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBufferID);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * sizeof(GpuInstance), NULL, GL_DYNAMIC_DRAW);
+        memoryTracker.trackBuffer("gpu-driven", instanceBufferID, capacity * sizeof(GpuInstance));
+
+        // Buildings that survived culling, read back as per-instance attributes
+        glGenBuffers(1, &visibleBufferID);
+        glBindBuffer(GL_ARRAY_BUFFER, visibleBufferID);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GpuInstance), NULL, GL_DYNAMIC_COPY);
+        memoryTracker.trackBuffer("gpu-driven", visibleBufferID, capacity * sizeof(GpuInstance));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(GpuInstance), (void*)offsetof(GpuInstance, position));
+        glVertexAttribDivisor(3, 1);
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(GpuInstance), (void*)offsetof(GpuInstance, scale));
+        glVertexAttribDivisor(4, 1);
+
+        glBindVertexArray(0);
+
+        glGenBuffers(1, &commandBufferID);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBufferID);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+        memoryTracker.trackBuffer("gpu-driven", commandBufferID, sizeof(DrawElementsIndirectCommand));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        glGenBuffers(READBACK_LATENCY, readbackBufferIDs);
+        for (GLuint buffer : readbackBufferIDs) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferData(GL_COPY_WRITE_BUFFER, sizeof(GLuint), NULL, GL_STREAM_READ);
+            memoryTracker.trackBuffer("gpu-driven", buffer, sizeof(GLuint));
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        cullProgramID = LoadComputeShaderFromFile("../assignment/shaders/cull.comp");
+        drawProgramID = LoadShadersFromFile("../assignment/shaders/city.vert",
+                                            "../assignment/shaders/city.frag");
+        if (cullProgramID == 0 || drawProgramID == 0) {
+            std::cerr << "Failed to load GPU-driven city shaders." << std::endl;
+            cleanup();
+            return false;
+        }
+
+        SetupClusteredLightingProgram(drawProgramID);
+
+        frustumPlanesID = glGetUniformLocation(cullProgramID, "frustumPlanes");
+        instanceCountID = glGetUniformLocation(cullProgramID, "instanceCount");
+        vpMatrixID = glGetUniformLocation(drawProgramID, "VP");
+        lightPositionID = glGetUniformLocation(drawProgramID, "lightPosition");
+        lightIntensityID = glGetUniformLocation(drawProgramID, "lightIntensity");
+        facadeSamplerID = glGetUniformLocation(drawProgramID, "facadeSampler");
+
+        GLenum errorCode = glGetError();
+        if (errorCode != 0) {
+            std::cout << "GPU-driven city error initializing: " << errorCode << std::endl;
+        }
+
+        available = true;
+        return true;
+    }
+
+    void uploadInstances(const std::vector<GpuInstance>& instances) {
+        instanceCount = static_cast<int>(instances.size());
+        if (instanceCount > capacity) {
+            std::cout << "GPU-driven city: " << instanceCount << " instances exceed capacity " << capacity << std::endl;
+            instanceCount = capacity;
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBufferID);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, instanceCount * sizeof(GpuInstance), instances.data());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    void render(const glm::mat4& vp) {
+        collectVisibleCount();
+        if (instanceCount == 0) {
+            visibleCount = 0;
+            return;
+        }
+
+        // Reset the draw command, the cull pass counts instances back into it
+        DrawElementsIndirectCommand command = {36, 0, 0, 0, 0};
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBufferID);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), &command);
+
+        Frustum frustum(vp);
+        glUseProgram(cullProgramID);
+        glUniform4fv(frustumPlanesID, 6, &frustum.planes[0][0]);
+        glUniform1ui(instanceCountID, static_cast<GLuint>(instanceCount));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instanceBufferID);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visibleBufferID);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBufferID);
+        glDispatchCompute((instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+        copyVisibleCount();
+
+        glUseProgram(drawProgramID);
+        glUniformMatrix4fv(vpMatrixID, 1, GL_FALSE, &vp[0][0]);
+        glUniform3fv(lightPositionID, 1, &lightPosition[0]);
+        glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, GetFacadeTextureArray());
+        glUniform1i(facadeSamplerID, 0);
+
+        glBindVertexArray(vertexArrayID);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 1, 0);
+        glBindVertexArray(0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    void cleanup() {
+        for (GLuint buffer : {vertexBufferID, uvBufferID, normalBufferID, indexBufferID,
+                              instanceBufferID, visibleBufferID, commandBufferID}) {
+            memoryTracker.releaseBuffer(buffer);
+        }
+        for (int i = 0; i < READBACK_LATENCY; i++) {
+            if (readbackFences[i]) glDeleteSync(readbackFences[i]);
+            readbackFences[i] = 0;
+            memoryTracker.releaseBuffer(readbackBufferIDs[i]);
+        }
+        glDeleteBuffers(READBACK_LATENCY, readbackBufferIDs);
+        visibleCount = -1;
+        glDeleteBuffers(1, &vertexBufferID);
+        glDeleteBuffers(1, &uvBufferID);
+        glDeleteBuffers(1, &normalBufferID);
+        glDeleteBuffers(1, &indexBufferID);
+        glDeleteBuffers(1, &instanceBufferID);
+        glDeleteBuffers(1, &visibleBufferID);
+        glDeleteBuffers(1, &commandBufferID);
+        glDeleteVertexArrays(1, &vertexArrayID);
+        glDeleteProgram(cullProgramID);
+        glDeleteProgram(drawProgramID);
+        available = false;
+    }
+
+private:
+    // Copies this frame's surviving count into the next ring slot, unless that
+    // slot is still waiting on the GPU
+    void copyVisibleCount() {
+        int slot = readbackFrame % READBACK_LATENCY;
+        if (readbackFences[slot]) return;
+        glBindBuffer(GL_COPY_READ_BUFFER, commandBufferID);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBufferIDs[slot]);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            offsetof(DrawElementsIndirectCommand, instanceCount), 0, sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        readbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readbackFrame++;
+    }
+
+    // Reads every slot whose copy has finished, oldest first so the newest wins
+    void collectVisibleCount() {
+        for (int i = 0; i < READBACK_LATENCY; i++) {
+            int slot = (readbackFrame + i) % READBACK_LATENCY;
+            if (!readbackFences[slot]) continue;
+
+            GLenum status = glClientWaitSync(readbackFences[slot], 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+
+            GLuint count = 0;
+            glBindBuffer(GL_COPY_READ_BUFFER, readbackBufferIDs[slot]);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint), &count);
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glDeleteSync(readbackFences[slot]);
+            readbackFences[slot] = 0;
+            visibleCount = static_cast<int>(count);
+        }
+    }
+};
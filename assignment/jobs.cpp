@@ -0,0 +1,254 @@
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <random>
+
+// Counts outstanding jobs. A counter can be waited on with JobSystem::wait and
+// used as a dependency with JobSystem::runAfter. Don't reuse a counter while
+// jobs are still queued behind it.
+struct JobCounter {
+    std::atomic<int> pending{0};
+
+    bool done() const {
+        return pending.load(std::memory_order_acquire) == 0;
+    }
+
+private:
+    friend class JobSystem;
+    std::mutex mutex;
+    std::vector<std::function<void()>> continuations;
+    std::vector<JobCounter *> continuationCounters;
+};
+
+// Work-stealing scheduler. Every worker owns a deque: it pushes and pops its
+// own jobs at the back (newest first, cache-warm) and steals from the front of
+// other workers' deques when it runs dry. Jobs submitted from outside a worker
+// go to an extra deque that workers steal from. Threads that wait on a counter
+// run queued jobs in the meantime instead of blocking, so the main thread can
+// help with a frame's work and jobs can safely wait on their own children.
+class JobSystem {
+public:
+    explicit JobSystem(unsigned int workerCount = defaultWorkerCount())
+            : queuedJobs(0), stopping(false)
+    {
+        // One deque per worker plus one for jobs submitted from other threads.
+        // With no workers at all, jobs only run inside wait() on the caller.
+        for (unsigned int i = 0; i <= workerCount; i++) {
+            queues.emplace_back(new Queue());
+        }
+        for (unsigned int i = 0; i < workerCount; i++) {
+            workers.emplace_back([this, i] { workerLoop(static_cast<int>(i)); });
+        }
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers) {
+            worker.join();
+        }
+    }
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // One worker per hardware thread, leaving one for the render thread
+    static unsigned int defaultWorkerCount() {
+        unsigned int hardwareThreads = std::thread::hardware_concurrency();
+        return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    unsigned int workerCount() const {
+        return static_cast<unsigned int>(workers.size());
+    }
+
+    void run(std::function<void()> job, JobCounter *counter = nullptr) {
+        if (counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+        push(Job{std::move(job), counter});
+    }
+
+    // Queues job once every job counted by dependency has finished
+    void runAfter(JobCounter &dependency, std::function<void()> job, JobCounter *counter = nullptr) {
+        if (counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+        std::unique_lock<std::mutex> lock(dependency.mutex);
+        if (dependency.done()) {
+            lock.unlock();
+            push(Job{std::move(job), counter});
+            return;
+        }
+        dependency.continuations.push_back(std::move(job));
+        dependency.continuationCounters.push_back(counter);
+    }
+
+    // Splits [0, count) into ranges of at most grain items. When everything
+    // fits in one range it runs inline on the calling thread.
+    template<typename Function>
+    void parallelFor(int count, int grain, Function function, JobCounter &counter) {
+        if (count <= 0) return;
+        if (grain < 1) grain = 1;
+        if (count <= grain) {
+            function(0, count);
+            return;
+        }
+        for (int begin = 0; begin < count; begin += grain) {
+            int end = begin + grain < count ? begin + grain : count;
+            run([function, begin, end] { function(begin, end); }, &counter);
+        }
+    }
+
+    // Runs queued jobs on the calling thread until counter reaches zero
+    void wait(JobCounter &counter) {
+        int self = currentQueue();
+        while (!counter.done()) {
+            Job job;
+            if (tryTake(self, job)) {
+                execute(job);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        // The job that finished the counter may still hold its mutex, don't let
+        // the caller destroy the counter before it lets go
+        std::lock_guard<std::mutex> lock(counter.mutex);
+    }
+
+    unsigned long jobsExecuted() const {
+        return executed.load(std::memory_order_relaxed);
+    }
+
+    unsigned long jobsStolen() const {
+        return stolen.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Job {
+        std::function<void()> function;
+        JobCounter *counter;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queuedJobs;
+    std::atomic<unsigned long> executed{0}, stolen{0};
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    static int &workerIndex() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    // Workers use their own deque, every other thread shares the last one
+    int currentQueue() const {
+        int index = workerIndex();
+        return index >= 0 ? index : static_cast<int>(queues.size()) - 1;
+    }
+
+    void push(Job job) {
+        Queue &queue = *queues[currentQueue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(std::move(job));
+        }
+        queuedJobs.fetch_add(1, std::memory_order_release);
+
+        // Taking the sleep mutex orders this with a worker checking queuedJobs
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wake.notify_one();
+    }
+
+    bool tryTake(int self, Job &job) {
+        if (queuedJobs.load(std::memory_order_acquire) == 0) return false;
+
+        // Own deque first, newest job
+        {
+            Queue &queue = *queues[self];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.jobs.empty()) {
+                job = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+                queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        // Then steal the oldest job from someone else, starting at a random victim
+        static thread_local std::minstd_rand victimRandom(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        int queueCount = static_cast<int>(queues.size());
+        int start = static_cast<int>(victimRandom() % queueCount);
+        for (int i = 0; i < queueCount; i++) {
+            int victim = (start + i) % queueCount;
+            if (victim == self) continue;
+            Queue &queue = *queues[victim];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.jobs.empty()) {
+                job = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+                queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+                stolen.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void execute(Job &job) {
+        job.function();
+        executed.fetch_add(1, std::memory_order_relaxed);
+        if (job.counter) finish(*job.counter);
+    }
+
+    void finish(JobCounter &counter) {
+        // Jobs that are not the last one just decrement. The last one does it
+        // under the counter's mutex so the counter outlives the release below.
+        int value = counter.pending.load(std::memory_order_relaxed);
+        while (value > 1) {
+            if (counter.pending.compare_exchange_weak(value, value - 1, std::memory_order_acq_rel)) return;
+        }
+
+        std::vector<std::function<void()>> ready;
+        std::vector<JobCounter *> readyCounters;
+        {
+            std::lock_guard<std::mutex> lock(counter.mutex);
+            if (counter.pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+            // Last job of the counter, release anything queued behind it
+            ready.swap(counter.continuations);
+            readyCounters.swap(counter.continuationCounters);
+        }
+        for (size_t i = 0; i < ready.size(); i++) {
+            push(Job{std::move(ready[i]), readyCounters[i]});
+        }
+    }
+
+    void workerLoop(int index) {
+        workerIndex() = index;
+        for (;;) {
+            Job job;
+            if (tryTake(index, job)) {
+                execute(job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || queuedJobs.load(std::memory_order_acquire) > 0; });
+            if (stopping && queuedJobs.load(std::memory_order_acquire) == 0) return;
+        }
+    }
+};
@@ -0,0 +1,344 @@
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LIGHTBIN_SSE2 1
+#endif
+
+// Layout shared with the clusterLights texture buffer, two texels per light
+struct PointLight {
+    glm::vec4 positionRadius;   // xyz = world position, w = radius of influence
+    glm::vec4 color;            // rgb = intensity, w unused
+};
+
+struct LightBinStats {
+    int lights = 0;
+    int lightsVisible = 0;      // Lights overlapping at least one cluster
+    int indices = 0;            // Light references over all clusters
+    int maxPerCluster = 0;
+    double transformMs = 0.0;
+    double binMs = 0.0;
+};
+
+// Bins point lights into a view-space froxel grid: TILES_X x TILES_Y screen
+// tiles times SLICES depth slices spaced exponentially between the near and
+// far planes. The output is, per cluster, an (offset, count) pair into one
+// flat light index list, which is what the fragment shaders consume.
+//
+// Lights are first transformed to view space and given a conservative
+// cluster range, four at a time with SSE2 where available. Each depth slice
+// is then filled by its own job, so slices need no synchronisation, and the
+// slices are concatenated afterwards.
+struct LightBinner {
+    static const int TILES_X = 16;
+    static const int TILES_Y = 9;
+    static const int SLICES = 24;
+    static const int CLUSTERS_PER_SLICE = TILES_X * TILES_Y;
+    static const int CLUSTER_COUNT = CLUSTERS_PER_SLICE * SLICES;
+    static const int TRANSFORM_BATCH = 256;     // Lights per transform job
+
+    bool useSimd = true;
+
+    // Output
+    std::vector<uint32_t> clusters;     // Two per cluster: offset, count
+    std::vector<uint32_t> indices;
+    float sliceScale = 0.0f, sliceBias = 0.0f;  // slice = log(depth) * scale + bias
+    LightBinStats stats;
+
+    LightBinner() : clusters(2 * CLUSTER_COUNT, 0), sliceIndices(SLICES), sliceCounts(SLICES) {}
+
+    // jobs may be null to bin on the calling thread
+    void bin(const std::vector<PointLight>& lights, const glm::mat4& view, float fovY, float aspect,
+             float zNear, float zFar, JobSystem* jobs) {
+        auto start = std::chrono::steady_clock::now();
+        int count = static_cast<int>(lights.size());
+        int padded = (count + 3) & ~3;
+        for (std::vector<int32_t>* range : {&x0, &x1, &y0, &y1, &z0, &z1}) {
+            range->assign(padded, 0);
+        }
+        // Padding lights get an empty slice range and are never binned
+        for (int i = count; i < padded; i++) {
+            z0[i] = 1;
+            z1[i] = 0;
+        }
+
+        float logRange = logf(zFar / zNear);
+        sliceScale = SLICES / logRange;
+        sliceBias = -SLICES * logf(zNear) / logRange;
+
+        Projection projection;
+        projection.view = view;
+        projection.tanHalfY = tanf(fovY * 0.5f);
+        projection.tanHalfX = projection.tanHalfY * aspect;
+        projection.zNear = zNear;
+        projection.zFar = zFar;
+
+        const PointLight* data = lights.data();
+        if (jobs && count > TRANSFORM_BATCH) {
+            JobCounter transformed;
+            jobs->parallelFor(padded / 4, TRANSFORM_BATCH / 4, [this, data, count, &projection](int begin, int end) {
+                computeRanges(data, count, projection, begin * 4, end * 4);
+            }, transformed);
+            jobs->wait(transformed);
+        } else {
+            computeRanges(data, count, projection, 0, padded);
+        }
+        auto binStart = std::chrono::steady_clock::now();
+        stats.transformMs = elapsedMs(start, binStart);
+
+        if (jobs) {
+            JobCounter binned;
+            jobs->parallelFor(SLICES, 1, [this, padded](int begin, int end) {
+                for (int slice = begin; slice < end; slice++) binSlice(slice, padded);
+            }, binned);
+            jobs->wait(binned);
+        } else {
+            for (int slice = 0; slice < SLICES; slice++) binSlice(slice, padded);
+        }
+
+        // Concatenate the slices
+        uint32_t total = 0;
+        stats.maxPerCluster = 0;
+        for (int slice = 0; slice < SLICES; slice++) {
+            const std::vector<uint32_t>& counts = sliceCounts[slice];
+            uint32_t offset = total;
+            for (int c = 0; c < CLUSTERS_PER_SLICE; c++) {
+                int cluster = slice * CLUSTERS_PER_SLICE + c;
+                clusters[2 * cluster] = offset;
+                clusters[2 * cluster + 1] = counts[c];
+                offset += counts[c];
+                stats.maxPerCluster = glm::max(stats.maxPerCluster, static_cast<int>(counts[c]));
+            }
+            total = offset;
+        }
+        indices.resize(total);
+        for (int slice = 0; slice < SLICES; slice++) {
+            const std::vector<uint32_t>& local = sliceIndices[slice];
+            if (!local.empty()) {
+                memcpy(&indices[clusters[2 * slice * CLUSTERS_PER_SLICE]], local.data(), local.size() * sizeof(uint32_t));
+            }
+        }
+
+        stats.lights = count;
+        stats.lightsVisible = 0;
+        for (int i = 0; i < count; i++) stats.lightsVisible += z0[i] <= z1[i];
+        stats.indices = static_cast<int>(total);
+        stats.binMs = elapsedMs(binStart, std::chrono::steady_clock::now());
+    }
+
+private:
+    struct Projection {
+        glm::mat4 view;
+        float tanHalfX, tanHalfY;
+        float zNear, zFar;
+    };
+
+    // Conservative cluster range per light, inclusive; z0 > z1 means culled
+    std::vector<int32_t> x0, x1, y0, y1, z0, z1;
+    std::vector<std::vector<uint32_t>> sliceIndices;
+    std::vector<std::vector<uint32_t>> sliceCounts;
+
+    static double elapsedMs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+        return std::chrono::duration<double, std::milli>(to - from).count();
+    }
+
+    void computeRanges(const PointLight* lights, int count, const Projection& p, int begin, int end) {
+#ifdef LIGHTBIN_SSE2
+        if (useSimd) {
+            computeRangesSse2(lights, count, p, begin, end);
+            return;
+        }
+#endif
+        for (int i = begin; i < glm::min(end, count); i++) {
+            glm::vec4 v = p.view * glm::vec4(glm::vec3(lights[i].positionRadius), 1.0f);
+            computeRange(i, v.x, v.y, -v.z, lights[i].positionRadius.w, p);
+        }
+    }
+
+    // Screen tiles come from the sphere's bounding box projected at whichever
+    // depth gives the larger extent on each side, slices from its depth range.
+    // The SSE2 version below computes exactly the same values.
+    void computeRange(int i, float x, float y, float depth, float radius, const Projection& p) {
+        float nearDepth = glm::max(depth - radius, p.zNear);
+        float farDepth = glm::max(depth + radius, p.zNear);
+        if (depth + radius < p.zNear || depth - radius > p.zFar) {
+            z0[i] = 1;
+            z1[i] = 0;
+            return;
+        }
+
+        float xLo = (x - radius) / ((x - radius <= 0.0f ? nearDepth : farDepth) * p.tanHalfX);
+        float xHi = (x + radius) / ((x + radius >= 0.0f ? nearDepth : farDepth) * p.tanHalfX);
+        float yLo = (y - radius) / ((y - radius <= 0.0f ? nearDepth : farDepth) * p.tanHalfY);
+        float yHi = (y + radius) / ((y + radius >= 0.0f ? nearDepth : farDepth) * p.tanHalfY);
+
+        float txLo = (xLo * 0.5f + 0.5f) * TILES_X, txHi = (xHi * 0.5f + 0.5f) * TILES_X;
+        float tyLo = (yLo * 0.5f + 0.5f) * TILES_Y, tyHi = (yHi * 0.5f + 0.5f) * TILES_Y;
+        if (txHi < 0.0f || txLo > TILES_X || tyHi < 0.0f || tyLo > TILES_Y) {
+            z0[i] = 1;
+            z1[i] = 0;
+            return;
+        }
+
+        x0[i] = static_cast<int32_t>(glm::clamp(txLo, 0.0f, float(TILES_X - 1)));
+        x1[i] = static_cast<int32_t>(glm::clamp(txHi, 0.0f, float(TILES_X - 1)));
+        y0[i] = static_cast<int32_t>(glm::clamp(tyLo, 0.0f, float(TILES_Y - 1)));
+        y1[i] = static_cast<int32_t>(glm::clamp(tyHi, 0.0f, float(TILES_Y - 1)));
+        float sLo = logf(nearDepth) * sliceScale + sliceBias;
+        float sHi = logf(glm::min(farDepth, p.zFar)) * sliceScale + sliceBias;
+        z0[i] = static_cast<int32_t>(glm::clamp(sLo, 0.0f, float(SLICES - 1)));
+        z1[i] = static_cast<int32_t>(glm::clamp(sHi, 0.0f, float(SLICES - 1)));
+    }
+
+#ifdef LIGHTBIN_SSE2
+    // Four lights per iteration for the view transform and the tile bounds.
+    // The logarithms for the slice range are taken per light.
+    void computeRangesSse2(const PointLight* lights, int count, const Projection& p, int begin, int end) {
+        const glm::mat4& m = p.view;
+        const __m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f);
+        const __m128 zNear = _mm_set1_ps(p.zNear), zFar = _mm_set1_ps(p.zFar);
+        const __m128 tilesX = _mm_set1_ps(float(TILES_X)), tilesY = _mm_set1_ps(float(TILES_Y));
+        const __m128 maxX = _mm_set1_ps(float(TILES_X - 1)), maxY = _mm_set1_ps(float(TILES_Y - 1));
+        const __m128 tanX = _mm_set1_ps(p.tanHalfX), tanY = _mm_set1_ps(p.tanHalfY);
+
+        for (int i = begin; i < end; i += 4) {
+            alignas(16) float px[4] = {0}, py[4] = {0}, pz[4] = {0}, pr[4] = {0};
+            for (int k = 0; k < 4 && i + k < count; k++) {
+                px[k] = lights[i + k].positionRadius.x;
+                py[k] = lights[i + k].positionRadius.y;
+                pz[k] = lights[i + k].positionRadius.z;
+                pr[k] = lights[i + k].positionRadius.w;
+            }
+            __m128 wx = _mm_load_ps(px), wy = _mm_load_ps(py), wz = _mm_load_ps(pz), radius = _mm_load_ps(pr);
+
+            // View transform, summed in the same order as glm's mat4 * vec4 so both
+            // paths round identically
+            __m128 x = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, _mm_set1_ps(m[0][0])), _mm_mul_ps(wy, _mm_set1_ps(m[1][0]))),
+                                             _mm_mul_ps(wz, _mm_set1_ps(m[2][0]))), _mm_set1_ps(m[3][0]));
+            __m128 y = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, _mm_set1_ps(m[0][1])), _mm_mul_ps(wy, _mm_set1_ps(m[1][1]))),
+                                             _mm_mul_ps(wz, _mm_set1_ps(m[2][1]))), _mm_set1_ps(m[3][1]));
+            __m128 z = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(wx, _mm_set1_ps(m[0][2])), _mm_mul_ps(wy, _mm_set1_ps(m[1][2]))),
+                                             _mm_mul_ps(wz, _mm_set1_ps(m[2][2]))), _mm_set1_ps(m[3][2]));
+            __m128 depth = _mm_sub_ps(zero, z);
+
+            __m128 nearDepth = _mm_max_ps(_mm_sub_ps(depth, radius), zNear);
+            __m128 farDepth = _mm_max_ps(_mm_add_ps(depth, radius), zNear);
+            __m128 culled = _mm_or_ps(_mm_cmplt_ps(_mm_add_ps(depth, radius), zNear),
+                                      _mm_cmpgt_ps(_mm_sub_ps(depth, radius), zFar));
+
+            __m128 xLo = bound(_mm_sub_ps(x, radius), nearDepth, farDepth, tanX, true);
+            __m128 xHi = bound(_mm_add_ps(x, radius), nearDepth, farDepth, tanX, false);
+            __m128 yLo = bound(_mm_sub_ps(y, radius), nearDepth, farDepth, tanY, true);
+            __m128 yHi = bound(_mm_add_ps(y, radius), nearDepth, farDepth, tanY, false);
+
+            __m128 txLo = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(xLo, half), half), tilesX);
+            __m128 txHi = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(xHi, half), half), tilesX);
+            __m128 tyLo = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(yLo, half), half), tilesY);
+            __m128 tyHi = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(yHi, half), half), tilesY);
+            culled = _mm_or_ps(culled, _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(txHi, zero), _mm_cmpgt_ps(txLo, tilesX)),
+                                                 _mm_or_ps(_mm_cmplt_ps(tyHi, zero), _mm_cmpgt_ps(tyLo, tilesY))));
+
+            alignas(16) int32_t ix0[4], ix1[4], iy0[4], iy1[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(ix0), _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(txLo, zero), maxX)));
+            _mm_store_si128(reinterpret_cast<__m128i*>(ix1), _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(txHi, zero), maxX)));
+            _mm_store_si128(reinterpret_cast<__m128i*>(iy0), _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(tyLo, zero), maxY)));
+            _mm_store_si128(reinterpret_cast<__m128i*>(iy1), _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(tyHi, zero), maxY)));
+            alignas(16) float nd[4], fd[4];
+            _mm_store_ps(nd, nearDepth);
+            _mm_store_ps(fd, _mm_min_ps(farDepth, zFar));
+            int culledMask = _mm_movemask_ps(culled);
+
+            for (int k = 0; k < 4 && i + k < count; k++) {
+                int light = i + k;
+                if (culledMask & (1 << k)) {
+                    z0[light] = 1;
+                    z1[light] = 0;
+                    continue;
+                }
+                x0[light] = ix0[k];
+                x1[light] = ix1[k];
+                y0[light] = iy0[k];
+                y1[light] = iy1[k];
+                z0[light] = static_cast<int32_t>(glm::clamp(logf(nd[k]) * sliceScale + sliceBias, 0.0f, float(SLICES - 1)));
+                z1[light] = static_cast<int32_t>(glm::clamp(logf(fd[k]) * sliceScale + sliceBias, 0.0f, float(SLICES - 1)));
+            }
+        }
+    }
+
+    // NDC bound of one box edge: divided by the near depth when that widens
+    // the range on this side, by the far depth otherwise
+    static __m128 bound(__m128 edge, __m128 nearDepth, __m128 farDepth, __m128 tanHalf, bool lower) {
+        __m128 useNear = lower ? _mm_cmple_ps(edge, _mm_setzero_ps()) : _mm_cmpge_ps(edge, _mm_setzero_ps());
+        __m128 depth = _mm_or_ps(_mm_and_ps(useNear, nearDepth), _mm_andnot_ps(useNear, farDepth));
+        return _mm_div_ps(edge, _mm_mul_ps(depth, tanHalf));
+    }
+#endif
+
+    // Counts then fills the clusters of one depth slice. Lights outside the
+    // slice are skipped four at a time with SSE2 where available.
+    void binSlice(int slice, int padded) {
+        std::vector<uint32_t>& counts = sliceCounts[slice];
+        std::vector<uint32_t>& local = sliceIndices[slice];
+        counts.assign(CLUSTERS_PER_SLICE, 0);
+        local.clear();
+
+        // Lights touching this slice, gathered once for both passes
+        std::vector<uint32_t> inSlice;
+        inSlice.reserve(64);
+#ifdef LIGHTBIN_SSE2
+        if (useSimd) {
+            const __m128i s = _mm_set1_epi32(slice);
+            for (int i = 0; i < padded; i += 4) {
+                __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&z0[i]));
+                __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&z1[i]));
+                __m128i outside = _mm_or_si128(_mm_cmpgt_epi32(lo, s), _mm_cmplt_epi32(hi, s));
+                int mask = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF;
+                while (mask) {
+                    int k = ctz(mask);
+                    inSlice.push_back(static_cast<uint32_t>(i + k));
+                    mask &= mask - 1;
+                }
+            }
+        } else
+#endif
+        {
+            for (int i = 0; i < padded; i++) {
+                if (z0[i] <= slice && slice <= z1[i]) inSlice.push_back(static_cast<uint32_t>(i));
+            }
+        }
+
+        for (uint32_t light : inSlice) {
+            for (int y = y0[light]; y <= y1[light]; y++) {
+                for (int x = x0[light]; x <= x1[light]; x++) counts[y * TILES_X + x]++;
+            }
+        }
+
+        std::vector<uint32_t> cursor(CLUSTERS_PER_SLICE);
+        uint32_t total = 0;
+        for (int c = 0; c < CLUSTERS_PER_SLICE; c++) {
+            cursor[c] = total;
+            total += counts[c];
+        }
+        local.resize(total);
+        for (uint32_t light : inSlice) {
+            for (int y = y0[light]; y <= y1[light]; y++) {
+                for (int x = x0[light]; x <= x1[light]; x++) local[cursor[y * TILES_X + x]++] = light;
+            }
+        }
+    }
+
+    static int ctz(int mask) {
+        int k = 0;
+        while (!(mask & 1)) {
+            mask >>= 1;
+            k++;
+        }
+        return k;
+    }
+};
@@ -0,0 +1,200 @@
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <map>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+// Approximate memory accounting per subsystem. GL buffers, textures and
+// renderbuffers are registered where they are created with an owner tag and
+// the size handed to the driver, and unregistered where they are deleted.
+// CPU-side data (chunks, mesh copies) is reported as plain counters. Sizes are
+// what we asked for; drivers may pad or keep extra copies.
+struct MemoryTracker {
+    enum Resource { BUFFER, TEXTURE, RENDERBUFFER };
+
+    struct Totals {
+        size_t current = 0;
+        size_t peak = 0;
+        unsigned long allocations = 0;
+        unsigned long frees = 0;
+        double lifetimeSeconds = 0.0;   // Summed over freed allocations
+    };
+
+    MemoryTracker() : start(std::chrono::steady_clock::now()) {}
+
+    void trackBuffer(const char *tag, GLuint id, size_t bytes) { track(BUFFER, tag, id, bytes); }
+    void trackTexture(const char *tag, GLuint id, size_t bytes) { track(TEXTURE, tag, id, bytes); }
+    void trackRenderbuffer(const char *tag, GLuint id, size_t bytes) { track(RENDERBUFFER, tag, id, bytes); }
+
+    void releaseBuffer(GLuint id) { release(BUFFER, id); }
+    void releaseTexture(GLuint id) { release(TEXTURE, id); }
+    void releaseRenderbuffer(GLuint id) { release(RENDERBUFFER, id); }
+
+    // CPU counters, safe to call from jobs
+    void addCpu(const char *tag, long long delta) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Totals &totals = cpuTotals[tag];
+        if (delta >= 0) {
+            totals.current += static_cast<size_t>(delta);
+            totals.allocations++;
+        } else {
+            totals.current -= glm::min(totals.current, static_cast<size_t>(-delta));
+            totals.frees++;
+        }
+        totals.peak = glm::max(totals.peak, totals.current);
+    }
+
+    void setCpu(const char *tag, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Totals &totals = cpuTotals[tag];
+        totals.current = bytes;
+        totals.peak = glm::max(totals.peak, bytes);
+    }
+
+    size_t gpuBytes() const { return gpuCurrent; }
+    size_t gpuPeakBytes() const { return gpuPeak; }
+
+    size_t cpuBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t total = 0;
+        for (const auto &entry : cpuTotals) total += entry.second.current;
+        return total;
+    }
+
+    void printReport(std::ostream &out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << std::fixed << std::setprecision(2);
+        out << "GPU memory: " << mb(gpuCurrent) << " MB (peak " << mb(gpuPeak) << " MB, "
+            << live.size() << " live objects)" << std::endl;
+        for (const auto &entry : gpuTotals) {
+            printTotals(out, entry.first, entry.second);
+        }
+        out << "CPU memory:" << std::endl;
+        for (const auto &entry : cpuTotals) {
+            printTotals(out, entry.first, entry.second);
+        }
+    }
+
+    // Single JSON object, e.g. for a benchmark report line
+    void writeJson(std::ostream &out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "{\"gpu_bytes\":" << gpuCurrent << ",\"gpu_peak_bytes\":" << gpuPeak
+            << ",\"live_objects\":" << live.size() << ",\"gpu\":";
+        writeTotalsJson(out, gpuTotals);
+        out << ",\"cpu\":";
+        writeTotalsJson(out, cpuTotals);
+        out << "}";
+    }
+
+    // Call after every subsystem has cleaned up. Returns the number of GL
+    // objects still registered.
+    size_t reportLeaks(std::ostream &out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        const char *resourceNames[] = {"buffer", "texture", "renderbuffer"};
+        for (const auto &entry : live) {
+            out << "Leaked " << resourceNames[entry.first.first] << " " << entry.first.second
+                << " (" << entry.second.tag << ", " << entry.second.bytes << " bytes, alive "
+                << secondsSinceStart() - entry.second.createdAt << " s)" << std::endl;
+        }
+        if (live.empty()) {
+            out << "No leaked GL objects" << std::endl;
+        }
+        return live.size();
+    }
+
+private:
+    struct Allocation {
+        std::string tag;
+        size_t bytes;
+        double createdAt;
+    };
+
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point start;
+    std::map<std::pair<int, GLuint>, Allocation> live;
+    std::map<std::string, Totals> gpuTotals;
+    std::map<std::string, Totals> cpuTotals;
+    size_t gpuCurrent = 0;
+    size_t gpuPeak = 0;
+
+    double secondsSinceStart() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static double mb(size_t bytes) {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    // Re-specifying an object's storage (glBufferData on a live buffer)
+    // replaces its previous size
+    void track(Resource resource, const char *tag, GLuint id, size_t bytes) {
+        if (id == 0) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto key = std::make_pair(static_cast<int>(resource), id);
+        auto it = live.find(key);
+        if (it != live.end()) {
+            gpuTotals[it->second.tag].current -= it->second.bytes;
+            gpuCurrent -= it->second.bytes;
+            it->second.tag = tag;
+            it->second.bytes = bytes;
+        } else {
+            live[key] = Allocation{tag, bytes, secondsSinceStart()};
+            gpuTotals[tag].allocations++;
+        }
+
+        Totals &totals = gpuTotals[tag];
+        totals.current += bytes;
+        totals.peak = glm::max(totals.peak, totals.current);
+        gpuCurrent += bytes;
+        gpuPeak = glm::max(gpuPeak, gpuCurrent);
+    }
+
+    void release(Resource resource, GLuint id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = live.find(std::make_pair(static_cast<int>(resource), id));
+        if (it == live.end()) return;
+
+        Totals &totals = gpuTotals[it->second.tag];
+        totals.current -= it->second.bytes;
+        totals.frees++;
+        totals.lifetimeSeconds += secondsSinceStart() - it->second.createdAt;
+        gpuCurrent -= it->second.bytes;
+        live.erase(it);
+    }
+
+    static void printTotals(std::ostream &out, const std::string &tag, const Totals &totals) {
+        out << "  " << std::left << std::setw(16) << tag << std::right
+            << std::setw(10) << mb(totals.current) << " MB, peak " << mb(totals.peak) << " MB, "
+            << totals.allocations << " allocs, " << totals.frees << " frees";
+        if (totals.frees > 0) {
+            out << ", avg lifetime " << totals.lifetimeSeconds / totals.frees << " s";
+        }
+        out << std::endl;
+    }
+
+    static void writeTotalsJson(std::ostream &out, const std::map<std::string, Totals> &totals) {
+        out << "{";
+        bool first = true;
+        for (const auto &entry : totals) {
+            if (!first) out << ",";
+            first = false;
+            out << "\"" << entry.first << "\":{\"bytes\":" << entry.second.current
+                << ",\"peak_bytes\":" << entry.second.peak
+                << ",\"allocs\":" << entry.second.allocations
+                << ",\"frees\":" << entry.second.frees << "}";
+        }
+        out << "}";
+    }
+};
+
+static MemoryTracker memoryTracker;
+
+// Size of an uncompressed 2D texture, a full mip chain adds a third
+inline size_t TextureBytes(int width, int height, int bytesPerTexel, bool mipmapped) {
+    size_t bytes = static_cast<size_t>(width) * height * bytesPerTexel;
+    return mipmapped ? bytes * 4 / 3 : bytes;
+}
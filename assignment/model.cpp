@@ -7,14 +7,19 @@
 #include <vector>
 #include <iostream>
 #include <math.h>
+#include <cfloat>
+#include <stdint.h>
 #include <fstream>
 #include <sstream>
+#include <chrono>
 
 #include <render/shader.h>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
 
 #include <render/shader.h>
 
@@ -22,229 +27,704 @@
 
 using namespace std;
 
-class Shader
+// An asset read straight out of the pack mapping. Assimp still copies through
+// Read(), but there is no file to open and nothing to read from disk twice.
+class PackIOStream : public Assimp::IOStream
 {
 public:
-    unsigned int ID;
+    explicit PackIOStream(AssetView &&view) : asset(std::move(view)) {}
 
-    Shader(const char* vertexPath, const char* fragmentPath)
+    size_t Read(void *buffer, size_t size, size_t count) override
     {
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try
-        {
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            vShaderFile.close();
-            fShaderFile.close();
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
+        if (size == 0) return 0;
+        count = std::min(count, (asset.size - position) / size);
+        memcpy(buffer, asset.data + position, size * count);
+        position += size * count;
+        return count;
+    }
 
-        unsigned int vertex, fragment;
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
+    size_t Write(const void *, size_t, size_t) override { return 0; }
 
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+    aiReturn Seek(size_t offset, aiOrigin origin) override
+    {
+        size_t base = origin == aiOrigin_SET ? 0 : origin == aiOrigin_CUR ? position : asset.size;
+        if (base + offset > asset.size) return aiReturn_FAILURE;
+        position = base + offset;
+        return aiReturn_SUCCESS;
+    }
 
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
+    size_t Tell() const override { return position; }
+    size_t FileSize() const override { return asset.size; }
+    void Flush() override {}
 
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+private:
+    AssetView asset;
+    size_t position = 0;
+};
+
+// Serves model files, and the material libraries they reference, from the
+// asset pack; anything not in it is opened from disk as usual
+class PackIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+    bool Exists(const char *file) const override
+    {
+        return assetFiles.inPack(file) || DefaultIOSystem::Exists(file);
+    }
+
+    Assimp::IOStream *Open(const char *file, const char *mode = "rb") override
+    {
+        AssetView view;
+        if (!strchr(mode, 'w') && assetFiles.inPack(file) && assetFiles.view(file, view))
+            return new PackIOStream(std::move(view));
+        return DefaultIOSystem::Open(file, mode);
+    }
+};
+
+class Shader
+{
+public:
+    unsigned int ID;
+
+    // Compiled through LoadShadersFromFile so the program binary cache applies
+    Shader(const char* vertexPath, const char* fragmentPath)
+    {
+        ID = LoadShadersFromFile(vertexPath, fragmentPath);
     }
 
     void use() { glUseProgram(ID); }
+    void setInt(const std::string &name, int value) const {
+        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    }
     void setVec3(const std::string &name, glm::vec3 value) const {
         glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
     }
     void setMat4(const std::string &name, glm::mat4 value) {
         glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &value[0][0]);
     }
+};
 
-private:
-    void checkCompileErrors(unsigned int shader, std::string type)
+// Bone palettes of every skinned character, uploaded once per frame into a
+// texture buffer (four RGBA32F texels per matrix) that mesh.vert reads with
+// texelFetch. A uniform block would cap the palette at a few hundred bones
+// for all characters together.
+struct SkinningPalettes {
+    static const int TEXTURE_UNIT = 7;
+
+    GLuint bufferID = 0, textureID = 0;
+    size_t capacity = 0;
+
+    void upload(const vector<glm::mat4> &palettes)
+    {
+        if (palettes.empty()) return;
+        size_t bytes = palettes.size() * sizeof(glm::mat4);
+        if (bufferID == 0) {
+            glGenBuffers(1, &bufferID);
+            glGenTextures(1, &textureID);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, bufferID);
+        if (bytes > capacity) {
+            capacity = glm::max(bytes, capacity * 2);
+            glBufferData(GL_TEXTURE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+            memoryTracker.trackBuffer("skinning", bufferID, capacity);
+            glBindTexture(GL_TEXTURE_BUFFER, textureID);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, bufferID);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        }
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, palettes.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void cleanup()
+    {
+        memoryTracker.releaseBuffer(bufferID);
+        glDeleteBuffers(1, &bufferID);
+        glDeleteTextures(1, &textureID);
+        bufferID = textureID = 0;
+        capacity = 0;
+    }
+};
+
+static SkinningPalettes skinningPalettes;
+
+struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    int m_BoneIDs[MAX_BONE_INFLUENCE];
+    float m_Weights[MAX_BONE_INFLUENCE];
+};
+
+// What a mesh keeps on the CPU once its GL buffers are filled
+enum MeshResidency {
+    MESH_KEEP_CPU,          // The full vertex and index arrays
+    MESH_GPU_ONLY,          // Nothing, the arrays are freed after upload
+    MESH_COMPRESSED,        // A quantised copy, for context-loss recovery or picking
+    MESH_RESIDENCY_COUNT
+};
+
+static const char *meshResidencyNames[MESH_RESIDENCY_COUNT] = {"keep", "gpu-only", "compressed"};
+
+inline bool ParseMeshResidency(const string &name, MeshResidency &residency)
+{
+    for (int i = 0; i < MESH_RESIDENCY_COUNT; i++)
+    {
+        if (name == meshResidencyNames[i])
+        {
+            residency = static_cast<MeshResidency>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Meshes and resident bytes of every live Mesh, by policy
+struct MeshResidencyStats {
+    int meshes[MESH_RESIDENCY_COUNT] = {};
+    long long cpuBytes[MESH_RESIDENCY_COUNT] = {};
+    long long gpuBytes[MESH_RESIDENCY_COUNT] = {};
+
+    void print(std::ostream &out) const
+    {
+        out << "Mesh residency:";
+        for (int i = 0; i < MESH_RESIDENCY_COUNT; i++)
+        {
+            out << " " << meshResidencyNames[i] << " " << meshes[i] << " meshes, "
+                << cpuBytes[i] / 1024.0 << " KB CPU / " << gpuBytes[i] / 1024.0 << " KB GPU"
+                << (i + 1 < MESH_RESIDENCY_COUNT ? ";" : "");
+        }
+        out << std::endl;
+    }
+};
+
+static MeshResidencyStats meshResidencyStats;
+
+// Quantised copy of a mesh for MESH_COMPRESSED: positions as 16-bit
+// fractions of the bounding box, normals octahedral-encoded in two 16-bit
+// values, bone influences only for skinned meshes and 16-bit indices when
+// every index fits. A static mesh shrinks from 56 to 10 bytes per vertex.
+struct CompressedMesh {
+    glm::vec3 boundsMin = glm::vec3(0.0f), boundsExtent = glm::vec3(0.0f);
+    size_t vertexCount = 0;
+    vector<uint16_t> positions;     // 3 per vertex
+    vector<int16_t> normals;        // 2 per vertex
+    vector<uint16_t> boneIds;       // 4 per vertex, skinned meshes only
+    vector<uint8_t> boneWeights;    // 4 per vertex, skinned meshes only
+    vector<uint16_t> indices16;
+    vector<unsigned int> indices32;
+
+    void compress(const vector<Vertex> &vertices, const vector<unsigned int> &indices)
     {
-        int success;
-        char infoLog[1024];
-        if (type != "PROGRAM")
+        vertexCount = vertices.size();
+        glm::vec3 boundsMax(-FLT_MAX);
+        boundsMin = glm::vec3(FLT_MAX);
+        for (const Vertex &vertex : vertices)
+        {
+            boundsMin = glm::min(boundsMin, vertex.Position);
+            boundsMax = glm::max(boundsMax, vertex.Position);
+        }
+        if (vertices.empty()) boundsMin = boundsMax = glm::vec3(0.0f);
+        boundsExtent = boundsMax - boundsMin;
+
+        bool skinned = false;
+        for (const Vertex &vertex : vertices)
+            skinned = skinned || vertex.m_Weights[0] > 0.0f;
+
+        positions.resize(3 * vertexCount);
+        normals.resize(2 * vertexCount);
+        boneIds.resize(skinned ? 4 * vertexCount : 0);
+        boneWeights.resize(skinned ? 4 * vertexCount : 0);
+        for (size_t i = 0; i < vertexCount; i++)
         {
-            glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-            if (!success)
+            const Vertex &vertex = vertices[i];
+            for (int axis = 0; axis < 3; axis++)
+            {
+                float t = boundsExtent[axis] > 0.0f ? (vertex.Position[axis] - boundsMin[axis]) / boundsExtent[axis] : 0.0f;
+                positions[3 * i + axis] = static_cast<uint16_t>(t * 65535.0f + 0.5f);
+            }
+            glm::vec2 octahedral = OctahedralEncode(vertex.Normal);
+            normals[2 * i] = static_cast<int16_t>(roundf(octahedral.x * 32767.0f));
+            normals[2 * i + 1] = static_cast<int16_t>(roundf(octahedral.y * 32767.0f));
+            if (skinned)
             {
-                glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+                {
+                    boneIds[4 * i + k] = static_cast<uint16_t>(vertex.m_BoneIDs[k]);
+                    boneWeights[4 * i + k] = static_cast<uint8_t>(glm::clamp(vertex.m_Weights[k], 0.0f, 1.0f) * 255.0f + 0.5f);
+                }
             }
         }
+
+        indices16.clear();
+        indices32.clear();
+        if (vertexCount <= 65536)
+            indices16.assign(indices.begin(), indices.end());
         else
+            indices32 = indices;
+    }
+
+    glm::vec3 position(size_t vertex) const
+    {
+        return boundsMin + boundsExtent * glm::vec3(positions[3 * vertex], positions[3 * vertex + 1],
+                                                    positions[3 * vertex + 2]) * (1.0f / 65535.0f);
+    }
+
+    void decompress(vector<Vertex> &vertices, vector<unsigned int> &indices) const
+    {
+        vertices.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++)
         {
-            glGetProgramiv(shader, GL_LINK_STATUS, &success);
-            if (!success)
+            Vertex &vertex = vertices[i];
+            vertex = Vertex();
+            vertex.Position = position(i);
+            vertex.Normal = OctahedralDecode(glm::vec2(normals[2 * i], normals[2 * i + 1]) * (1.0f / 32767.0f));
+            if (!boneIds.empty())
             {
-                glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-                std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+                for (int k = 0; k < MAX_BONE_INFLUENCE; k++)
+                {
+                    vertex.m_BoneIDs[k] = boneIds[4 * i + k];
+                    vertex.m_Weights[k] = boneWeights[4 * i + k] * (1.0f / 255.0f);
+                }
             }
         }
+        if (!indices16.empty())
+            indices.assign(indices16.begin(), indices16.end());
+        else
+            indices = indices32;
     }
-};
 
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    int m_BoneIDs[MAX_BONE_INFLUENCE];
-    float m_Weights[MAX_BONE_INFLUENCE];
+    size_t bytes() const
+    {
+        return positions.capacity() * sizeof(uint16_t) + normals.capacity() * sizeof(int16_t)
+               + boneIds.capacity() * sizeof(uint16_t) + boneWeights.capacity()
+               + indices16.capacity() * sizeof(uint16_t) + indices32.capacity() * sizeof(unsigned int);
+    }
+
+    // Unit vector onto the [-1, 1] square, a zero normal stays zero
+    static glm::vec2 OctahedralEncode(glm::vec3 n)
+    {
+        float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+        if (sum == 0.0f) return glm::vec2(0.0f);
+        n /= sum;
+        glm::vec2 e(n.x, n.y);
+        if (n.z < 0.0f)
+        {
+            e = glm::vec2((1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f),
+                          (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+        }
+        return e;
+    }
+
+    static glm::vec3 OctahedralDecode(glm::vec2 e)
+    {
+        glm::vec3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+        if (n.z < 0.0f)
+        {
+            n.x = (1.0f - fabsf(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f);
+            n.y = (1.0f - fabsf(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        float length = glm::length(n);
+        return length > 0.0f ? n / length : glm::vec3(0.0f);
+    }
 };
 
+// Every mesh lives in the geometry pool's buffers for this layout, so all
+// meshes of all models draw from one VAO
+static int MeshGeometryFormat()
+{
+    static const int format = geometryPool.registerFormat(GeometryFormat{"meshes", sizeof(Vertex), 4, {
+            {0, 3, GL_FLOAT, false, 0},
+            {1, 3, GL_FLOAT, false, offsetof(Vertex, Normal)},
+            {2, 4, GL_INT, true, offsetof(Vertex, m_BoneIDs)},
+            {3, 4, GL_FLOAT, false, offsetof(Vertex, m_Weights)}}});
+    return format;
+}
+
 class Mesh {
 public:
-    vector<Vertex> vertices;
+    vector<Vertex> vertices;        // Empty after upload unless the policy keeps them
     vector<unsigned int> indices;
-    unsigned int VAO;
+    CompressedMesh compressed;      // Only filled for MESH_COMPRESSED
+    GeometryHandle geometry;        // Range in the geometry pool, -1 before upload
+    GLsizei indexCount;
+    MeshResidency residency;
+
+    // Takes over the converted arrays, the pool range is allocated later by
+    // setupMesh
+    Mesh(vector<Vertex> &&vertices, vector<unsigned int> &&indices, MeshResidency residency = MESH_KEEP_CPU)
+        : vertices(std::move(vertices)), indices(std::move(indices)), geometry(-1),
+          indexCount(static_cast<GLsizei>(this->indices.size())), residency(residency)
+    {
+        trackCpu(1);
+    }
+
+    // Whatever the residency policy left on the CPU
+    size_t cpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) + compressed.bytes();
+    }
 
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices)
+    size_t gpuBytes() const
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        setupMesh();
+        return gpuVertexCount * sizeof(Vertex) + indexCount * sizeof(unsigned int);
     }
 
-    void Draw(Shader &shader, glm::mat4 vp, glm::vec3 position, glm::vec3 scale)
+    void cleanup()
     {
-        //glEnable(GL_DEPTH_TEST);
+        trackCpu(-1);
+        if (geometry >= 0)
+        {
+            meshResidencyStats.meshes[residency]--;
+            meshResidencyStats.gpuBytes[residency] -= gpuBytes();
+        }
+        geometryPool.release(geometry);
+    }
 
-        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), position);
-        modelMatrix = glm::scale(modelMatrix, scale);
-        modelMatrix = glm::rotate(modelMatrix, glm::radians(180.0f), glm::vec3(0,1,0));
-        glm::mat4 mvp = vp * modelMatrix;
+    // Uploads the arrays, then drops or compresses them as the policy says
+    void setupMesh()
+    {
+        upload(vertices, indices);
 
-        shader.use();
-        shader.setMat4("MVP", mvp);
-        shader.setVec3("material_diffuse", glm::vec3(0.0f));
+        trackCpu(-1);
+        if (residency == MESH_COMPRESSED)
+            compressed.compress(vertices, indices);
+        if (residency != MESH_KEEP_CPU)
+        {
+            vector<Vertex>().swap(vertices);
+            vector<unsigned int>().swap(indices);
+        }
+        trackCpu(1);
+        meshResidencyStats.meshes[residency]++;
+        meshResidencyStats.gpuBytes[residency] += gpuBytes();
+    }
 
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+    // Uploads again, e.g. after the context was lost and the geometry pool
+    // was reset, from the CPU or compressed copy. GPU-only meshes have to be
+    // imported again.
+    bool restore()
+    {
+        if (residency == MESH_GPU_ONLY)
+            return false;
+        if (residency == MESH_COMPRESSED)
+        {
+            vector<Vertex> decodedVertices;
+            vector<unsigned int> decodedIndices;
+            compressed.decompress(decodedVertices, decodedIndices);
+            upload(decodedVertices, decodedIndices);
+        }
+        else
+        {
+            upload(vertices, indices);
+        }
+        return true;
     }
 
 private:
-    unsigned int VBO, EBO;
+    size_t gpuVertexCount = 0;
 
-    void setupMesh()
+    // The pool keeps indices relative to the range's first vertex, so the
+    // arrays go in unchanged
+    void upload(const vector<Vertex> &vertexData, const vector<unsigned int> &indexData)
     {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // bone IDs
-        glEnableVertexAttribArray(2);
-        glVertexAttribIPointer(2, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, m_BoneIDs));
-        // weights
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
+        gpuVertexCount = vertexData.size();
+        geometry = geometryPool.allocate(MeshGeometryFormat(), vertexData.data(), vertexData.size(),
+                                         indexData.data(), indexData.size());
+    }
 
-        glBindVertexArray(0);
+    // Adds (sign 1) or removes (sign -1) what the mesh currently holds on the CPU
+    void trackCpu(int sign)
+    {
+        long long arrays = static_cast<long long>(vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int));
+        long long packed = static_cast<long long>(compressed.bytes());
+        memoryTracker.addCpu("mesh data", sign * arrays);
+        memoryTracker.addCpu("mesh data compressed", sign * packed);
+        meshResidencyStats.cpuBytes[residency] += sign * (arrays + packed);
     }
 };
 
+// CPU side of an imported model, filled without touching GL so it can be
+// imported on a worker and shared by several Model instances
+struct MeshData {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+};
+
+struct ModelImportStats {
+    double readMs = 0.0;        // Assimp: parsing and post-processing
+    double convertMs = 0.0;     // processMesh for every mesh, plus bones
+    double uploadMs = 0.0;      // GL objects, set when a Model is created
+    int meshes = 0;
+    int threads = 1;            // Threads the conversion could use
+    size_t vertices = 0;
+    size_t indices = 0;
+};
+
+struct ModelData {
+    vector<MeshData> meshes;
+    string directory;
+    bool skinned = false;
+    Skeleton skeleton;
+    vector<AnimationClip> clips;
+    ModelImportStats stats;
+};
+
+// An aiMesh and the node that references it, in node order
+struct MeshSource {
+    const aiMesh *mesh;
+    const aiNode *node;
+};
+
+static glm::mat4 ToGlm(const aiMatrix4x4 &m)
+{
+    // Assimp matrices are row-major
+    return glm::mat4(m.a1, m.b1, m.c1, m.d1,
+                     m.a2, m.b2, m.c2, m.d2,
+                     m.a3, m.b3, m.c3, m.d3,
+                     m.a4, m.b4, m.c4, m.d4);
+}
+
 class Model
 {
 public:
     vector<Mesh> meshes;
     string directory;
     glm::vec3 pos, scl;
+    bool skinned = false;
+    Skeleton skeleton;
+    vector<AnimationClip> clips;
+    int paletteOffset = -1;     // Set per draw for skinned characters
+    ModelImportStats importStats;
 
-    Model(string const &path, glm::vec3 __pos, glm::vec3 __scl)
+    Model(string const &path, glm::vec3 __pos, glm::vec3 __scl, MeshResidency residency = MESH_KEEP_CPU)
     {
-        loadModel(path);
+        ModelData data;
+        importModel(path, data);
+        createMeshes(std::move(data), residency);
         pos = __pos;
         scl = __scl;
     }
 
-    void Draw(glm::mat4 vp)
+    // Copies the arrays, for data shared by several models
+    Model(const ModelData &data, glm::vec3 __pos, glm::vec3 __scl, MeshResidency residency = MESH_KEEP_CPU)
     {
-         Shader shader("../assignment/shaders/mesh.vert", "../assignment/shaders/mesh.frag");
-        if (shader.ID == 0) {
-            std::cerr << "Failed to compile model shaders" << std::endl;
-            return;
-        }
+        ModelData copy = data;
+        createMeshes(std::move(copy), residency);
+        pos = __pos;
+        scl = __scl;
+    }
 
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader, vp, pos, scl);
+    Model(ModelData &&data, glm::vec3 __pos, glm::vec3 __scl, MeshResidency residency = MESH_KEEP_CPU)
+    {
+        createMeshes(std::move(data), residency);
+        pos = __pos;
+        scl = __scl;
     }
 
-private:
-    void loadModel(string const &path)
+    // Thread-safe, every call uses its own importer. With a job system the
+    // meshes are converted in parallel, each straight into its slot of
+    // data.meshes; this may itself run as a job.
+    static bool importModel(string const &path, ModelData &data, JobSystem *jobs = nullptr)
     {
+        auto start = std::chrono::steady_clock::now();
         Assimp::Importer importer;
+        // The importer takes ownership of the IO handler
+        if (assetFiles.isPacked())
+            importer.SetIOHandler(new PackIOSystem());
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate
                                                        | aiProcess_GenSmoothNormals
                                                        | aiProcess_FlipUVs
-                                                       | aiProcess_PreTransformVertices);
+                                                       | aiProcess_LimitBoneWeights);
 
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            return false;
+        }
+
+        // PreTransformVertices bakes the node hierarchy into the vertices and
+        // drops the bones, so only static models get it
+        data.skinned = false;
+        for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+            data.skinned = data.skinned || scene->mMeshes[i]->HasBones();
+        if (!data.skinned)
+        {
+            scene = importer.ApplyPostProcessing(aiProcess_PreTransformVertices);
+            if (!scene)
+            {
+                cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+                return false;
+            }
+        }
+
+        auto readEnd = std::chrono::steady_clock::now();
+        data.stats.readMs = std::chrono::duration<double, std::milli>(readEnd - start).count();
+
+        data.directory = path.substr(0, path.find_last_of('/'));
+        if (data.skinned)
+        {
+            data.skeleton.globalInverse = glm::inverse(ToGlm(scene->mRootNode->mTransformation));
+            processSkeleton(scene->mRootNode, -1, data.skeleton);
+        }
+
+        vector<MeshSource> sources;
+        collectMeshes(scene->mRootNode, scene, sources);
+        int count = static_cast<int>(sources.size());
+        data.meshes.resize(count);
+        auto convert = [&sources, &data](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                processMesh(sources[i].mesh, data.meshes[i]);
+        };
+        if (jobs && count > 1)
+        {
+            JobCounter converted;
+            jobs->parallelFor(count, 1, convert, converted);
+            jobs->wait(converted);
+        }
+        else
+        {
+            convert(0, count);
+        }
+
+        // Bone ids are handed out in mesh order, so this part stays serial
+        if (data.skinned)
+        {
+            for (int i = 0; i < count; i++)
+                processBones(sources[i].mesh, sources[i].node, data.skeleton, data.meshes[i]);
+            processAnimations(scene, data);
+        }
+
+        data.stats.convertMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - readEnd).count();
+        data.stats.meshes = count;
+        data.stats.threads = jobs ? static_cast<int>(jobs->workerCount()) + 1 : 1;
+        data.stats.vertices = data.stats.indices = 0;
+        for (const MeshData &mesh : data.meshes)
+        {
+            data.stats.vertices += mesh.vertices.size();
+            data.stats.indices += mesh.indices.size();
+        }
+        return true;
+    }
+
+    glm::mat4 modelMatrix() const
+    {
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), pos);
+        modelMatrix = glm::scale(modelMatrix, scl);
+        return glm::rotate(modelMatrix, glm::radians(180.0f), glm::vec3(0,1,0));
+    }
+
+    void Draw(glm::mat4 vp)
+    {
+        Draw(vp, modelMatrix());
+    }
+
+    void Draw(const glm::mat4 &vp, const glm::mat4 &model)
+    {
+        Shader *shader = useShader();
+        if (!shader) {
             return;
         }
-        directory = path.substr(0, path.find_last_of('/'));
-        processNode(scene->mRootNode, scene);
+        shader->setInt("instanced", 0);
+        shader->setMat4("MVP", vp * model);
+
+        // All meshes share the pool's mesh buffers, one call draws them all
+        geometryPool.bind(MeshGeometryFormat());
+        geometryHandles.clear();
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            geometryHandles.push_back(meshes[i].geometry);
+        geometryPool.multiDraw(geometryHandles.data(), static_cast<int>(geometryHandles.size()));
+        glBindVertexArray(0);
     }
 
-    void processNode(aiNode *node, const aiScene *scene)
+    // One draw call per mesh for every instance, e.g. with the matrices of a
+    // TransformSystem. The instance attributes 4-7 are pointed at this model's
+    // buffer on the shared VAO for the duration of the call.
+    void DrawInstanced(const glm::mat4 &vp, const glm::mat4 *models, int count)
     {
-        for(unsigned int i = 0; i < node->mNumMeshes; i++)
-        {
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+        Shader *shader = useShader();
+        if (!shader || count <= 0) {
+            return;
         }
-        for(unsigned int i = 0; i < node->mNumChildren; i++)
+
+        if (instanceBufferID == 0) {
+            glGenBuffers(1, &instanceBufferID);
+        }
+        size_t bytes = count * sizeof(glm::mat4);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBufferID);
+        if (bytes > instanceCapacity) {
+            instanceCapacity = glm::max(bytes, instanceCapacity * 2);
+            glBufferData(GL_ARRAY_BUFFER, instanceCapacity, NULL, GL_STREAM_DRAW);
+            memoryTracker.trackBuffer("meshes", instanceBufferID, instanceCapacity);
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, models);
+
+        shader->setInt("instanced", 1);
+        shader->setMat4("VP", vp);
+
+        geometryPool.bind(MeshGeometryFormat());
+        for (int column = 0; column < 4; column++)
         {
-            processNode(node->mChildren[i], scene);
+            glEnableVertexAttribArray(4 + column);
+            glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(4 + column, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            geometryPool.drawInstanced(meshes[i].geometry, count);
+
+        for (int column = 0; column < 4; column++)
+            glDisableVertexAttribArray(4 + column);
+        glBindVertexArray(0);
+    }
+
+    void cleanup()
+    {
+        for (Mesh &mesh : meshes)
+            mesh.cleanup();
+        meshes.clear();
+        if (instanceBufferID != 0) {
+            memoryTracker.releaseBuffer(instanceBufferID);
+            glDeleteBuffers(1, &instanceBufferID);
+            instanceBufferID = 0;
+            instanceCapacity = 0;
         }
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // Uploads the meshes again after a context loss, once
+    // geometryPool.contextLost() has dropped the old ranges. False if any mesh
+    // was GPU-only and has to be imported again.
+    bool restore()
     {
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
+        bool restored = true;
+        for (Mesh &mesh : meshes)
+            restored = mesh.restore() && restored;
+        instanceBufferID = 0;
+        instanceCapacity = 0;
+        return restored;
+    }
 
+    // Every model draws with the same program, linked on first use
+    static Shader *sharedShader()
+    {
+        static Shader *shader = nullptr;
+        if (!shader) {
+            shader = new Shader("../assignment/shaders/mesh.vert", "../assignment/shaders/mesh.frag");
+            if (shader->ID == 0) {
+                std::cerr << "Failed to compile model shaders" << std::endl;
+            }
+        }
+        return shader;
+    }
+
+    // Converts one mesh to the vertex layout of Mesh, touches no GL state.
+    // Both arrays are sized once and written in place.
+    static void processMesh(const aiMesh *mesh, MeshData &data)
+    {
+        data.vertices.resize(mesh->mNumVertices);
+        Vertex *vertices = data.vertices.data();
+        bool normals = mesh->HasNormals();
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            Vertex &vertex = vertices[i];
 
             // positions
             vertex.Position.x = mesh->mVertices[i].x;
@@ -252,23 +732,188 @@ private:
             vertex.Position.z = mesh->mVertices[i].z;
 
             // normals
-            if (mesh->HasNormals())
+            if (normals)
             {
                 vertex.Normal.x = mesh->mNormals[i].x;
                 vertex.Normal.y = mesh->mNormals[i].y;
                 vertex.Normal.z = mesh->mNormals[i].z;
             }
-
-            vertices.push_back(vertex);
         }
 
+        size_t indexCount = 0;
+        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+            indexCount += mesh->mFaces[i].mNumIndices;
+        data.indices.resize(indexCount);
+        unsigned int *indices = data.indices.data();
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace &face = mesh->mFaces[i];
             for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
+                *indices++ = face.mIndices[j];
         }
+    }
+
+private:
+    unsigned int instanceBufferID = 0;
+    size_t instanceCapacity = 0;
+    vector<GeometryHandle> geometryHandles;    // Scratch for Draw's multi-draw
+
+    // Binds the shared program with the state common to every mesh
+    Shader *useShader()
+    {
+        Shader *shader = sharedShader();
+        if (shader->ID == 0) {
+            return nullptr;
+        }
+        shader->use();
+        shader->setVec3("material_diffuse", glm::vec3(0.0f));
+        // paletteOffset is the first matrix of this character in
+        // skinningPalettes, -1 draws the meshes unskinned
+        shader->setInt("paletteOffset", skinned ? paletteOffset : -1);
+        if (skinned && paletteOffset >= 0) {
+            glActiveTexture(GL_TEXTURE0 + SkinningPalettes::TEXTURE_UNIT);
+            glBindTexture(GL_TEXTURE_BUFFER, skinningPalettes.textureID);
+            glActiveTexture(GL_TEXTURE0);
+            shader->setInt("boneMatrices", SkinningPalettes::TEXTURE_UNIT);
+        }
+        return shader;
+    }
+
+    void createMeshes(ModelData &&data, MeshResidency residency)
+    {
+        directory = std::move(data.directory);
+        skinned = data.skinned;
+        skeleton = std::move(data.skeleton);
+        clips = std::move(data.clips);
+        importStats = data.stats;
+        meshes.reserve(data.meshes.size());
+        for (MeshData &mesh : data.meshes)
+            meshes.emplace_back(std::move(mesh.vertices), std::move(mesh.indices), residency);
+        data.meshes.clear();
+        uploadMeshes();
+    }
+
+    // Each mesh uploads its arrays into a range of the geometry pool
+    void uploadMeshes()
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (Mesh &mesh : meshes)
+            mesh.setupMesh();
+        importStats.uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Flattens the node tree parents first, see Skeleton
+    static void processSkeleton(aiNode *node, int parent, Skeleton &skeleton)
+    {
+        int index = static_cast<int>(skeleton.nodes.size());
+        skeleton.nodes.push_back(SkeletonNode{node->mName.C_Str(), parent, ToGlm(node->mTransformation), -1});
+        for(unsigned int i = 0; i < node->mNumChildren; i++)
+        {
+            processSkeleton(node->mChildren[i], index, skeleton);
+        }
+    }
 
-        return Mesh(vertices, indices);
+    static void processAnimations(const aiScene *scene, ModelData &data)
+    {
+        for(unsigned int i = 0; i < scene->mNumAnimations; i++)
+        {
+            const aiAnimation *animation = scene->mAnimations[i];
+            AnimationClip clip;
+            clip.name = animation->mName.C_Str();
+            clip.duration = static_cast<float>(animation->mDuration);
+            if (animation->mTicksPerSecond > 0.0)
+                clip.ticksPerSecond = static_cast<float>(animation->mTicksPerSecond);
+
+            for(unsigned int j = 0; j < animation->mNumChannels; j++)
+            {
+                const aiNodeAnim *source = animation->mChannels[j];
+                AnimationChannel channel;
+                channel.node = data.skeleton.findNode(source->mNodeName.C_Str());
+                if (channel.node < 0)
+                    continue;
+                for(unsigned int k = 0; k < source->mNumPositionKeys; k++)
+                {
+                    const aiVectorKey &key = source->mPositionKeys[k];
+                    channel.positionTimes.push_back(static_cast<float>(key.mTime));
+                    channel.positions.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+                }
+                for(unsigned int k = 0; k < source->mNumRotationKeys; k++)
+                {
+                    const aiQuatKey &key = source->mRotationKeys[k];
+                    channel.rotationTimes.push_back(static_cast<float>(key.mTime));
+                    channel.rotations.push_back(glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z));
+                }
+                for(unsigned int k = 0; k < source->mNumScalingKeys; k++)
+                {
+                    const aiVectorKey &key = source->mScalingKeys[k];
+                    channel.scaleTimes.push_back(static_cast<float>(key.mTime));
+                    channel.scales.push_back(glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z));
+                }
+                clip.channels.push_back(channel);
+            }
+            data.clips.push_back(clip);
+        }
+    }
+
+    static void collectMeshes(const aiNode *node, const aiScene *scene, vector<MeshSource> &sources)
+    {
+        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+        {
+            sources.push_back(MeshSource{scene->mMeshes[node->mMeshes[i]], node});
+        }
+        for(unsigned int i = 0; i < node->mNumChildren; i++)
+        {
+            collectMeshes(node->mChildren[i], scene, sources);
+        }
+    }
+
+    // Keeps the four largest influences per vertex (LimitBoneWeights already
+    // caps them) and renormalises. A mesh without bones in a skinned file
+    // follows its node, as a single bone with an identity offset.
+    static void processBones(const aiMesh *mesh, const aiNode *node, Skeleton &skeleton, MeshData &data)
+    {
+        vector<Vertex> &vertices = data.vertices;
+        if (!mesh->HasBones())
+        {
+            int bone = skeleton.addBone(skeleton.findNode(node->mName.C_Str()), glm::mat4(1.0f));
+            for (Vertex &vertex : vertices)
+            {
+                vertex.m_BoneIDs[0] = bone;
+                vertex.m_Weights[0] = 1.0f;
+            }
+            return;
+        }
+
+        for(unsigned int i = 0; i < mesh->mNumBones; i++)
+        {
+            const aiBone *source = mesh->mBones[i];
+            int boneNode = skeleton.findNode(source->mName.C_Str());
+            if (boneNode < 0)
+            {
+                cout << "Bone " << source->mName.C_Str() << " has no node, ignored" << endl;
+                continue;
+            }
+            int bone = skeleton.addBone(boneNode, ToGlm(source->mOffsetMatrix));
+            for(unsigned int j = 0; j < source->mNumWeights; j++)
+            {
+                Vertex &vertex = vertices[source->mWeights[j].mVertexId];
+                int slot = 0;
+                for (int k = 1; k < MAX_BONE_INFLUENCE; k++)
+                    if (vertex.m_Weights[k] < vertex.m_Weights[slot]) slot = k;
+                if (source->mWeights[j].mWeight > vertex.m_Weights[slot])
+                {
+                    vertex.m_BoneIDs[slot] = bone;
+                    vertex.m_Weights[slot] = source->mWeights[j].mWeight;
+                }
+            }
+        }
+
+        for (Vertex &vertex : vertices)
+        {
+            float total = 0.0f;
+            for (int k = 0; k < MAX_BONE_INFLUENCE; k++) total += vertex.m_Weights[k];
+            if (total <= 0.0f) continue;
+            for (int k = 0; k < MAX_BONE_INFLUENCE; k++) vertex.m_Weights[k] /= total;
+        }
     }
 };
\ No newline at end of file
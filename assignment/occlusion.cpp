@@ -0,0 +1,213 @@
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vector>
+#include <iostream>
+
+#include <render/shader.h>
+
+// Per-chunk hardware occlusion query state. Results are only ever read when
+// GL_QUERY_RESULT_AVAILABLE says so, a pending query is used for conditional
+// rendering instead, so the CPU never stalls on the GPU.
+struct ChunkOcclusion {
+    GLuint queryID = 0;
+    bool queryPending = false;
+    bool visible = true;        // Result of the last query that came back
+    int stableResults = 0;      // Consecutive results that agreed with the previous one
+    int framesUntilTest = 0;    // Frames left before a visible chunk is re-tested
+
+    void reset() {
+        queryPending = false;
+        visible = true;
+        stableResults = 0;
+        framesUntilTest = 0;
+    }
+};
+
+struct OcclusionStats {
+    unsigned long queriesIssued = 0;
+    unsigned long chunksSkipped = 0;
+    unsigned long conditionalDraws = 0;
+    unsigned long chunksDrawn = 0;
+
+    void reset() {
+        queriesIssued = chunksSkipped = conditionalDraws = chunksDrawn = 0;
+    }
+};
+
+struct OcclusionCuller {
+    // A chunk whose visibility has been stable for this many results is only
+    // re-tested every VISIBLE_RETEST_INTERVAL frames. Occluded chunks are
+    // re-tested every frame so they pop back in as soon as they are exposed.
+    static const int STABLE_THRESHOLD = 2;
+    static const int VISIBLE_RETEST_INTERVAL = 8;
+
+    enum Decision { DRAW, DRAW_CONDITIONAL, SKIP };
+
+    GLfloat vertex_buffer_data[24] = {      // Corners of a canonical box
+            -1.0f, -1.0f, -1.0f,   1.0f, -1.0f, -1.0f,   1.0f, 1.0f, -1.0f,   -1.0f, 1.0f, -1.0f,
+            -1.0f, -1.0f,  1.0f,   1.0f, -1.0f,  1.0f,   1.0f, 1.0f,  1.0f,   -1.0f, 1.0f,  1.0f
+    };
+
+    GLuint index_buffer_data[36] = {
+            0, 1, 2,  0, 2, 3,      // Back
+            4, 6, 5,  4, 7, 6,      // Front
+            0, 4, 5,  0, 5, 1,      // Bottom
+            3, 2, 6,  3, 6, 7,      // Top
+            0, 3, 7,  0, 7, 4,      // Left
+            1, 5, 6,  1, 6, 2       // Right
+    };
+
+    GLuint vertexArrayID, vertexBufferID, indexBufferID;
+    GLuint programID, mvpMatrixID;
+
+    OcclusionStats stats;
+    unsigned long frameIndex = 0;
+
+    void initialize() {
+        glGenVertexArrays(1, &vertexArrayID);
+        glBindVertexArray(vertexArrayID);
+
+        glGenBuffers(1, &vertexBufferID);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
+        memoryTracker.trackBuffer("occlusion", vertexBufferID, sizeof(vertex_buffer_data));
+
+        glGenBuffers(1, &indexBufferID);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
+        memoryTracker.trackBuffer("occlusion", indexBufferID, sizeof(index_buffer_data));
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glBindVertexArray(0);
+
+        programID = LoadShadersFromFile("../assignment/shaders/bbox.vert",
+                                        "../assignment/shaders/bbox.frag");
+        if (programID == 0) {
+            std::cerr << "Failed to load shaders." << std::endl;
+        }
+
+        mvpMatrixID = glGetUniformLocation(programID, "MVP");
+
+        GLenum errorCode = glGetError();
+        if (errorCode != 0) {
+            std::cout << "Occlusion culler error initializing: " << errorCode << std::endl;
+        }
+    }
+
+    void beginFrame() {
+        stats.reset();
+        frameIndex++;
+    }
+
+    // Collects a finished query if there is one and decides how the chunk is
+    // drawn this frame. Chunks the camera is inside of are always drawn, since
+    // their proxy box would be clipped by the near plane.
+    Decision classify(ChunkOcclusion &occ, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+                      const glm::vec3 &cameraPos) {
+        if (glm::all(glm::greaterThanEqual(cameraPos, boundsMin)) &&
+            glm::all(glm::lessThanEqual(cameraPos, boundsMax))) {
+            occ.visible = true;
+            occ.stableResults = 0;
+            stats.chunksDrawn++;
+            return DRAW;
+        }
+
+        if (occ.queryPending) {
+            GLint available = 0;
+            glGetQueryObjectiv(occ.queryID, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                stats.conditionalDraws++;
+                return DRAW_CONDITIONAL;
+            }
+
+            GLuint samplesPassed = 0;
+            glGetQueryObjectuiv(occ.queryID, GL_QUERY_RESULT, &samplesPassed);
+            bool visible = samplesPassed != 0;
+            occ.stableResults = (visible == occ.visible) ? occ.stableResults + 1 : 0;
+            occ.visible = visible;
+            occ.queryPending = false;
+
+            // Stagger re-tests by query handle so stable chunks don't all test on the same frame
+            occ.framesUntilTest = occ.stableResults >= STABLE_THRESHOLD
+                                  ? VISIBLE_RETEST_INTERVAL + occ.queryID % VISIBLE_RETEST_INTERVAL
+                                  : 0;
+        }
+
+        if (!occ.visible) {
+            stats.chunksSkipped++;
+            return SKIP;
+        }
+        stats.chunksDrawn++;
+        return DRAW;
+    }
+
+    bool needsQuery(ChunkOcclusion &occ) {
+        if (occ.queryPending) return false;
+        if (!occ.visible) return true;
+        if (occ.framesUntilTest > 0) {
+            occ.framesUntilTest--;
+            return false;
+        }
+        return true;
+    }
+
+    // Proxy boxes are drawn after the scene with colour and depth writes off,
+    // so they are tested against this frame's depth buffer without changing it.
+    void beginQueries(const glm::mat4 &vp) {
+        glUseProgram(programID);
+        glBindVertexArray(vertexArrayID);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        glDepthMask(GL_FALSE);
+        viewProjection = vp;
+    }
+
+    void issueQuery(ChunkOcclusion &occ, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+        if (occ.queryID == 0) {
+            glGenQueries(1, &occ.queryID);
+        }
+
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        glm::vec3 halfExtent = (boundsMax - boundsMin) * 0.5f;
+        glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), center);
+        modelMatrix = glm::scale(modelMatrix, halfExtent);
+        glm::mat4 mvp = viewProjection * modelMatrix;
+        glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
+
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, occ.queryID);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+        occ.queryPending = true;
+        stats.queriesIssued++;
+    }
+
+    void endQueries() {
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glBindVertexArray(0);
+    }
+
+    void releaseQuery(ChunkOcclusion &occ) {
+        if (occ.queryID != 0) {
+            glDeleteQueries(1, &occ.queryID);
+            occ.queryID = 0;
+        }
+        occ.reset();
+    }
+
+    void cleanup() {
+        memoryTracker.releaseBuffer(vertexBufferID);
+        memoryTracker.releaseBuffer(indexBufferID);
+        glDeleteBuffers(1, &vertexBufferID);
+        glDeleteBuffers(1, &indexBufferID);
+        glDeleteVertexArrays(1, &vertexArrayID);
+        glDeleteProgram(programID);
+    }
+
+private:
+    glm::mat4 viewProjection;
+};
@@ -0,0 +1,58 @@
+#include "glext.h"
+
+#include <cstddef>
+#include <cstring>
+
+PFNGLDISPATCHCOMPUTEPROC glext_DispatchCompute = NULL;
+PFNGLMEMORYBARRIERPROC glext_MemoryBarrier = NULL;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glext_MultiDrawElementsIndirect = NULL;
+PFNGLGETPROGRAMBINARYPROC glext_GetProgramBinary = NULL;
+PFNGLPROGRAMBINARYPROC glext_ProgramBinary = NULL;
+PFNGLPROGRAMPARAMETERIPROC glext_ProgramParameteri = NULL;
+
+static int glVersionMajor = 0;
+static int glVersionMinor = 0;
+static GLint programBinaryFormats = 0;
+
+static bool HasExtension(const char *name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		const char *extension = (const char *) glGetStringi(GL_EXTENSIONS, i);
+		if (extension && strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+void LoadGLExtensions(int version, GLADloadfunc load)
+{
+	glVersionMajor = GLAD_VERSION_MAJOR(version);
+	glVersionMinor = GLAD_VERSION_MINOR(version);
+
+	if (glVersionMajor > 4 || (glVersionMajor == 4 && glVersionMinor >= 3)) {
+		glext_DispatchCompute = (PFNGLDISPATCHCOMPUTEPROC) load("glDispatchCompute");
+		glext_MemoryBarrier = (PFNGLMEMORYBARRIERPROC) load("glMemoryBarrier");
+		glext_MultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC) load("glMultiDrawElementsIndirect");
+	}
+
+	// The ARB extension exposes the same unsuffixed entry points as GL 4.1
+	if (glVersionMajor > 4 || (glVersionMajor == 4 && glVersionMinor >= 1) || HasExtension("GL_ARB_get_program_binary")) {
+		glext_GetProgramBinary = (PFNGLGETPROGRAMBINARYPROC) load("glGetProgramBinary");
+		glext_ProgramBinary = (PFNGLPROGRAMBINARYPROC) load("glProgramBinary");
+		glext_ProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC) load("glProgramParameteri");
+		if (glext_GetProgramBinary)
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &programBinaryFormats);
+	}
+}
+
+bool HasGL43()
+{
+	return glext_DispatchCompute && glext_MemoryBarrier && glext_MultiDrawElementsIndirect;
+}
+
+bool HasProgramBinary()
+{
+	return glext_GetProgramBinary && glext_ProgramBinary && glext_ProgramParameteri && programBinaryFormats > 0;
+}
@@ -0,0 +1,71 @@
+#ifndef _GLEXT_H_
+#define _GLEXT_H_
+
+#include <glad/gl.h>
+
+// Entry points and enums newer than the GL 3.3 core profile the glad loader
+// was generated for. They are loaded at runtime by LoadGLExtensions and are
+// null when the context doesn't provide them, so check the Has* helpers first.
+
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void (GLAD_API_PTR *PFNGLDISPATCHCOMPUTEPROC)(GLuint num_groups_x, GLuint num_groups_y, GLuint num_groups_z);
+typedef void (GLAD_API_PTR *PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+typedef void (GLAD_API_PTR *PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+typedef void (GLAD_API_PTR *PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (GLAD_API_PTR *PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (GLAD_API_PTR *PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+extern PFNGLDISPATCHCOMPUTEPROC glext_DispatchCompute;
+extern PFNGLMEMORYBARRIERPROC glext_MemoryBarrier;
+extern PFNGLMULTIDRAWELEMENTSINDIRECTPROC glext_MultiDrawElementsIndirect;
+extern PFNGLGETPROGRAMBINARYPROC glext_GetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC glext_ProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC glext_ProgramParameteri;
+
+#define glDispatchCompute glext_DispatchCompute
+#define glMemoryBarrier glext_MemoryBarrier
+#define glMultiDrawElementsIndirect glext_MultiDrawElementsIndirect
+#define glGetProgramBinary glext_GetProgramBinary
+#define glProgramBinary glext_ProgramBinary
+#define glProgramParameteri glext_ProgramParameteri
+
+// version is the value returned by gladLoadGL
+void LoadGLExtensions(int version, GLADloadfunc load);
+
+// Compute shaders, shader storage buffers and multi-draw-indirect
+bool HasGL43();
+
+// GL 4.1 or ARB_get_program_binary, with at least one binary format
+bool HasProgramBinary();
+
+#endif
@@ -1,28 +1,257 @@
 #include "shader.h"
+#include "glext.h"
 
 #include <string> 
 #include <iostream> 
 #include <fstream>
 #include <sstream> 
 #include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
 
-GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path)
+static ShaderSourceProvider SourceProvider = NULL;
+
+void SetShaderSourceProvider(ShaderSourceProvider provider)
 {
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+	SourceProvider = provider;
+}
+
+// Asks the source provider first, then falls back to reading the file
+static bool ReadSourceFile(const char *file_path, std::string &code)
+{
+	if (SourceProvider && SourceProvider(file_path, code))
+		return true;
+
+	std::ifstream stream(file_path, std::ios::in);
+	if (!stream.is_open())
+		return false;
+	std::stringstream sstr;
+	sstr << stream.rdbuf();
+	code = sstr.str();
+	return true;
+}
+
+// Reads a shader and splices in any '#include "file"' line, resolved next to
+// the including file, so code shared between shaders lives in one place
+static bool ReadShaderSource(const char *file_path, std::string &code, int depth = 0)
+{
+	std::string source;
+	if (!ReadSourceFile(file_path, source))
+		return false;
+
+	std::string path = file_path;
+	size_t slash = path.find_last_of("/\\");
+	std::string directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+
+	code.clear();
+	std::istringstream lines(source);
+	std::string line;
+	while (std::getline(lines, line)) {
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+			code += line;
+			code += '\n';
+			continue;
+		}
+
+		size_t open = line.find('"', start);
+		size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+		std::string included;
+		if (close == std::string::npos || depth >= 4 ||
+		    !ReadShaderSource((directory + line.substr(open + 1, close - open - 1)).c_str(), included, depth + 1)) {
+			printf("Could not include %s in %s\n", line.c_str() + start, file_path);
+			return false;
+		}
+		code += included;
+	}
+	return true;
+}
+
+struct CachedProgram
+{
+	GLenum format;
+	std::vector<char> binary;
+};
+
+static const uint32_t ProgramCacheMagic = 0x31434250; // "PBC1"
+static bool ProgramCacheEnabled = false;
+static std::string ProgramCachePath;
+static uint64_t DriverHash = 0;
+static std::unordered_map<uint64_t, CachedProgram> CachedPrograms;
+static bool ProgramCacheDirty = false;
+static ProgramCacheStats CacheStats = {0, 0, 0, 0};
+
+// 64-bit FNV-1a, chained through seed
+static uint64_t HashBytes(const char *data, size_t length, uint64_t seed = 14695981039346656037ull)
+{
+	uint64_t hash = seed;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char) data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static uint64_t HashString(const char *text, uint64_t seed)
+{
+	if (!text)
+		text = "";
+	// Include the terminator so ("ab", "c") and ("a", "bc") hash differently
+	return HashBytes(text, strlen(text) + 1, seed);
+}
+
+static uint64_t ProgramKey(const std::string &VertexShaderCode, const std::string &FragmentShaderCode)
+{
+	uint64_t hash = HashString(VertexShaderCode.c_str(), DriverHash);
+	return HashString(FragmentShaderCode.c_str(), hash);
+}
+
+// File layout: magic, driver hash, entry count, then per entry
+// key, format, length and the binary itself
+static void SaveProgramCache()
+{
+	std::ofstream stream(ProgramCachePath, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!stream.is_open()) {
+		printf("Could not write program cache %s\n", ProgramCachePath.c_str());
+		return;
+	}
+	uint32_t count = (uint32_t) CachedPrograms.size();
+	stream.write((const char *) &ProgramCacheMagic, sizeof(ProgramCacheMagic));
+	stream.write((const char *) &DriverHash, sizeof(DriverHash));
+	stream.write((const char *) &count, sizeof(count));
+	for (const auto &entry : CachedPrograms) {
+		uint32_t format = entry.second.format;
+		uint32_t length = (uint32_t) entry.second.binary.size();
+		stream.write((const char *) &entry.first, sizeof(entry.first));
+		stream.write((const char *) &format, sizeof(format));
+		stream.write((const char *) &length, sizeof(length));
+		stream.write(entry.second.binary.data(), length);
+	}
+}
+
+void EnableProgramBinaryCache(const char *cache_file_path)
+{
+	if (!HasProgramBinary()) {
+		printf("Program binaries not supported, shaders are compiled from source\n");
+		return;
+	}
+	ProgramCacheEnabled = true;
+	ProgramCachePath = cache_file_path;
+	DriverHash = HashString((const char *) glGetString(GL_VENDOR), HashBytes(NULL, 0));
+	DriverHash = HashString((const char *) glGetString(GL_RENDERER), DriverHash);
+	DriverHash = HashString((const char *) glGetString(GL_VERSION), DriverHash);
+
+	std::ifstream stream(cache_file_path, std::ios::in | std::ios::binary);
+	if (!stream.is_open())
+		return;
+	stream.seekg(0, std::ios::end);
+	std::streamoff fileSize = stream.tellg();
+	stream.seekg(0, std::ios::beg);
+
+	uint32_t magic = 0, count = 0;
+	uint64_t driver = 0;
+	stream.read((char *) &magic, sizeof(magic));
+	stream.read((char *) &driver, sizeof(driver));
+	stream.read((char *) &count, sizeof(count));
+	if (!stream || magic != ProgramCacheMagic || driver != DriverHash) {
+		// Written by another driver, or not a cache file at all. It is
+		// overwritten by the next flush once a program has been stored.
+		printf("Program cache %s is stale, discarding %u entries\n", cache_file_path, count);
+		CacheStats.invalidated += (int) count;
+		return;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint64_t key = 0;
+		uint32_t format = 0, length = 0;
+		stream.read((char *) &key, sizeof(key));
+		stream.read((char *) &format, sizeof(format));
+		stream.read((char *) &length, sizeof(length));
+		// A corrupt length must not turn into a huge allocation
+		std::streamoff position = stream.tellg();
+		if (!stream || position < 0 || (std::streamoff) length > fileSize - position) {
+			printf("Program cache %s is corrupt, discarding it\n", cache_file_path);
+			CacheStats.invalidated += (int) (count - i) + (int) CachedPrograms.size();
+			CachedPrograms.clear();
+			return;
+		}
+		CachedProgram program;
+		program.format = format;
+		program.binary.resize(length);
+		stream.read(program.binary.data(), length);
+		if (!stream) {
+			printf("Program cache %s is truncated\n", cache_file_path);
+			CacheStats.invalidated++;
+			break;
+		}
+		CachedPrograms[key] = std::move(program);
+	}
+}
+
+void FlushProgramBinaryCache()
+{
+	if (!ProgramCacheEnabled || !ProgramCacheDirty)
+		return;
+	SaveProgramCache();
+	ProgramCacheDirty = false;
+}
+
+ProgramCacheStats GetProgramCacheStats()
+{
+	return CacheStats;
+}
+
+// Returns 0 on a miss. A binary the driver refuses is dropped from the cache.
+static GLuint LoadCachedProgram(uint64_t key)
+{
+	if (!ProgramCacheEnabled)
+		return 0;
+	auto it = CachedPrograms.find(key);
+	if (it == CachedPrograms.end()) {
+		CacheStats.misses++;
+		return 0;
+	}
+
+	GLuint ProgramID = glCreateProgram();
+	glProgramBinary(ProgramID, it->second.format, it->second.binary.data(), (GLsizei) it->second.binary.size());
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if (!Result) {
+		printf("Cached program binary rejected, compiling from source\n");
+		glDeleteProgram(ProgramID);
+		CachedPrograms.erase(it);
+		ProgramCacheDirty = true;
+		CacheStats.invalidated++;
+		CacheStats.misses++;
+		return 0;
+	}
+	CacheStats.hits++;
+	return ProgramID;
+}
+
+static void StoreProgramBinary(uint64_t key, GLuint ProgramID)
+{
+	if (!ProgramCacheEnabled)
+		return;
+	GLint length = 0;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
 
+	CachedProgram program;
+	program.binary.resize(length);
+	glGetProgramBinary(ProgramID, length, NULL, &program.format, program.binary.data());
+	CachedPrograms[key] = std::move(program);
+	ProgramCacheDirty = true;
+	CacheStats.stored++;
+}
+
+GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path)
+{
 	// Read the Vertex Shader code from the file
 	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if (VertexShaderStream.is_open())
-	{
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}
-	else
+	if (!ReadShaderSource(vertex_file_path, VertexShaderCode))
 	{
 		printf("Vertex shader not found %s.\n", vertex_file_path);
 		return 0;
@@ -30,20 +259,21 @@ GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_fi
 
 	// Read the Fragment Shader code from the file
 	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if (FragmentShaderStream.is_open())
-	{
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
-	}
-	else
+	if (!ReadShaderSource(fragment_file_path, FragmentShaderCode))
 	{
 		printf("Fragment shader not found %s.\n", fragment_file_path);
 		return 0;
 	}
 
+	uint64_t CacheKey = ProgramKey(VertexShaderCode, FragmentShaderCode);
+	GLuint CachedProgramID = LoadCachedProgram(CacheKey);
+	if (CachedProgramID != 0)
+		return CachedProgramID;
+
+	// Create the shaders
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
@@ -91,6 +321,8 @@ GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_fi
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if (ProgramCacheEnabled)
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -113,11 +345,18 @@ GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_fi
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
+	StoreProgramBinary(CacheKey, ProgramID);
+
 	return ProgramID;
 }
 
 GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode)
 {
+	uint64_t CacheKey = ProgramKey(VertexShaderCode, FragmentShaderCode);
+	GLuint CachedProgramID = LoadCachedProgram(CacheKey);
+	if (CachedProgramID != 0)
+		return CachedProgramID;
+
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
 	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
@@ -169,6 +408,8 @@ GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentS
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if (ProgramCacheEnabled)
+		glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -191,5 +432,68 @@ GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentS
 	glDeleteShader(VertexShaderID);
 	glDeleteShader(FragmentShaderID);
 
+	StoreProgramBinary(CacheKey, ProgramID);
+
+	return ProgramID;
+}
+
+GLuint LoadComputeShaderFromFile(const char *compute_file_path)
+{
+	// Read the Compute Shader code from the file
+	std::string ComputeShaderCode;
+	if (!ReadShaderSource(compute_file_path, ComputeShaderCode))
+	{
+		printf("Compute shader not found %s.\n", compute_file_path);
+		return 0;
+	}
+
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+
+	// Compile Compute Shader
+	printf("Compiling compute shader : %s\n", compute_file_path);
+	GLuint ComputeShaderID = glCreateShader(GL_COMPUTE_SHADER);
+	char const *ComputeSourcePointer = ComputeShaderCode.c_str();
+	glShaderSource(ComputeShaderID, 1, &ComputeSourcePointer, NULL);
+	glCompileShader(ComputeShaderID);
+
+	// Check Compute Shader
+	glGetShaderiv(ComputeShaderID, GL_COMPILE_STATUS, &Result);
+	if (!Result) {
+		printf("Error compiling compute shader : %s\n", compute_file_path);
+		glGetShaderiv(ComputeShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		if (InfoLogLength > 0) {
+			std::vector<char> ComputeShaderErrorMessage(InfoLogLength + 1);
+			glGetShaderInfoLog(ComputeShaderID, InfoLogLength, NULL, &ComputeShaderErrorMessage[0]);
+			printf("%s\n", &ComputeShaderErrorMessage[0]);
+		}
+		glDeleteShader(ComputeShaderID);
+		return 0;
+	}
+
+	// Link the program
+	printf("Linking program\n");
+	GLuint ProgramID = glCreateProgram();
+	glAttachShader(ProgramID, ComputeShaderID);
+	glLinkProgram(ProgramID);
+
+	// Check the program
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if (!Result) {
+		printf("Error linking program\n");
+		glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		if (InfoLogLength > 0)
+		{
+			std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
+			glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+			printf("%s\n", &ProgramErrorMessage[0]);
+		}
+		glDeleteShader(ComputeShaderID);
+		return 0;
+	}
+
+	glDetachShader(ProgramID, ComputeShaderID);
+	glDeleteShader(ComputeShaderID);
+
 	return ProgramID;
 }
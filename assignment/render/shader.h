@@ -4,8 +4,37 @@
 #include <glad/gl.h>
 #include <string>
 
+// Lets callers supply shader sources that were read ahead of time. The
+// provider returns false for paths it doesn't have, those are read from disk.
+typedef bool (*ShaderSourceProvider)(const char *file_path, std::string &source);
+void SetShaderSourceProvider(ShaderSourceProvider provider);
+
 GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path);
 
 GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode);
 
+// Linked programs are stored with glGetProgramBinary in a single cache file
+// and reloaded on the next launch instead of compiling from source. Entries
+// are keyed by both shader sources and the driver vendor/renderer/version,
+// a driver change or a binary the driver rejects invalidates them.
+// Does nothing unless HasProgramBinary().
+void EnableProgramBinaryCache(const char *cache_file_path);
+
+// Stored and rejected programs only change the cache in memory, this writes
+// the file if anything changed. Call once startup has loaded its programs
+// and again at shutdown for any loaded later.
+void FlushProgramBinaryCache();
+
+struct ProgramCacheStats {
+	int hits;
+	int misses;
+	int invalidated;
+	int stored;
+};
+
+ProgramCacheStats GetProgramCacheStats();
+
+// Requires a GL 4.3 context
+GLuint LoadComputeShaderFromFile(const char *compute_file_path);
+
 #endif
@@ -0,0 +1,66 @@
+#include <glm/glm.hpp>
+
+// World matrices recomputed this frame and in total, so a static scene can be
+// shown to cost nothing per frame once everything is placed
+struct TransformCounters {
+    unsigned long recomputedThisFrame = 0;
+    unsigned long recomputedLastFrame = 0;
+    unsigned long recomputedTotal = 0;
+
+    void beginFrame() {
+        recomputedLastFrame = recomputedThisFrame;
+        recomputedThisFrame = 0;
+    }
+};
+
+static TransformCounters transformCounters;
+
+// Translation and scale of one node in the scene -> chunk -> building
+// hierarchy with its cached world matrix. Setters only mark the node dirty
+// when the value actually changes; update() recomputes the world matrix when
+// the node or its parent changed and reports that back so the caller can
+// pass it on to the children. Updates run parents first on one thread.
+struct TransformNode {
+    glm::vec3 translation = glm::vec3(0.0f);
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::mat4 world = glm::mat4(1.0f);
+    bool dirty = true;
+
+    void setTranslation(const glm::vec3& value) {
+        if (value != translation) {
+            translation = value;
+            dirty = true;
+        }
+    }
+
+    void setScale(const glm::vec3& value) {
+        if (value != scale) {
+            scale = value;
+            dirty = true;
+        }
+    }
+
+    // translate(translation) * scale(scale) without the matrix products
+    glm::mat4 local() const {
+        glm::mat4 m(1.0f);
+        m[0][0] = scale.x;
+        m[1][1] = scale.y;
+        m[2][2] = scale.z;
+        m[3] = glm::vec4(translation, 1.0f);
+        return m;
+    }
+
+    bool update(const glm::mat4& parentWorld, bool parentChanged) {
+        if (!dirty && !parentChanged) return false;
+        world = parentWorld * local();
+        dirty = false;
+        transformCounters.recomputedThisFrame++;
+        transformCounters.recomputedTotal++;
+        return true;
+    }
+
+    // For a root node
+    bool update() {
+        return update(glm::mat4(1.0f), false);
+    }
+};
@@ -0,0 +1,8 @@
+#version 330 core
+
+out vec3 finalColor;
+
+void main() {
+    // Colour writes are masked off during occlusion queries, only depth testing matters
+    finalColor = vec3(1.0, 0.0, 1.0);
+}
@@ -0,0 +1,38 @@
+#version 430 core
+
+in vec2 UV;
+in vec3 worldPosition;
+in vec3 worldNormal;
+flat in int facade;
+flat in float highlight;
+
+uniform sampler2DArray facadeSampler;
+uniform vec3 lightPosition;
+uniform vec3 lightIntensity;
+
+out vec3 finalColor;
+
+#include "clustered_lighting.glsl"
+
+void main() {
+    vec3 ambient = vec3(0.2);
+
+    vec3 lightDir = normalize(lightPosition - worldPosition);
+    float diff = max(dot(normalize(worldNormal), lightDir), 0.0);
+    vec3 diffuse = diff * lightIntensity;
+
+    vec3 lighting = ambient + diffuse + clusteredLighting(worldPosition, normalize(worldNormal));
+
+    // Tone mapping
+    lighting = lighting / (1 + lighting);
+
+    // Gamma correction
+    lighting = pow(lighting, vec3(2.2));
+
+    finalColor = texture(facadeSampler, vec3(UV, float(facade))).rgb;
+
+    finalColor = finalColor * lighting;
+
+    // The building picked under the cursor
+    finalColor = mix(finalColor, vec3(1.0, 0.75, 0.2), 0.4 * highlight);
+}
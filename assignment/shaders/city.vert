@@ -0,0 +1,26 @@
+#version 430 core
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec2 vertexUV;
+layout(location = 2) in vec3 vertexNormal;
+
+// Per instance, written by cull.comp
+layout(location = 3) in vec4 instancePosition;
+layout(location = 4) in vec4 instanceScale;
+
+uniform mat4 VP;
+
+out vec2 UV;
+out vec3 worldPosition;
+out vec3 worldNormal;
+flat out int facade;
+flat out float highlight;
+
+void main() {
+    worldPosition = instancePosition.xyz + vertexPosition * instanceScale.xyz;
+    gl_Position = VP * vec4(worldPosition, 1.0);
+    UV = vertexUV;
+
+    worldNormal = vertexNormal;
+    facade = int(instanceScale.w);
+    highlight = instancePosition.w;
+}
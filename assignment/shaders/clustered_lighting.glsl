@@ -0,0 +1,39 @@
+// Shared by every lit fragment shader through #include, see ReadShaderSource
+// in render/shader.cpp. SetupClusteredLightingProgram binds these to
+// ClusteredLighting's buffers.
+
+// Clustered point lights, binned on the CPU by LightBinner
+layout(std140) uniform ClusterParams {
+    mat4 clusterView;
+    vec4 clusterScreen;         // xy = render target size in pixels
+    ivec4 clusterDims;          // x, y = tiles, z = depth slices, w = light count
+    vec4 clusterDepth;          // x = slice scale, y = slice bias
+};
+uniform samplerBuffer clusterLights;    // Two texels per light: position + radius, colour
+uniform usamplerBuffer clusterGrid;     // Per cluster: first index, light count
+uniform usamplerBuffer clusterIndices;
+
+vec3 clusteredLighting(vec3 position, vec3 normal) {
+    float depth = -(clusterView * vec4(position, 1.0)).z;
+    if (clusterDims.w == 0 || depth <= 0.0) return vec3(0.0);
+
+    ivec3 cluster = ivec3(ivec2(gl_FragCoord.xy / clusterScreen.xy * vec2(clusterDims.xy)),
+                          int(log(depth) * clusterDepth.x + clusterDepth.y));
+    cluster = clamp(cluster, ivec3(0), clusterDims.xyz - 1);
+    uvec2 range = texelFetch(clusterGrid, (cluster.z * clusterDims.y + cluster.y) * clusterDims.x + cluster.x).xy;
+
+    vec3 result = vec3(0.0);
+    for (uint i = 0u; i < range.y; i++) {
+        int light = int(texelFetch(clusterIndices, int(range.x + i)).r);
+        vec4 positionRadius = texelFetch(clusterLights, 2 * light);
+        vec3 toLight = positionRadius.xyz - position;
+        float distanceSquared = dot(toLight, toLight);
+
+        // Smooth falloff that reaches zero at the radius the binner culls with
+        float window = clamp(1.0 - distanceSquared / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+        float attenuation = window * window;
+        float diff = max(dot(normal, toLight * inversesqrt(max(distanceSquared, 1e-4))), 0.0);
+        result += texelFetch(clusterLights, 2 * light + 1).rgb * diff * attenuation;
+    }
+    return result;
+}
@@ -1,23 +1,50 @@
 #version 330 core
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
-layout(location = 2) in vec4 ids;
+layout(location = 2) in ivec4 boneIds;
 layout(location = 3) in vec4 weights;
+layout(location = 4) in mat4 instanceModel;
 
 //uniform mat4 projectionView;
 //uniform mat4 model;
 uniform mat4 MVP;
+uniform mat4 VP;
+uniform int instanced;          // 1 to transform by VP * instanceModel instead of MVP
+
+// Skinning palettes of all characters, four texels per matrix
+uniform samplerBuffer boneMatrices;
+uniform int paletteOffset;      // First matrix of this character, -1 when not skinned
 
 out vec2 UV;
 out vec3 worldPosition;
 out vec3 worldNormal;
 
+mat4 boneMatrix(int bone)
+{
+    int texel = 4 * (paletteOffset + bone);
+    return mat4(texelFetch(boneMatrices, texel),
+                texelFetch(boneMatrices, texel + 1),
+                texelFetch(boneMatrices, texel + 2),
+                texelFetch(boneMatrices, texel + 3));
+}
+
 void main()
 {
-    gl_Position = MVP * vec4(position, 1.0);
+    vec4 skinnedPosition = vec4(position, 1.0);
+    vec3 skinnedNormal = normal;
+    if (paletteOffset >= 0 && dot(weights, vec4(1.0)) > 0.0) {
+        mat4 skin = weights.x * boneMatrix(boneIds.x)
+                  + weights.y * boneMatrix(boneIds.y)
+                  + weights.z * boneMatrix(boneIds.z)
+                  + weights.w * boneMatrix(boneIds.w);
+        skinnedPosition = skin * skinnedPosition;
+        skinnedNormal = mat3(skin) * normal;
+    }
+
+    gl_Position = (instanced != 0 ? VP * instanceModel : MVP) * skinnedPosition;
 
-    worldPosition = position;
-    worldNormal = normal;
+    worldPosition = skinnedPosition.xyz;
+    worldNormal = skinnedNormal;
 
     //gl_Position = projectionView * model * vec4(position, 1.0);
 }
\ No newline at end of file
@@ -3,13 +3,17 @@
 in vec2 UV;
 in vec3 worldPosition;
 in vec3 worldNormal;
+flat in float facadeLayer;
+flat in float highlight;
 
-uniform sampler2D textureSampler;
+uniform sampler2DArray facadeSampler;
 uniform vec3 lightPosition;
 uniform vec3 lightIntensity;
 
 out vec3 finalColor;
 
+#include "clustered_lighting.glsl"
+
 void main() {
     vec3 ambient = vec3(0.2);
 
@@ -17,7 +21,7 @@ void main() {
     float diff = max(dot(normalize(worldNormal), lightDir), 0.0);
     vec3 diffuse = diff * lightIntensity;
 
-    vec3 lighting = ambient + diffuse;
+    vec3 lighting = ambient + diffuse + clusteredLighting(worldPosition, normalize(worldNormal));
 
     // Tone mapping
     lighting = lighting / (1 + lighting);
@@ -25,6 +29,9 @@ void main() {
     // Gamma correction
     lighting = pow(lighting, vec3(2.2));
 
-    finalColor = texture(textureSampler, UV).rgb;
+    finalColor = texture(facadeSampler, vec3(UV, facadeLayer)).rgb;
     finalColor = finalColor * lighting;
+
+    // The building picked under the cursor
+    finalColor = mix(finalColor, vec3(1.0, 0.75, 0.2), 0.4 * highlight);
 }
\ No newline at end of file
@@ -3,17 +3,27 @@ layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec2 vertexUV;
 layout(location = 2) in vec3 vertexNormal;
 
-uniform mat4 MVP;
+// Per instance, see BuildingRenderer
+layout(location = 3) in mat4 instanceMVP;
+layout(location = 7) in float instanceLayer;
+layout(location = 8) in vec3 instancePosition;
+layout(location = 9) in vec3 instanceScale;
+layout(location = 10) in float instanceHighlight;
 
 out vec2 UV;
 out vec3 worldPosition;
 out vec3 worldNormal;
+flat out float facadeLayer;
+flat out float highlight;
 
 void main() {
-    gl_Position = MVP * vec4(vertexPosition, 1.0);
+    gl_Position = instanceMVP * vec4(vertexPosition, 1.0);
     //color = vec3(100,200,100);
     UV = vertexUV;
 
-    worldPosition = vertexPosition;
+    // Buildings are axis aligned boxes, scaling keeps the cube's face normals
+    worldPosition = instancePosition + vertexPosition * instanceScale;
     worldNormal = vertexNormal;
+    facadeLayer = instanceLayer;
+    highlight = instanceHighlight;
 }
\ No newline at end of file
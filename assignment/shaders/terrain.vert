@@ -0,0 +1,44 @@
+#version 330 core
+layout(location = 0) in vec2 gridPosition;
+
+// Must match ClipmapTerrain
+const int GRID = 64;
+const int TEXTURE_SIZE = 128;
+
+uniform mat4 VP;
+uniform ivec2 originTexel;
+uniform float spacing;
+uniform int level;
+uniform sampler2DArray heightSampler;
+
+out vec2 UV;
+out vec3 worldPosition;
+out vec3 worldNormal;
+
+// Heights are stored toroidally, texel t lives at t mod TEXTURE_SIZE
+float heightAt(ivec2 texel) {
+    return texelFetch(heightSampler, ivec3(texel & (TEXTURE_SIZE - 1), level), 0).r;
+}
+
+void main() {
+    ivec2 grid = ivec2(gridPosition);
+    ivec2 texel = originTexel + grid;
+    float height = heightAt(texel);
+
+    // Odd vertices on the outer edge don't exist in the next coarser level.
+    // Interpolate them from their even neighbours so the edge matches and no
+    // cracks open between levels.
+    if ((grid.y == 0 || grid.y == GRID) && (grid.x & 1) == 1) {
+        height = 0.5 * (heightAt(texel - ivec2(1, 0)) + heightAt(texel + ivec2(1, 0)));
+    } else if ((grid.x == 0 || grid.x == GRID) && (grid.y & 1) == 1) {
+        height = 0.5 * (heightAt(texel - ivec2(0, 1)) + heightAt(texel + ivec2(0, 1)));
+    }
+
+    float dx = heightAt(texel + ivec2(1, 0)) - heightAt(texel - ivec2(1, 0));
+    float dz = heightAt(texel + ivec2(0, 1)) - heightAt(texel - ivec2(0, 1));
+    worldNormal = normalize(vec3(-dx, 2.0 * spacing, -dz));
+
+    worldPosition = vec3(vec2(texel) * spacing, height).xzy;
+    UV = worldPosition.xz / 100.0;
+    gl_Position = VP * vec4(worldPosition, 1.0);
+}
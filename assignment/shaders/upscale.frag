@@ -0,0 +1,32 @@
+#version 330 core
+
+in vec2 UV;
+
+uniform sampler2D sceneSampler;
+uniform vec2 uvScale;       // Part of the texture the scene was rendered into
+uniform vec2 texelSize;     // One source texel in UV units
+uniform int sharpen;        // 0 = plain bilinear, 1 = bilinear plus unsharp mask
+uniform float sharpness;
+
+out vec3 finalColor;
+
+void main() {
+    // Keep every tap half a texel inside the rendered region so bilinear
+    // filtering never picks up the unused part of the texture
+    vec2 maxUV = uvScale - 0.5 * texelSize;
+    vec2 uv = min(UV * uvScale, maxUV);
+    vec3 center = texture(sceneSampler, uv).rgb;
+
+    if (sharpen == 0) {
+        finalColor = center;
+        return;
+    }
+
+    vec3 north = texture(sceneSampler, min(uv + vec2(0.0, texelSize.y), maxUV)).rgb;
+    vec3 south = texture(sceneSampler, uv - vec2(0.0, texelSize.y)).rgb;
+    vec3 east = texture(sceneSampler, min(uv + vec2(texelSize.x, 0.0), maxUV)).rgb;
+    vec3 west = texture(sceneSampler, uv - vec2(texelSize.x, 0.0)).rgb;
+
+    vec3 detail = 4.0 * center - north - south - east - west;
+    finalColor = clamp(center + sharpness * 0.25 * detail, 0.0, 1.0);
+}
@@ -10,8 +10,18 @@
 
 #include <render/shader.h>
 
+// Interleaved position, colour and uv at the locations skybox.vert reads
+static int SkyboxGeometryFormat() {
+    static const int format = geometryPool.registerFormat(GeometryFormat{"skybox", 8 * sizeof(GLfloat), 3, {
+            {0, 3, GL_FLOAT, false, 0},
+            {1, 3, GL_FLOAT, false, 3 * sizeof(GLfloat)},
+            {2, 2, GL_FLOAT, false, 6 * sizeof(GLfloat)}}});
+    return format;
+}
+
 struct Skybox {
     glm::vec3 pos, scale;		// Size of the box in each axis
+    TransformNode transform;
 
     GLfloat vertex_buffer_data[72] = {	// Vertex definition for a canonical box
             // Front face (reversed)
@@ -150,13 +160,9 @@ struct Skybox {
     // ---------------------------
     // ---------------------------
 
-    // OpenGL buffers
-    GLuint vertexArrayID;
-    GLuint vertexBufferID;
-    GLuint indexBufferID;
-    GLuint colorBufferID;
-    GLuint uvBufferID;
-    GLuint textureID;
+    // Range in the geometry pool
+    GeometryHandle geometry = -1;
+    StreamedTexture *texture = nullptr;
 
     // Shader variable IDs
     GLuint mvpMatrixID;
@@ -170,33 +176,20 @@ struct Skybox {
         this->pos = pos;
         this->scale = scale;
 
-        // Create a vertex array object
-        glGenVertexArrays(1, &vertexArrayID);
-        glBindVertexArray(vertexArrayID);
-
-        // Create a vertex buffer object to store the vertex data
-        glGenBuffers(1, &vertexBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(vertex_buffer_data), vertex_buffer_data, GL_STATIC_DRAW);
-
-        // Create a vertex buffer object to store the color data
-        glGenBuffers(1, &colorBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(color_buffer_data), color_buffer_data, GL_STATIC_DRAW);
-
-        glGenBuffers(1, &uvBufferID);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(uv_buffer_data), uv_buffer_data, GL_STATIC_DRAW);
+        // Positions, colours and uvs go into the pool interleaved
+        GLfloat interleaved[24 * 8];
+        for (int i = 0; i < 24; i++) {
+            GLfloat *vertex = &interleaved[8 * i];
+            for (int j = 0; j < 3; j++) vertex[j] = vertex_buffer_data[3 * i + j];
+            for (int j = 0; j < 3; j++) vertex[3 + j] = color_buffer_data[3 * i + j];
+            for (int j = 0; j < 2; j++) vertex[6 + j] = uv_buffer_data[2 * i + j];
+        }
+        geometry = geometryPool.allocate(SkyboxGeometryFormat(), interleaved, 24, index_buffer_data, 36);
 
-        textureID = LoadTextureTileBox("../assignment/assets/cubemap.png");
+        texture = textureStreamer.create("skybox", {"../assignment/assets/cubemap.png"}, GL_TEXTURE_2D);
         // --------------------------------------------------------
         // --------------------------------------------------------
 
-        // Create an index buffer object to store the index data that defines triangle faces
-        glGenBuffers(1, &indexBufferID);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(index_buffer_data), index_buffer_data, GL_STATIC_DRAW);
-
         // Create and compile our GLSL program from the shaders
         programID = LoadShadersFromFile("../assignment/shaders/skybox.vert",
                                         "../assignment/shaders/skybox.frag");
@@ -221,62 +214,42 @@ struct Skybox {
     void render(glm::mat4 cameraMatrix) {
         glUseProgram(programID);
 
-        glBindVertexArray(vertexArrayID);
-
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, colorBufferID);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+        geometryPool.bind(SkyboxGeometryFormat());
 
         // -----------------------
-        glm::mat4 modelMatrix = glm::mat4(1.0f);
-        // Scale the box along each axis to make it look like a building
-        modelMatrix = glm::translate(modelMatrix, pos);
-        modelMatrix = glm::scale(modelMatrix, scale);
+        // pos is moved directly with the camera, the cached matrix is only
+        // rebuilt when it actually changed
+        transform.setTranslation(pos);
+        transform.setScale(scale);
+        transform.update();
         // -----------------------
 
         // Set model-view-projection matrix
-        glm::mat4 mvp = cameraMatrix * modelMatrix;
+        glm::mat4 mvp = cameraMatrix * transform.world;
         glUniformMatrix4fv(mvpMatrixID, 1, GL_FALSE, &mvp[0][0]);
 
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBufferID);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        // The camera sits inside the box, so a face (a quarter of the
+        // texture's width) spans 2 units at distance 1 whatever the scale
+        textureStreamer.request(texture, 8.0f, 1.0f);
 
         // Set textureSampler to use texture unit 0
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        glBindTexture(GL_TEXTURE_2D, texture->textureID);
         glUniform1i(textureSamplerID, 0);
         // ------------------------------------------
         // ------------------------------------------
 
         // Draw the box
-        glDrawElements(
-                GL_TRIANGLES,      // mode
-                36,    			   // number of indices
-                GL_UNSIGNED_INT,   // type
-                (void*)0           // element array buffer offset
-        );
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        geometryPool.draw(geometry);
+        glBindVertexArray(0);
 
 
     }
 
     void cleanup() {
-        glDeleteBuffers(1, &vertexBufferID);
-        glDeleteBuffers(1, &colorBufferID);
-        glDeleteBuffers(1, &indexBufferID);
-        glDeleteVertexArrays(1, &vertexArrayID);
-        //glDeleteBuffers(1, &uvBufferID);
-        //glDeleteTextures(1, &textureID);
+        geometryPool.release(geometry);
+        textureStreamer.release(texture);
+        texture = nullptr;
         glDeleteProgram(programID);
     }
 };
\ No newline at end of file
@@ -0,0 +1,356 @@
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <math.h>
+
+#include <render/shader.h>
+
+// Procedural ground height. Fractal value noise over an integer lattice
+// hashed with splitMix64, so any point can be evaluated independently on any
+// thread and always gives the same result. Heights stay in [0, amplitude]:
+// buildings stand at y = 0 and are buried slightly rather than left floating.
+struct TerrainHeightField {
+    uint64_t seed = 7331;
+    float amplitude = 14.0f;
+    float wavelength = 900.0f;     // Of the lowest octave, in world units
+    int octaves = 4;
+
+    float lattice(int64_t x, int64_t z, int octave) const {
+        uint64_t h = CityRandom::splitMix64(seed ^ (static_cast<uint64_t>(octave) << 56));
+        h = CityRandom::splitMix64(h ^ static_cast<uint64_t>(x));
+        h = CityRandom::splitMix64(h ^ static_cast<uint64_t>(z));
+        return (h >> 40) * (1.0f / 16777216.0f);
+    }
+
+    float valueNoise(float x, float z, int octave) const {
+        float fx = floorf(x), fz = floorf(z);
+        int64_t ix = static_cast<int64_t>(fx), iz = static_cast<int64_t>(fz);
+        float tx = x - fx, tz = z - fz;
+        tx = tx * tx * (3.0f - 2.0f * tx);
+        tz = tz * tz * (3.0f - 2.0f * tz);
+        float a = lattice(ix, iz, octave), b = lattice(ix + 1, iz, octave);
+        float c = lattice(ix, iz + 1, octave), d = lattice(ix + 1, iz + 1, octave);
+        return glm::mix(glm::mix(a, b, tx), glm::mix(c, d, tx), tz);
+    }
+
+    float height(float x, float z) const {
+        float sum = 0.0f, weight = 1.0f, total = 0.0f, frequency = 1.0f / wavelength;
+        for (int i = 0; i < octaves; i++) {
+            sum += valueNoise(x * frequency, z * frequency, i) * weight;
+            total += weight;
+            weight *= 0.5f;
+            frequency *= 2.0f;
+        }
+        return amplitude * sum / total;
+    }
+};
+
+struct TerrainStats {
+    int texelsUpdated = 0;      // Height samples regenerated this frame
+    int regionsUploaded = 0;    // glTexSubImage3D calls this frame
+    int triangles = 0;          // Drawn every frame, independent of position
+    double updateMs = 0.0;
+};
+
+// Ground rendered as nested geometry clipmaps around the camera. Every level
+// is the same GRID x GRID quad grid at twice the spacing of the one inside
+// it; level 0 is a full grid and the others are rings whose hole the next
+// finer level fills. Two meshes (full and ring) are shared by all levels and
+// displaced in the vertex shader from one height texture layer per level.
+//
+// Height layers are toroidal: texel (x, z) of a level lives at (x, z) mod
+// TEXTURE_SIZE, so when the clipmap moves only the rows and columns that
+// became visible are generated (on the job system) and uploaded.
+struct ClipmapTerrain {
+    static const int LEVELS = 5;
+    static const int GRID = 64;                     // Quads per side of every level
+    static const int WINDOW = GRID + 3;             // Texels needed per side, one extra each side for normals
+    static const int TEXTURE_SIZE = 128;            // Power of two >= WINDOW
+    static constexpr float BASE_SPACING = 8.0f;     // Vertex spacing of level 0
+
+    struct Level {
+        float spacing;
+        glm::ivec2 originTexel;     // Texel under grid vertex (0, 0)
+        glm::ivec2 windowStart;     // First texel currently valid in the layer
+        bool valid = false;
+    };
+
+    // A rectangle of one level's texels to regenerate, in texel coordinates
+    struct HeightRegion {
+        int level;
+        glm::ivec2 start;
+        glm::ivec2 size;
+        std::vector<float> heights;
+    };
+
+    TerrainHeightField field;
+    Level levels[LEVELS];
+    TerrainStats stats;
+    glm::vec3 lightPosition, lightIntensity;
+    JobSystem* jobs = nullptr;
+    std::vector<HeightRegion> regions;
+
+    GLuint fullVertexArrayID, fullVertexBufferID, fullIndexBufferID;
+    GLuint ringVertexArrayID, ringVertexBufferID, ringIndexBufferID;
+    GLsizei fullIndexCount = 0, ringIndexCount = 0;
+    GLuint heightTextureID, programID;
+    StreamedTexture *texture = nullptr;
+    GLuint vpMatrixID, originTexelID, spacingID, levelID, heightSamplerID, textureSamplerID;
+    GLuint lightPositionID, lightIntensityID;
+
+    void initialize(const glm::vec3& __lightPosition, const glm::vec3& __lightIntensity, JobSystem& jobSystem) {
+        lightPosition = __lightPosition;
+        lightIntensity = __lightIntensity;
+        jobs = &jobSystem;
+        for (int i = 0; i < LEVELS; i++) {
+            levels[i].spacing = BASE_SPACING * float(1 << i);
+        }
+
+        fullIndexCount = createGrid(false, fullVertexArrayID, fullVertexBufferID, fullIndexBufferID);
+        ringIndexCount = createGrid(true, ringVertexArrayID, ringVertexBufferID, ringIndexBufferID);
+        stats.triangles = (fullIndexCount + (LEVELS - 1) * ringIndexCount) / 3;
+
+        glGenTextures(1, &heightTextureID);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, heightTextureID);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, TEXTURE_SIZE, TEXTURE_SIZE, LEVELS, 0, GL_RED, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        memoryTracker.trackTexture("terrain", heightTextureID, TextureBytes(TEXTURE_SIZE, TEXTURE_SIZE, 4, false) * LEVELS);
+
+        texture = textureStreamer.create("terrain", {"../assignment/assets/floor.jpg"}, GL_TEXTURE_2D);
+
+        programID = LoadShadersFromFile("../assignment/shaders/terrain.vert",
+                                        "../assignment/shaders/terrain.frag");
+        if (programID == 0) {
+            std::cerr << "Failed to load shaders." << std::endl;
+        }
+        SetupClusteredLightingProgram(programID);
+
+        vpMatrixID = glGetUniformLocation(programID, "VP");
+        originTexelID = glGetUniformLocation(programID, "originTexel");
+        spacingID = glGetUniformLocation(programID, "spacing");
+        levelID = glGetUniformLocation(programID, "level");
+        heightSamplerID = glGetUniformLocation(programID, "heightSampler");
+        textureSamplerID = glGetUniformLocation(programID, "textureSampler");
+        lightPositionID = glGetUniformLocation(programID, "lightPosition");
+        lightIntensityID = glGetUniformLocation(programID, "lightIntensity");
+
+        GLenum errorCode = glGetError();
+        if (errorCode != 0) {
+            std::cout << "Terrain error initializing: " << errorCode << std::endl;
+        }
+    }
+
+    // Recentres the clipmap on the camera and streams in the newly exposed
+    // height strips. All levels share one centre snapped to twice the coarsest
+    // spacing, so every level's vertices stay on its own lattice and the ring
+    // holes line up exactly with the next finer level.
+    void update(const glm::vec3& cameraPos) {
+        auto start = std::chrono::steady_clock::now();
+        // The floor texture repeats every 100 units and is closest straight below
+        textureStreamer.request(texture, 100.0f, cameraPos.y - field.height(cameraPos.x, cameraPos.z));
+        float step = 2.0f * levels[LEVELS - 1].spacing;
+        glm::vec2 center = glm::floor(glm::vec2(cameraPos.x, cameraPos.z) / step + 0.5f) * step;
+
+        regions.clear();
+        for (int i = 0; i < LEVELS; i++) {
+            Level& level = levels[i];
+            level.originTexel = glm::ivec2(glm::round(center / level.spacing)) - GRID / 2;
+            glm::ivec2 newStart = level.originTexel - 1;
+            queueExposedRegions(i, newStart);
+            level.windowStart = newStart;
+            level.valid = true;
+        }
+
+        stats.texelsUpdated = 0;
+        stats.regionsUploaded = 0;
+        if (!regions.empty()) {
+            JobCounter generated;
+            for (HeightRegion& region : regions) {
+                HeightRegion* target = &region;
+                const TerrainHeightField* heights = &field;
+                float spacing = levels[region.level].spacing;
+                jobs->run([target, heights, spacing] { fillRegion(*target, *heights, spacing); }, &generated);
+            }
+            jobs->wait(generated);
+
+            glBindTexture(GL_TEXTURE_2D_ARRAY, heightTextureID);
+            for (const HeightRegion& region : regions) {
+                uploadRegion(region);
+                stats.texelsUpdated += region.size.x * region.size.y;
+            }
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+            glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+        }
+        stats.updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void render(const glm::mat4& vp) {
+        glUseProgram(programID);
+        glUniformMatrix4fv(vpMatrixID, 1, GL_FALSE, &vp[0][0]);
+        glUniform3fv(lightPositionID, 1, &lightPosition[0]);
+        glUniform3fv(lightIntensityID, 1, &lightIntensity[0]);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, heightTextureID);
+        glUniform1i(heightSamplerID, 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, texture->textureID);
+        glUniform1i(textureSamplerID, 1);
+
+        for (int i = 0; i < LEVELS; i++) {
+            glUniform2i(originTexelID, levels[i].originTexel.x, levels[i].originTexel.y);
+            glUniform1f(spacingID, levels[i].spacing);
+            glUniform1i(levelID, i);
+            if (i == 0) {
+                glBindVertexArray(fullVertexArrayID);
+                glDrawElements(GL_TRIANGLES, fullIndexCount, GL_UNSIGNED_INT, 0);
+            } else {
+                glBindVertexArray(ringVertexArrayID);
+                glDrawElements(GL_TRIANGLES, ringIndexCount, GL_UNSIGNED_INT, 0);
+            }
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+
+        GLenum errorCode = glGetError();
+        if (errorCode != 0) {
+            std::cout << "Terrain rendering: " << errorCode << std::endl;
+        }
+    }
+
+    void cleanup() {
+        for (GLuint buffer : {fullVertexBufferID, fullIndexBufferID, ringVertexBufferID, ringIndexBufferID}) {
+            memoryTracker.releaseBuffer(buffer);
+        }
+        memoryTracker.releaseTexture(heightTextureID);
+        glDeleteBuffers(1, &fullVertexBufferID);
+        glDeleteBuffers(1, &fullIndexBufferID);
+        glDeleteBuffers(1, &ringVertexBufferID);
+        glDeleteBuffers(1, &ringIndexBufferID);
+        glDeleteVertexArrays(1, &fullVertexArrayID);
+        glDeleteVertexArrays(1, &ringVertexArrayID);
+        glDeleteTextures(1, &heightTextureID);
+        textureStreamer.release(texture);
+        texture = nullptr;
+        glDeleteProgram(programID);
+        for (Level& level : levels) {
+            level.valid = false;
+        }
+    }
+
+private:
+    // Vertices are integer grid coordinates, the shader places them in the world.
+    // A ring leaves out the middle half, where the next finer level goes.
+    GLsizei createGrid(bool ring, GLuint& vertexArrayID, GLuint& vertexBufferID, GLuint& indexBufferID) {
+        std::vector<GLfloat> vertices;
+        for (int z = 0; z <= GRID; z++) {
+            for (int x = 0; x <= GRID; x++) {
+                vertices.push_back(float(x));
+                vertices.push_back(float(z));
+            }
+        }
+
+        std::vector<GLuint> indices;
+        for (int z = 0; z < GRID; z++) {
+            for (int x = 0; x < GRID; x++) {
+                bool inHole = x >= GRID / 4 && x < 3 * GRID / 4 && z >= GRID / 4 && z < 3 * GRID / 4;
+                if (ring && inHole) continue;
+                GLuint i0 = z * (GRID + 1) + x;
+                GLuint i1 = i0 + 1;
+                GLuint i2 = i0 + (GRID + 1);
+                GLuint i3 = i2 + 1;
+                indices.insert(indices.end(), {i0, i2, i1, i1, i2, i3});
+            }
+        }
+
+        glGenVertexArrays(1, &vertexArrayID);
+        glBindVertexArray(vertexArrayID);
+
+        glGenBuffers(1, &vertexBufferID);
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBufferID);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+        memoryTracker.trackBuffer("terrain", vertexBufferID, vertices.size() * sizeof(GLfloat));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glGenBuffers(1, &indexBufferID);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBufferID);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+        memoryTracker.trackBuffer("terrain", indexBufferID, indices.size() * sizeof(GLuint));
+
+        glBindVertexArray(0);
+        return static_cast<GLsizei>(indices.size());
+    }
+
+    // Queues the part of the new window that the old window didn't cover: a
+    // column strip and a row strip after a small move, the whole window after
+    // a jump or on the first update
+    void queueExposedRegions(int level, const glm::ivec2& newStart) {
+        const Level& current = levels[level];
+        glm::ivec2 delta = newStart - current.windowStart;
+        if (!current.valid || abs(delta.x) >= WINDOW || abs(delta.y) >= WINDOW) {
+            queueRegion(level, newStart, glm::ivec2(WINDOW));
+            return;
+        }
+        if (delta.x > 0) {
+            queueRegion(level, glm::ivec2(current.windowStart.x + WINDOW, newStart.y), glm::ivec2(delta.x, WINDOW));
+        } else if (delta.x < 0) {
+            queueRegion(level, newStart, glm::ivec2(-delta.x, WINDOW));
+        }
+        if (delta.y > 0) {
+            queueRegion(level, glm::ivec2(newStart.x, current.windowStart.y + WINDOW), glm::ivec2(WINDOW, delta.y));
+        } else if (delta.y < 0) {
+            queueRegion(level, newStart, glm::ivec2(WINDOW, -delta.y));
+        }
+    }
+
+    void queueRegion(int level, const glm::ivec2& start, const glm::ivec2& size) {
+        HeightRegion region;
+        region.level = level;
+        region.start = start;
+        region.size = size;
+        regions.push_back(std::move(region));
+    }
+
+    static void fillRegion(HeightRegion& region, const TerrainHeightField& field, float spacing) {
+        region.heights.resize(region.size.x * region.size.y);
+        for (int z = 0; z < region.size.y; z++) {
+            for (int x = 0; x < region.size.x; x++) {
+                float worldX = (region.start.x + x) * spacing;
+                float worldZ = (region.start.y + z) * spacing;
+                region.heights[z * region.size.x + x] = field.height(worldX, worldZ);
+            }
+        }
+    }
+
+    static int wrap(int texel) {
+        return texel & (TEXTURE_SIZE - 1);
+    }
+
+    // A region can straddle the texture's edges, in which case it is split
+    // into up to four uploads
+    void uploadRegion(const HeightRegion& region) {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, region.size.x);
+        for (int z = 0; z < region.size.y;) {
+            int zTexel = wrap(region.start.y + z);
+            int rows = glm::min(region.size.y - z, TEXTURE_SIZE - zTexel);
+            for (int x = 0; x < region.size.x;) {
+                int xTexel = wrap(region.start.x + x);
+                int columns = glm::min(region.size.x - x, TEXTURE_SIZE - xTexel);
+                glPixelStorei(GL_UNPACK_SKIP_PIXELS, x);
+                glPixelStorei(GL_UNPACK_SKIP_ROWS, z);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, xTexel, zTexel, region.level, columns, rows, 1,
+                                GL_RED, GL_FLOAT, region.heights.data());
+                stats.regionsUploaded++;
+                x += columns;
+            }
+            z += rows;
+        }
+    }
+};
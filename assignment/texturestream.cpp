@@ -0,0 +1,487 @@
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+#include <stb/stb_image.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <math.h>
+
+// Resamples one axis of a float RGB image: a box filter over the source
+// footprint where it shrinks, linear interpolation where it grows.
+// Strides are in pixels.
+static void ResampleAxis(const float *src, int srcCount, int srcStride, float *dst, int dstCount, int dstStride) {
+    float scale = float(srcCount) / float(dstCount);
+    for (int i = 0; i < dstCount; i++) {
+        float sum[3] = {0.0f, 0.0f, 0.0f};
+        if (scale > 1.0f) {
+            float begin = i * scale, end = (i + 1) * scale;
+            for (int j = int(begin); j < srcCount && j < end; j++) {
+                float weight = glm::min(end, float(j + 1)) - glm::max(begin, float(j));
+                for (int c = 0; c < 3; c++) sum[c] += src[j * srcStride * 3 + c] * weight;
+            }
+            for (int c = 0; c < 3; c++) sum[c] /= scale;
+        } else {
+            float x = glm::clamp((i + 0.5f) * scale - 0.5f, 0.0f, float(srcCount - 1));
+            int j = int(x);
+            int next = glm::min(j + 1, srcCount - 1);
+            float t = x - j;
+            for (int c = 0; c < 3; c++) sum[c] = src[j * srcStride * 3 + c] * (1.0f - t) + src[next * srcStride * 3 + c] * t;
+        }
+        for (int c = 0; c < 3; c++) dst[i * dstStride * 3 + c] = sum[c];
+    }
+}
+
+// RGB8 image to width x height, columns first then rows
+static void ResizeRgb(const uint8_t *src, int srcWidth, int srcHeight, uint8_t *dst, int width, int height) {
+    std::vector<float> source(src, src + size_t(srcWidth) * srcHeight * 3);
+    std::vector<float> columns(size_t(width) * srcHeight * 3);
+    for (int y = 0; y < srcHeight; y++) {
+        ResampleAxis(&source[size_t(y) * srcWidth * 3], srcWidth, 1, &columns[size_t(y) * width * 3], width, 1);
+    }
+    std::vector<float> rows(size_t(width) * height * 3);
+    for (int x = 0; x < width; x++) {
+        ResampleAxis(&columns[size_t(x) * 3], srcHeight, width, &rows[size_t(x) * 3], height, width);
+    }
+    for (size_t i = 0; i < rows.size(); i++) dst[i] = static_cast<uint8_t>(glm::clamp(rows[i] + 0.5f, 0.0f, 255.0f));
+}
+
+// Next mip level of an RGB8 image, each texel the average of a 2x2 block. On
+// an odd edge the last row or column is averaged with itself.
+static void DownsampleRgb(const uint8_t *src, int width, int height, uint8_t *dst) {
+    int dstWidth = glm::max(1, width / 2), dstHeight = glm::max(1, height / 2);
+    for (int y = 0; y < dstHeight; y++) {
+        const uint8_t *row0 = &src[size_t(glm::min(2 * y, height - 1)) * width * 3];
+        const uint8_t *row1 = &src[size_t(glm::min(2 * y + 1, height - 1)) * width * 3];
+        for (int x = 0; x < dstWidth; x++) {
+            int x0 = glm::min(2 * x, width - 1) * 3, x1 = glm::min(2 * x + 1, width - 1) * 3;
+            uint8_t *out = &dst[(size_t(y) * dstWidth + x) * 3];
+            for (int c = 0; c < 3; c++) {
+                out[c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+            }
+        }
+    }
+}
+
+static int MipLevelCount(int width, int height) {
+    int levels = 1;
+    while (glm::max(width, height) >> levels) levels++;
+    return levels;
+}
+
+// Decodes every layer into one RGB8 block of width x height x layers. A zero
+// size takes the first image's, layers of another size are resampled and
+// layers that fail to decode are left mid-grey. With preloaded set, images the
+// startup preloader already decoded are taken from it (GL thread only).
+// Returns false if no layer decoded.
+static bool DecodeLayers(const std::vector<std::string> &paths, bool preloaded, int &width, int &height,
+                         std::vector<uint8_t> &pixels) {
+    bool decodedAny = false;
+    for (size_t layer = 0; layer < paths.size(); layer++) {
+        const char *path = paths[layer].c_str();
+        int w, h, channels;
+        uint8_t* img = nullptr;
+        if (!preloaded || !activePreloader || !activePreloader->takeImage(path, img, w, h)) {
+            AssetView file;
+            if (assetFiles.view(path, file)) {
+                img = stbi_load_from_memory(file.data, static_cast<int>(file.size), &w, &h, &channels, 3);
+            }
+        }
+        if (img && width == 0) {
+            width = w;
+            height = h;
+        }
+        if (width == 0) {
+            // Nothing to size the texture by yet, a single grey texel
+            width = height = 1;
+        }
+        if (pixels.empty()) pixels.resize(size_t(width) * height * 3 * paths.size());
+
+        uint8_t *dst = &pixels[size_t(width) * height * 3 * layer];
+        size_t layerBytes = size_t(width) * height * 3;
+        if (img && w == width && h == height) {
+            std::copy(img, img + layerBytes, dst);
+        } else if (img) {
+            ResizeRgb(img, w, h, dst, width, height);
+        } else {
+            std::cout << "Failed to load texture " << path << std::endl;
+            std::fill(dst, dst + layerBytes, 128);
+        }
+        decodedAny = decodedAny || img != nullptr;
+        stbi_image_free(img);
+    }
+    return decodedAny;
+}
+
+// One texture whose finer mip levels are streamed in on demand. Levels
+// [residentLevel, levelCount) are on the GPU and the texture's base level is
+// residentLevel, so sampling never reaches a level that is not there.
+struct StreamedTexture {
+    std::string name;                   // Memory tracker tag and report label
+    std::vector<std::string> paths;     // One per layer
+    GLenum target = GL_TEXTURE_2D;      // GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+    GLuint textureID = 0;
+    int width = 1, height = 1, layers = 1;
+    int levelCount = 1;
+    int coarseLevel = 0;        // Always resident, loaded with the texture
+    int finestLevel = 0;        // Raised when a streaming load fails, so it is not retried
+    int residentLevel = 0;
+    int wantedLevel = 0;        // From the last update's requests
+    int requestedLevel = 0;     // Finest level asked for since the last update
+    unsigned long lastFullyUsed = 0;    // Last update that needed every resident level
+
+    // In-flight load of levels [loadLevel, residentLevel), filled in by a job
+    JobCounter loading;
+    bool loadPending = false;
+    bool loadFailed = false;
+    int loadLevel = 0;
+    std::vector<std::vector<uint8_t>> loadedLevels;
+    std::chrono::steady_clock::time_point loadStart;
+
+    size_t residentBytes = 0;
+    unsigned long loads = 0, evictions = 0;
+    double lastLatencyMs = 0.0, totalLatencyMs = 0.0, maxLatencyMs = 0.0;
+
+    int levelWidth(int level) const { return glm::max(1, width >> level); }
+    int levelHeight(int level) const { return glm::max(1, height >> level); }
+
+    size_t levelBytes(int level) const {
+        return size_t(levelWidth(level)) * levelHeight(level) * 3 * layers;
+    }
+
+    size_t levelRangeBytes(int first, int end) const {
+        size_t bytes = 0;
+        for (int level = first; level < end; level++) bytes += levelBytes(level);
+        return bytes;
+    }
+};
+
+// Mip-level texture streaming. Textures are created with only their levels of
+// up to COARSE_SIZE texels resident. Every frame their users report how large
+// one repeat of the texture appears on screen with request(), and update()
+// turns that into the finest level worth having: finer levels are decoded and
+// filtered on the job system and uploaded on the GL thread once ready, and
+// while the resident total is over the budget, levels finer than any user
+// currently needs are dropped, longest unneeded first.
+class TextureStreamer {
+public:
+    static const int COARSE_SIZE = 64;
+
+    size_t budgetBytes = size_t(96) * 1024 * 1024;
+
+    void initialize(JobSystem &jobSystem, size_t budgetMB) {
+        jobs = &jobSystem;
+        budgetBytes = budgetMB * 1024 * 1024;
+    }
+
+    // Loads the coarse levels now, from the preloader if it has the images.
+    // size resamples every layer to size x size, 0 keeps the first image's size.
+    StreamedTexture *create(const char *name, const std::vector<std::string> &paths, GLenum target, int size = 0) {
+        textures.emplace_back(new StreamedTexture());
+        StreamedTexture &texture = *textures.back();
+        texture.name = name;
+        texture.paths = paths;
+        texture.target = target;
+        texture.layers = static_cast<int>(paths.size());
+
+        int width = size, height = size;
+        std::vector<uint8_t> pixels;
+        bool decoded = DecodeLayers(paths, true, width, height, pixels);
+        texture.width = width;
+        texture.height = height;
+        texture.levelCount = MipLevelCount(width, height);
+        texture.coarseLevel = 0;
+        while (texture.coarseLevel < texture.levelCount - 1 &&
+               glm::max(texture.levelWidth(texture.coarseLevel), texture.levelHeight(texture.coarseLevel)) > COARSE_SIZE) {
+            texture.coarseLevel++;
+        }
+        texture.finestLevel = decoded ? 0 : texture.coarseLevel;
+        texture.residentLevel = texture.wantedLevel = texture.requestedLevel = texture.coarseLevel;
+
+        for (const std::string &path : paths) {
+            if (activePreloader) activePreloader->beginUpload(path);
+        }
+        glGenTextures(1, &texture.textureID);
+        glBindTexture(target, texture.textureID);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, texture.levelCount - 1);
+
+        std::vector<std::vector<uint8_t>> levels;
+        BuildLevels(pixels, texture, texture.coarseLevel, texture.levelCount, levels);
+        pixels = std::vector<uint8_t>();
+        uploadLevels(texture, texture.coarseLevel, levels);
+        for (const std::string &path : paths) {
+            if (activePreloader) activePreloader->endUpload(path);
+        }
+
+        GLenum errorCode = glGetError();
+        if (errorCode != 0) {
+            std::cout << "Streamed texture " << name << " error: " << errorCode << std::endl;
+        }
+        return textures.back().get();
+    }
+
+    // Projection and viewport the coming frame's requests are measured against
+    void setView(const glm::mat4 &projection, int viewportHeight) {
+        pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+    }
+
+    // One repeat of the texture's width spans span world units on a surface
+    // distance away from the camera. Called by users while they draw.
+    void request(StreamedTexture *texture, float span, float distance) {
+        float pixels = span * pixelsPerUnit / glm::max(distance, 1e-3f);
+        float level = log2f(float(texture->width) / glm::max(pixels, 1e-3f));
+        int wanted = glm::clamp(static_cast<int>(floorf(level)), texture->finestLevel, texture->coarseLevel);
+        texture->requestedLevel = glm::min(texture->requestedLevel, wanted);
+    }
+
+    // Once per frame on the GL thread after everything has drawn
+    void update() {
+        frame++;
+        for (auto &texture : textures) {
+            if (texture->loadPending && texture->loading.done()) finishLoad(*texture);
+        }
+        for (auto &texture : textures) {
+            texture->wantedLevel = texture->requestedLevel;
+            texture->requestedLevel = texture->coarseLevel;
+            if (texture->wantedLevel <= texture->residentLevel) texture->lastFullyUsed = frame;
+        }
+        if (!jobs) return;
+
+        while (residentBytes() + pendingBytes > budgetBytes && evictUnneeded(nullptr)) {}
+
+        // Biggest shortfall first, so one texture cannot starve the others of budget
+        std::vector<StreamedTexture *> order;
+        for (auto &texture : textures) {
+            if (!texture->loadPending && texture->wantedLevel < texture->residentLevel) order.push_back(texture.get());
+        }
+        std::sort(order.begin(), order.end(), [](const StreamedTexture *a, const StreamedTexture *b) {
+            return a->residentLevel - a->wantedLevel > b->residentLevel - b->wantedLevel;
+        });
+        // Settle for a coarser level if even evicting everything unneeded
+        // would not make room for the wanted one
+        for (StreamedTexture *texture : order) {
+            size_t available = budgetBytes + unneededBytes(texture);
+            int level = texture->wantedLevel;
+            while (level < texture->residentLevel &&
+                   residentBytes() + pendingBytes + texture->levelRangeBytes(level, texture->residentLevel) > available) {
+                level++;
+            }
+            if (level == texture->residentLevel) continue;
+            size_t bytes = texture->levelRangeBytes(level, texture->residentLevel);
+            while (residentBytes() + pendingBytes + bytes > budgetBytes && evictUnneeded(texture)) {}
+            startLoad(*texture, level);
+        }
+    }
+
+    size_t residentBytes() const {
+        size_t bytes = 0;
+        for (const auto &texture : textures) bytes += texture->residentBytes;
+        return bytes;
+    }
+
+    int loadsInFlight() const {
+        int count = 0;
+        for (const auto &texture : textures) count += texture->loadPending ? 1 : 0;
+        return count;
+    }
+
+    // Latency of streaming loads from request to upload, over every texture
+    double averageLatencyMs() const {
+        double total = 0.0;
+        unsigned long loads = 0;
+        for (const auto &texture : textures) {
+            total += texture->totalLatencyMs;
+            loads += texture->loads;
+        }
+        return loads > 0 ? total / loads : 0.0;
+    }
+
+    void print(std::ostream &out) const {
+        out << std::fixed << std::setprecision(2);
+        out << "Texture streaming: " << mb(residentBytes()) << " MB resident of " << mb(budgetBytes)
+            << " MB budget, " << loadsInFlight() << " loads in flight" << std::endl;
+        for (const auto &texture : textures) {
+            out << "  " << std::left << std::setw(10) << texture->name << std::right
+                << std::setw(5) << texture->width << "x" << texture->height;
+            if (texture->layers > 1) out << "x" << texture->layers;
+            out << ": level " << texture->residentLevel << " of " << texture->levelCount - 1
+                << " resident (wanted " << texture->wantedLevel << "), " << mb(texture->residentBytes) << " MB, "
+                << texture->loads << " loads, " << texture->evictions << " evictions";
+            if (texture->loads > 0) {
+                out << ", latency avg " << texture->totalLatencyMs / texture->loads << " ms, max "
+                    << texture->maxLatencyMs << " ms";
+            }
+            out << std::endl;
+        }
+    }
+
+    // Waits for the texture's load, if any, and deletes it
+    void release(StreamedTexture *texture) {
+        if (!texture) return;
+        for (size_t i = 0; i < textures.size(); i++) {
+            if (textures[i].get() != texture) continue;
+            if (texture->loadPending) {
+                jobs->wait(texture->loading);
+                pendingBytes -= texture->levelRangeBytes(texture->loadLevel, texture->residentLevel);
+            }
+            memoryTracker.releaseTexture(texture->textureID);
+            glDeleteTextures(1, &texture->textureID);
+            textures.erase(textures.begin() + i);
+            return;
+        }
+    }
+
+    void cleanup() {
+        while (!textures.empty()) release(textures.back().get());
+    }
+
+private:
+    JobSystem *jobs = nullptr;
+    std::vector<std::unique_ptr<StreamedTexture>> textures;
+    float pixelsPerUnit = 1.0f;     // Screen pixels of one world unit at distance 1
+    size_t pendingBytes = 0;        // Reserved by loads in flight
+    unsigned long frame = 0;
+
+    static double mb(size_t bytes) {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    static double elapsedMs(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    // Levels [first, end) of the texture from its level 0 pixels, every
+    // level holding all layers back to back
+    static void BuildLevels(const std::vector<uint8_t> &pixels, const StreamedTexture &texture, int first, int end,
+                            std::vector<std::vector<uint8_t>> &levels) {
+        levels.resize(end - first);
+        std::vector<uint8_t> current, next;
+        for (int layer = 0; layer < texture.layers; layer++) {
+            size_t layerBytes = size_t(texture.width) * texture.height * 3;
+            current.assign(pixels.begin() + layerBytes * layer, pixels.begin() + layerBytes * (layer + 1));
+            for (int level = 0; level < end; level++) {
+                if (level > 0) {
+                    next.resize(size_t(texture.levelWidth(level)) * texture.levelHeight(level) * 3);
+                    DownsampleRgb(current.data(), texture.levelWidth(level - 1), texture.levelHeight(level - 1), next.data());
+                    current.swap(next);
+                }
+                if (level >= first) {
+                    levels[level - first].insert(levels[level - first].end(), current.begin(), current.end());
+                }
+            }
+        }
+    }
+
+    // Uploads levels[i] as level first + i, finest last, and makes first the
+    // base level
+    void uploadLevels(StreamedTexture &texture, int first, const std::vector<std::vector<uint8_t>> &levels) {
+        glBindTexture(texture.target, texture.textureID);
+        // Small levels have rows that are not a multiple of four bytes
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int i = static_cast<int>(levels.size()) - 1; i >= 0; i--) {
+            specifyLevel(texture, first + i, levels[i].data());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(texture.target, GL_TEXTURE_BASE_LEVEL, first);
+        texture.residentLevel = first;
+        texture.residentBytes = texture.levelRangeBytes(first, texture.levelCount);
+        memoryTracker.trackTexture(texture.name.c_str(), texture.textureID, texture.residentBytes);
+    }
+
+    // NULL pixels with a zero size frees the level's storage
+    static void specifyLevel(const StreamedTexture &texture, int level, const uint8_t *pixels) {
+        int width = pixels ? texture.levelWidth(level) : 0;
+        int height = pixels ? texture.levelHeight(level) : 0;
+        if (texture.target == GL_TEXTURE_2D_ARRAY) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGB, width, height, pixels ? texture.layers : 0, 0,
+                         GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+        }
+    }
+
+    void startLoad(StreamedTexture &texture, int level) {
+        texture.loadPending = true;
+        texture.loadFailed = false;
+        texture.loadLevel = level;
+        texture.loadStart = std::chrono::steady_clock::now();
+        pendingBytes += texture.levelRangeBytes(level, texture.residentLevel);
+        StreamedTexture *target = &texture;
+        int end = texture.residentLevel;
+        jobs->run([target, level, end] {
+            int width = target->width, height = target->height;
+            std::vector<uint8_t> pixels;
+            if (!DecodeLayers(target->paths, false, width, height, pixels)) {
+                target->loadFailed = true;
+                return;
+            }
+            BuildLevels(pixels, *target, level, end, target->loadedLevels);
+        }, &texture.loading);
+    }
+
+    void finishLoad(StreamedTexture &texture) {
+        texture.loadPending = false;
+        pendingBytes -= texture.levelRangeBytes(texture.loadLevel, texture.residentLevel);
+        if (texture.loadFailed) {
+            std::cout << "Streaming " << texture.name << " level " << texture.loadLevel
+                      << " failed, keeping level " << texture.residentLevel << std::endl;
+            texture.finestLevel = texture.residentLevel;
+        } else {
+            uploadLevels(texture, texture.loadLevel, texture.loadedLevels);
+            texture.lastLatencyMs = elapsedMs(texture.loadStart);
+            texture.totalLatencyMs += texture.lastLatencyMs;
+            texture.maxLatencyMs = glm::max(texture.maxLatencyMs, texture.lastLatencyMs);
+            texture.loads++;
+        }
+        texture.loadedLevels = std::vector<std::vector<uint8_t>>();
+
+        GLenum errorCode = glGetError();
+        if (errorCode != 0) {
+            std::cout << "Streamed texture " << texture.name << " upload error: " << errorCode << std::endl;
+        }
+    }
+
+    // Resident bytes finer than their texture's users need, other than except's
+    size_t unneededBytes(const StreamedTexture *except) const {
+        size_t bytes = 0;
+        for (const auto &texture : textures) {
+            if (texture.get() == except || texture->loadPending) continue;
+            if (texture->residentLevel < texture->wantedLevel) {
+                bytes += texture->levelRangeBytes(texture->residentLevel, texture->wantedLevel);
+            }
+        }
+        return bytes;
+    }
+
+    // Drops the finest level of the texture, other than except, that has gone
+    // unneeded the longest. Returns false if every resident level is in use.
+    bool evictUnneeded(const StreamedTexture *except) {
+        StreamedTexture *victim = nullptr;
+        for (auto &texture : textures) {
+            if (texture.get() == except || texture->loadPending) continue;
+            if (texture->residentLevel >= texture->wantedLevel) continue;
+            if (!victim || texture->lastFullyUsed < victim->lastFullyUsed) victim = texture.get();
+        }
+        if (!victim) return false;
+
+        int level = victim->residentLevel;
+        glBindTexture(victim->target, victim->textureID);
+        glTexParameteri(victim->target, GL_TEXTURE_BASE_LEVEL, level + 1);
+        specifyLevel(*victim, level, NULL);
+        victim->residentLevel = level + 1;
+        victim->residentBytes -= victim->levelBytes(level);
+        victim->evictions++;
+        memoryTracker.trackTexture(victim->name.c_str(), victim->textureID, victim->residentBytes);
+        return true;
+    }
+};
+
+static TextureStreamer textureStreamer;
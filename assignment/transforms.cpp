@@ -0,0 +1,201 @@
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <chrono>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFORMS_SSE2 1
+#endif
+
+struct TransformStats {
+    int instances = 0;
+    double updateMs = 0.0;
+
+    double transformsPerSecond() const {
+        return updateMs > 0.0 ? instances / (updateMs / 1000.0) : 0.0;
+    }
+};
+
+// Animated transforms for many instances, stored as structure-of-arrays so
+// four instances are evaluated per SSE2 step. Each instance has a base
+// position, yaw and scale plus a sinusoidal curve:
+//   position = origin + base + axis * amplitude * sin(frequency * t + phase)
+//   yaw      = yaw + spin * t
+// update() writes T * Ry(yaw) * S for every instance into one contiguous
+// matrix array that can go straight into an instance buffer. Large counts are
+// split into blocks on the job system.
+class TransformSystem {
+public:
+    static const int BLOCK_SIZE = 1024;     // Instances per job, a multiple of 4
+
+    bool useSimd = true;
+    glm::vec3 origin = glm::vec3(0.0f);     // Added to every position, e.g. to follow the camera
+    TransformStats stats;
+
+    int add(const glm::vec3& position, float yaw, const glm::vec3& scale) {
+        baseX.push_back(position.x);
+        baseY.push_back(position.y);
+        baseZ.push_back(position.z);
+        yaw0.push_back(yaw);
+        spin.push_back(0.0f);
+        scaleX.push_back(scale.x);
+        scaleY.push_back(scale.y);
+        scaleZ.push_back(scale.z);
+        axisX.push_back(0.0f);
+        axisY.push_back(0.0f);
+        axisZ.push_back(0.0f);
+        frequency.push_back(0.0f);
+        phase.push_back(0.0f);
+
+        count++;
+        matrices.resize(count);
+        return static_cast<int>(count) - 1;
+    }
+
+    // axis is scaled by amplitude, so it need not be normalised
+    void setOscillation(int instance, const glm::vec3& axis, float amplitude, float frequencyRadians, float phaseRadians) {
+        axisX[instance] = axis.x * amplitude;
+        axisY[instance] = axis.y * amplitude;
+        axisZ[instance] = axis.z * amplitude;
+        frequency[instance] = frequencyRadians;
+        phase[instance] = phaseRadians;
+    }
+
+    void setSpin(int instance, float radiansPerSecond) {
+        spin[instance] = radiansPerSecond;
+    }
+
+    int size() const {
+        return static_cast<int>(count);
+    }
+
+    void clear() {
+        for (std::vector<float>* array : {&baseX, &baseY, &baseZ, &yaw0, &spin, &scaleX, &scaleY, &scaleZ,
+                                          &axisX, &axisY, &axisZ, &frequency, &phase}) {
+            array->clear();
+        }
+        matrices.clear();
+        count = 0;
+    }
+
+    void update(float time, JobSystem* jobs) {
+        auto start = std::chrono::steady_clock::now();
+        int blocks = static_cast<int>((count + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        if (jobs && blocks > 1) {
+            JobCounter updated;
+            jobs->parallelFor(blocks, 1, [this, time](int begin, int end) {
+                for (int block = begin; block < end; block++) updateBlock(block, time);
+            }, updated);
+            jobs->wait(updated);
+        } else {
+            for (int block = 0; block < blocks; block++) updateBlock(block, time);
+        }
+        stats.instances = static_cast<int>(count);
+        stats.updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    const std::vector<glm::mat4>& worldMatrices() const {
+        return matrices;
+    }
+
+    glm::vec3 position(int instance) const {
+        return glm::vec3(matrices[instance][3]);
+    }
+
+private:
+    size_t count = 0;
+    std::vector<float> baseX, baseY, baseZ, yaw0, spin, scaleX, scaleY, scaleZ;
+    std::vector<float> axisX, axisY, axisZ, frequency, phase;
+    std::vector<glm::mat4> matrices;
+
+    void updateBlock(int block, float time) {
+        size_t begin = size_t(block) * BLOCK_SIZE;
+        size_t end = glm::min(begin + BLOCK_SIZE, count);
+#ifdef TRANSFORMS_SSE2
+        if (useSimd) {
+            // Whole groups of four, the remainder takes the scalar path
+            size_t simdEnd = begin + ((end - begin) & ~size_t(3));
+            updateSse2(begin, simdEnd, time);
+            begin = simdEnd;
+        }
+#endif
+        for (size_t i = begin; i < end; i++) {
+            float wave = sinf(frequency[i] * time + phase[i]);
+            float yaw = yaw0[i] + spin[i] * time;
+            float c = cosf(yaw), s = sinf(yaw);
+            glm::mat4& m = matrices[i];
+            m[0] = glm::vec4(c * scaleX[i], 0.0f, -s * scaleX[i], 0.0f);
+            m[1] = glm::vec4(0.0f, scaleY[i], 0.0f, 0.0f);
+            m[2] = glm::vec4(s * scaleZ[i], 0.0f, c * scaleZ[i], 0.0f);
+            m[3] = glm::vec4(origin.x + baseX[i] + axisX[i] * wave,
+                             origin.y + baseY[i] + axisY[i] * wave,
+                             origin.z + baseZ[i] + axisZ[i] * wave, 1.0f);
+        }
+    }
+
+#ifdef TRANSFORMS_SSE2
+    // sin of four angles: reduced to [-pi, pi], folded onto [-pi/2, pi/2] and
+    // evaluated with a degree 9 odd polynomial (error below 4e-6)
+    static __m128 sin4(__m128 x) {
+        // 2pi split so turns * twoPiHigh is exact for the turn counts we see
+        const __m128 twoPiHigh = _mm_set1_ps(6.28125f), twoPiLow = _mm_set1_ps(1.9353071795864769e-3f);
+        const __m128 invTwoPi = _mm_set1_ps(0.159154943f);
+        const __m128 pi = _mm_set1_ps(3.14159265f), halfPi = _mm_set1_ps(1.57079633f);
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+
+        // x - 2pi * round(x / 2pi), rounding through the default round-to-nearest mode
+        __m128 turns = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(x, invTwoPi)));
+        x = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(turns, twoPiHigh)), _mm_mul_ps(turns, twoPiLow));
+
+        // sin(x) = sin(sign(x) * pi - x) folds |x| > pi/2 back into range
+        __m128 sign = _mm_and_ps(x, signMask);
+        __m128 folded = _mm_sub_ps(_mm_or_ps(pi, sign), x);
+        __m128 outside = _mm_cmpgt_ps(_mm_andnot_ps(signMask, x), halfPi);
+        x = _mm_or_ps(_mm_and_ps(outside, folded), _mm_andnot_ps(outside, x));
+
+        __m128 x2 = _mm_mul_ps(x, x);
+        __m128 p = _mm_set1_ps(2.7557319e-6f);
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.9841270e-4f));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(8.3333333e-3f));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.6666667e-1f));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(1.0f));
+        return _mm_mul_ps(p, x);
+    }
+
+    void updateSse2(size_t begin, size_t end, float time) {
+        const __m128 t = _mm_set1_ps(time), zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        const __m128 halfPi = _mm_set1_ps(1.57079633f);
+        const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+
+        for (size_t i = begin; i < end; i += 4) {
+            __m128 wave = sin4(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&frequency[i]), t), _mm_loadu_ps(&phase[i])));
+            __m128 yaw = _mm_add_ps(_mm_loadu_ps(&yaw0[i]), _mm_mul_ps(_mm_loadu_ps(&spin[i]), t));
+            __m128 s = sin4(yaw), c = sin4(_mm_add_ps(yaw, halfPi));
+            __m128 sx = _mm_loadu_ps(&scaleX[i]), sy = _mm_loadu_ps(&scaleY[i]), sz = _mm_loadu_ps(&scaleZ[i]);
+
+            // Rows of the four matrices, transposed into their columns below
+            __m128 c0[4] = {_mm_mul_ps(c, sx), zero, _mm_sub_ps(zero, _mm_mul_ps(s, sx)), zero};
+            __m128 c1[4] = {zero, sy, zero, zero};
+            __m128 c2[4] = {_mm_mul_ps(s, sz), zero, _mm_mul_ps(c, sz), zero};
+            __m128 c3[4] = {_mm_add_ps(_mm_add_ps(ox, _mm_loadu_ps(&baseX[i])), _mm_mul_ps(_mm_loadu_ps(&axisX[i]), wave)),
+                            _mm_add_ps(_mm_add_ps(oy, _mm_loadu_ps(&baseY[i])), _mm_mul_ps(_mm_loadu_ps(&axisY[i]), wave)),
+                            _mm_add_ps(_mm_add_ps(oz, _mm_loadu_ps(&baseZ[i])), _mm_mul_ps(_mm_loadu_ps(&axisZ[i]), wave)),
+                            one};
+            _MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+            _MM_TRANSPOSE4_PS(c1[0], c1[1], c1[2], c1[3]);
+            _MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+            _MM_TRANSPOSE4_PS(c3[0], c3[1], c3[2], c3[3]);
+
+            for (int k = 0; k < 4; k++) {
+                float* m = &matrices[i + k][0][0];
+                _mm_storeu_ps(m, c0[k]);
+                _mm_storeu_ps(m + 4, c1[k]);
+                _mm_storeu_ps(m + 8, c2[k]);
+                _mm_storeu_ps(m + 12, c3[k]);
+            }
+        }
+    }
+#endif
+};
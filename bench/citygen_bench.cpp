@@ -0,0 +1,81 @@
+// Throughput of procedural chunk generation on 1..N threads. The main thread
+// helps while waiting, so N threads means N-1 workers plus the main thread.
+// Needs no GL context, only the generator and the job system.
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+
+#include "jobs.cpp"
+#include "citygen.cpp"
+
+static const int CHUNKS_PER_RUN = 20000;
+static const int CHUNKS_PER_JOB = 64;
+
+// Hash of every generated value so runs with different thread counts can be
+// checked against each other
+static uint64_t checksum(const std::vector<ChunkLayout> &layouts) {
+    uint64_t hash = 1469598103934665603ull;
+    for (const ChunkLayout &layout : layouts) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(layout.buildings);
+        for (size_t i = 0; i < sizeof(layout.buildings); i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1337;
+    CityGenerator generator(seed);
+    unsigned int maxThreads = std::thread::hardware_concurrency();
+    if (maxThreads == 0) maxThreads = 1;
+
+    // Same seed and coordinates must always give the same chunk
+    ChunkLayout first, second;
+    generator.generate(glm::ivec2(-3, 7), first);
+    generator.generate(glm::ivec2(-3, 7), second);
+    if (std::memcmp(first.buildings, second.buildings, sizeof(first.buildings)) != 0) {
+        std::cerr << "Generation is not deterministic" << std::endl;
+        return 1;
+    }
+
+    std::vector<ChunkLayout> layouts(CHUNKS_PER_RUN);
+    uint64_t reference = 0;
+
+    std::cout << std::fixed << std::setprecision(1);
+    for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+        JobSystem jobs(threads - 1);
+
+        auto start = std::chrono::steady_clock::now();
+        JobCounter generated;
+        jobs.parallelFor(CHUNKS_PER_RUN, CHUNKS_PER_JOB, [&generator, &layouts](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                // Cover a 141x141 window of coordinates around the origin
+                glm::ivec2 coord(i % 141 - 70, i / 141 - 70);
+                generator.generate(coord, layouts[i]);
+            }
+        }, generated);
+        jobs.wait(generated);
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double chunksPerSecond = CHUNKS_PER_RUN / seconds;
+
+        uint64_t sum = checksum(layouts);
+        if (threads == 1) reference = sum;
+
+        std::cout << "threads=" << threads
+                  << " chunks/s=" << chunksPerSecond
+                  << " chunks/s/core=" << chunksPerSecond / threads
+                  << " checksum=" << std::hex << sum << std::dec
+                  << (sum == reference ? "" : " MISMATCH") << std::endl;
+
+        if (sum != reference) return 1;
+    }
+
+    return 0;
+}
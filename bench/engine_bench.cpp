@@ -0,0 +1,744 @@
+// CPU cost of the engine's hot paths without a GL context. The engine sources
+// are compiled against the mock GL in bench/mockgl, which counts calls instead
+// of issuing them, so GL-heavy code such as ChunkManager runs unchanged and
+// its GL traffic is reported next to its CPU time. Covered:
+//   chunk_update   ChunkManager::update for one-chunk moves, moves back onto
+//                  cached chunks, long jumps and a full reset of the window
+//   chunk_render   ChunkManager::render: classify, packet build and submit
+//   chunk_hash     distribution and lookup cost of the chunk cache key
+//   culling        isBuildingInView against Frustum::intersectsBox
+//   process_mesh   Model::processMesh conversion of an Assimp mesh
+//   mesh_residency resident CPU/GPU bytes of each Mesh residency policy, and
+//                  the error of restoring from the compressed copy
+//   model_import   Model::importModel of a real asset (second argument,
+//                  bugatti.obj by default), serial and on the job system
+//   depth_to_rgb   the float depth to RGB byte conversion of saveDepthTexture
+//   geometry_pool  GeometryPool allocate/release churn, the fragmentation it
+//                  leaves and what defragmenting it copies
+//   texture_stream TextureStreamer on the facade array and skybox: resident
+//                  bytes at load, while approaching the city and after turning
+//                  away under a lower budget, and the latency of mip loads
+//   asset_io       reading every asset through AssetFiles from loose files
+//                  and from a freshly written pack, cold (page cache dropped,
+//                  Linux only) and warm
+//   bvh            ray casts and sphere sweeps against ChunkManager's building
+//                  BVH over a large city, scalar and SSE2, against a brute
+//                  force check, and the BVH cost of a one-chunk move
+// Every result is one line "bench=<case> key=value ...", engine diagnostics
+// (e.g. missing textures when not run from the build directory) never start
+// with "bench=", so results can be grepped and compared between releases.
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <sstream>
+#include <cstdio>
+
+#include "jobs.cpp"
+#include "arena.cpp"
+#include "citygen.cpp"
+#include "assetpack.cpp"
+#include "assets.cpp"
+#include "memtrack.cpp"
+#include "geometrypool.cpp"
+#include "texturestream.cpp"
+#include "lightbinning.cpp"
+#include "clusteredlights.cpp"
+#include "scenegraph.cpp"
+#include "building.cpp"
+#include "animation.cpp"
+#include "model.cpp"
+#include "frustum.cpp"
+#include "bvh.cpp"
+#include "depthimage.cpp"
+#include "occlusion.cpp"
+#include "gpudriven.cpp"
+#include "chunk.cpp"
+
+static const glm::vec3 lightPosition(-50.0f, 500.0f, 0.0f);
+static const glm::vec3 lightIntensity(5.0f, 4.2f, 2.2f);
+
+static double elapsedUs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - since).count();
+}
+
+// Centre of a chunk, where the camera would be standing
+static glm::vec3 chunkCentre(const glm::ivec2 &chunk) {
+    return glm::vec3((chunk.x + 0.5f) * CityGenerator::CHUNK_WIDTH, 250.0f, (chunk.y + 0.5f) * CityGenerator::CHUNK_WIDTH);
+}
+
+// The view of the demo: 45 degrees, 1024x768, near 50 and far 3000
+static glm::mat4 viewProjection(const glm::vec3 &eye) {
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1024.0f / 768.0f, 50.0f, 3000.0f);
+    return projection * glm::lookAt(eye, eye + glm::vec3(0.0f, -50.0f, -800.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+static void reportChunkUpdates(const char *mode, int distance, int updates, double totalUs,
+                               unsigned long glCalls, unsigned long matrices, const ChunkCacheStats &cache) {
+    std::cout << "bench=chunk_update mode=" << mode
+              << " render_distance=" << distance
+              << " updates=" << updates
+              << " us_per_update=" << totalUs / updates
+              << " gl_calls_per_update=" << double(glCalls) / updates
+              << " matrices_per_update=" << double(matrices) / updates
+              << " cache_hit_rate=" << cache.hitRate() << std::endl;
+}
+
+// Moves the camera to each position in turn, one update per position
+static void benchChunkPath(const char *mode, int distance, JobSystem &jobs, const std::vector<glm::ivec2> &path) {
+    ChunkManager manager(distance, lightPosition, lightIntensity, jobs);
+    manager.update(chunkCentre(path.front()));
+
+    mockGL.reset();
+    unsigned long matricesBefore = transformCounters.recomputedTotal;
+    double totalUs = 0.0;
+    for (size_t i = 1; i < path.size(); i++) {
+        auto start = std::chrono::steady_clock::now();
+        manager.update(chunkCentre(path[i]));
+        totalUs += elapsedUs(start);
+    }
+    reportChunkUpdates(mode, distance, static_cast<int>(path.size()) - 1, totalUs, mockGL.calls,
+                       transformCounters.recomputedTotal - matricesBefore, manager.cacheStats());
+    manager.cleanup();
+}
+
+static void benchChunkUpdates(JobSystem &jobs) {
+    const int STEPS = 200;
+    for (int distance : {1, 2, 4}) {
+        std::vector<glm::ivec2> path;
+
+        // A new edge row every step
+        for (int i = 0; i <= STEPS; i++) path.push_back(glm::ivec2(i, 0));
+        benchChunkPath("incremental", distance, jobs, path);
+
+        // Back and forth over one street, the edge rows come from the cache
+        path.clear();
+        for (int i = 0; i <= STEPS; i++) path.push_back(glm::ivec2(i % 2, 0));
+        benchChunkPath("backtrack", distance, jobs, path);
+
+        // Far enough that nothing is shared with the previous window
+        path.clear();
+        for (int i = 0; i <= STEPS / 4; i++) path.push_back(glm::ivec2(i * 50, i * 17));
+        benchChunkPath("jump", distance, jobs, path);
+
+        // First update of a fresh manager: every slot is generated, its
+        // buildings placed and its BVH built. The constructor builds the facade
+        // texture array, so only chunk work is timed.
+        const int RESETS = 10;
+        double totalUs = 0.0;
+        unsigned long glCalls = 0, matrices = 0;
+        ChunkCacheStats cache;
+        for (int i = 0; i < RESETS; i++) {
+            ChunkManager manager(distance, lightPosition, lightIntensity, jobs);
+            mockGL.reset();
+            unsigned long matricesBefore = transformCounters.recomputedTotal;
+            auto start = std::chrono::steady_clock::now();
+            manager.update(chunkCentre(glm::ivec2(i * 100, 0)));
+            totalUs += elapsedUs(start);
+            glCalls += mockGL.calls;
+            matrices += transformCounters.recomputedTotal - matricesBefore;
+            cache = manager.cacheStats();
+            manager.cleanup();
+        }
+        reportChunkUpdates("reset", distance, RESETS, totalUs, glCalls, matrices, cache);
+    }
+}
+
+static void benchChunkRender(JobSystem &jobs) {
+    const int FRAMES = 200;
+    FrameArena arena;
+    for (int distance : {1, 2}) {
+        for (bool occlusion : {false, true}) {
+            ChunkManager manager(distance, lightPosition, lightIntensity, jobs);
+            manager.setFrameArena(&arena);
+            manager.occlusionEnabled = occlusion;
+            glm::vec3 eye = chunkCentre(glm::ivec2(0, 0));
+            manager.update(eye);
+            glm::mat4 vp = viewProjection(eye);
+
+            mockGL.reset();
+            double totalUs = 0.0, classifyMs = 0.0, buildMs = 0.0, submitMs = 0.0;
+            int drawn = 0, culled = 0;
+            for (int frame = 0; frame < FRAMES; frame++) {
+                arena.beginFrame();
+                auto start = std::chrono::steady_clock::now();
+                manager.render(vp, eye);
+                totalUs += elapsedUs(start);
+
+                const ChunkRenderStats &stats = manager.lastRenderStats();
+                classifyMs += stats.classifyMs;
+                buildMs += stats.buildMs;
+                submitMs += stats.submitMs;
+                drawn = stats.buildingsDrawn;
+                culled = stats.buildingsCulled;
+            }
+            std::cout << "bench=chunk_render render_distance=" << distance
+                      << " occlusion=" << (occlusion ? 1 : 0)
+                      << " frames=" << FRAMES
+                      << " us_per_frame=" << totalUs / FRAMES
+                      << " classify_us=" << classifyMs * 1000.0 / FRAMES
+                      << " build_us=" << buildMs * 1000.0 / FRAMES
+                      << " submit_us=" << submitMs * 1000.0 / FRAMES
+                      << " buildings_drawn=" << drawn
+                      << " buildings_culled=" << culled
+                      << " gl_calls_per_frame=" << double(mockGL.calls) / FRAMES
+                      << " draw_calls_per_frame=" << double(mockGL.drawCalls) / FRAMES
+                      << " texture_binds_per_frame=" << double(mockGL.textureBinds) / FRAMES << std::endl;
+            manager.cleanup();
+        }
+    }
+}
+
+// The chunk cache hashes ChunkCache::key (x in the low, z in the high 32
+// bits) with ChunkKeyHash. Reports how evenly a square of chunks
+// around the origin spreads over the buckets and what a lookup costs.
+static void benchChunkHash(uint64_t seed) {
+    for (int radius : {8, 32, 128}) {
+        std::unordered_map<uint64_t, int, ChunkKeyHash> map;
+        std::vector<glm::ivec2> coords;
+        for (int z = -radius; z < radius; z++) {
+            for (int x = -radius; x < radius; x++) {
+                coords.push_back(glm::ivec2(x, z));
+                map[ChunkCache::key(glm::ivec2(x, z))] = static_cast<int>(coords.size());
+            }
+        }
+
+        size_t occupied = 0, longest = 0;
+        for (size_t bucket = 0; bucket < map.bucket_count(); bucket++) {
+            size_t size = map.bucket_size(bucket);
+            if (size > 0) occupied++;
+            longest = std::max(longest, size);
+        }
+        // With a uniform hash a fraction exp(-load) of the buckets stays empty
+        double load = map.load_factor();
+        double emptyFraction = 1.0 - double(occupied) / map.bucket_count();
+
+        CityRandom rng(seed);
+        std::vector<uint64_t> hits, misses;
+        for (int i = 0; i < 1 << 16; i++) {
+            hits.push_back(ChunkCache::key(coords[rng.nextInt(static_cast<int>(coords.size()))]));
+            misses.push_back(ChunkCache::key(glm::ivec2(radius + rng.nextInt(1000), rng.nextInt(1000))));
+        }
+
+        const int ROUNDS = 20;
+        long long found = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int round = 0; round < ROUNDS; round++) {
+            for (uint64_t key : hits) found += map.find(key) != map.end();
+        }
+        double hitNs = elapsedUs(start) * 1000.0 / (ROUNDS * hits.size());
+        start = std::chrono::steady_clock::now();
+        for (int round = 0; round < ROUNDS; round++) {
+            for (uint64_t key : misses) found += map.find(key) != map.end();
+        }
+        double missNs = elapsedUs(start) * 1000.0 / (ROUNDS * misses.size());
+
+        std::cout << "bench=chunk_hash radius=" << radius
+                  << " keys=" << map.size()
+                  << " buckets=" << map.bucket_count()
+                  << " load_factor=" << load
+                  << " empty_buckets=" << emptyFraction
+                  << " expected_empty=" << exp(-load)
+                  << " longest_chain=" << longest
+                  << " hit_ns=" << hitNs
+                  << " miss_ns=" << missNs
+                  << " found=" << found << std::endl;
+    }
+}
+
+static void benchCulling(uint64_t seed) {
+    const int BUILDINGS = 100000;
+    const int ROUNDS = 20;
+    CityRandom rng(seed);
+    std::vector<glm::vec3> positions, scales;
+    float extent = 10.0f * CityGenerator::CHUNK_WIDTH;
+    for (int i = 0; i < BUILDINGS; i++) {
+        positions.push_back(glm::vec3(rng.range(-extent, extent), 0.0f, rng.range(-extent, extent)));
+        scales.push_back(glm::vec3(rng.range(12.0f, 60.0f), rng.range(60.0f, 500.0f), rng.range(12.0f, 60.0f)));
+    }
+    glm::mat4 vp = viewProjection(glm::vec3(0.0f, 250.0f, 800.0f));
+
+    long long pointVisible = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < BUILDINGS; i++) pointVisible += isBuildingInView(positions[i], vp);
+    }
+    double pointNs = elapsedUs(start) * 1000.0 / (ROUNDS * BUILDINGS);
+
+    long long boxVisible = 0;
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        Frustum frustum(vp);
+        for (int i = 0; i < BUILDINGS; i++) {
+            boxVisible += frustum.intersectsBox(positions[i] - scales[i], positions[i] + scales[i]);
+        }
+    }
+    double boxNs = elapsedUs(start) * 1000.0 / (ROUNDS * BUILDINGS);
+
+    std::cout << "bench=culling buildings=" << BUILDINGS
+              << " point_ns=" << pointNs
+              << " point_visible=" << pointVisible / ROUNDS
+              << " box_ns=" << boxNs
+              << " box_visible=" << boxVisible / ROUNDS << std::endl;
+}
+
+// A flat grid of side x side vertices, two triangles per cell
+static void buildGridMesh(int side, aiMesh &mesh) {
+    mesh.mNumVertices = side * side;
+    mesh.mVertices = new aiVector3D[mesh.mNumVertices];
+    mesh.mNormals = new aiVector3D[mesh.mNumVertices];
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            mesh.mVertices[z * side + x] = aiVector3D(float(x), 0.0f, float(z));
+            mesh.mNormals[z * side + x] = aiVector3D(0.0f, 1.0f, 0.0f);
+        }
+    }
+
+    mesh.mNumFaces = 2 * (side - 1) * (side - 1);
+    mesh.mFaces = new aiFace[mesh.mNumFaces];
+    unsigned int face = 0;
+    for (int z = 0; z + 1 < side; z++) {
+        for (int x = 0; x + 1 < side; x++) {
+            unsigned int corner = z * side + x;
+            unsigned int triangles[2][3] = {{corner, corner + side, corner + 1},
+                                            {corner + 1, corner + side, corner + side + 1}};
+            for (auto &triangle : triangles) {
+                mesh.mFaces[face].mNumIndices = 3;
+                mesh.mFaces[face].mIndices = new unsigned int[3]{triangle[0], triangle[1], triangle[2]};
+                face++;
+            }
+        }
+    }
+}
+
+static void benchProcessMesh() {
+    for (int side : {32, 316, 1000}) {
+        aiMesh mesh;
+        buildGridMesh(side, mesh);
+
+        int rounds = glm::max(1, 2000000 / int(mesh.mNumVertices));
+        size_t indices = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++) {
+            MeshData data;
+            Model::processMesh(&mesh, data);
+            indices += data.indices.size();
+        }
+        double totalUs = elapsedUs(start);
+
+        std::cout << "bench=process_mesh vertices=" << mesh.mNumVertices
+                  << " triangles=" << mesh.mNumFaces
+                  << " us_per_mesh=" << totalUs / rounds
+                  << " mvertices_per_s=" << mesh.mNumVertices * double(rounds) / totalUs
+                  << " indices=" << indices / rounds << std::endl;
+    }
+}
+
+static void benchMeshResidency() {
+    aiMesh mesh;
+    buildGridMesh(316, mesh);
+    MeshData source;
+    Model::processMesh(&mesh, source);
+    for (Vertex &vertex : source.vertices) vertex.Position *= 3.7f;
+
+    for (int policy = 0; policy < MESH_RESIDENCY_COUNT; policy++) {
+        MeshResidency residency = static_cast<MeshResidency>(policy);
+        ModelData data;
+        data.meshes.push_back(source);
+
+        auto start = std::chrono::steady_clock::now();
+        Model model(std::move(data), glm::vec3(0), glm::vec3(1), residency);
+        double createMs = elapsedUs(start) / 1000.0;
+        size_t cpuBytes = meshResidencyStats.cpuBytes[residency];
+        size_t gpuBytes = meshResidencyStats.gpuBytes[residency];
+
+        // Positions come back within half a quantisation step of the bounds
+        float maxError = 0.0f;
+        if (residency == MESH_COMPRESSED) {
+            std::vector<Vertex> vertices;
+            std::vector<unsigned int> indices;
+            model.meshes[0].compressed.decompress(vertices, indices);
+            for (size_t i = 0; i < vertices.size(); i++) {
+                glm::vec3 d = glm::abs(vertices[i].Position - source.vertices[i].Position);
+                maxError = glm::max(maxError, glm::max(d.x, glm::max(d.y, d.z)));
+            }
+            if (indices != source.indices) maxError = FLT_MAX;
+        }
+
+        // A lost context takes the pool's buffers with it
+        geometryPool.contextLost();
+        start = std::chrono::steady_clock::now();
+        bool restored = model.restore();
+        double restoreMs = elapsedUs(start) / 1000.0;
+
+        std::cout << "bench=mesh_residency policy=" << meshResidencyNames[residency]
+                  << " vertices=" << source.vertices.size()
+                  << " cpu_bytes=" << cpuBytes
+                  << " gpu_bytes=" << gpuBytes
+                  << " create_ms=" << createMs
+                  << " restorable=" << (restored ? 1 : 0)
+                  << " restore_ms=" << restoreMs
+                  << " max_position_error=" << maxError << std::endl;
+        model.cleanup();
+    }
+}
+
+static void benchModelImport(const std::string &path, JobSystem &jobs) {
+    for (bool parallel : {false, true}) {
+        ModelData data;
+        bool loaded = Model::importModel(path, data, parallel ? &jobs : nullptr);
+        std::cout << "bench=model_import path=" << path
+                  << " loaded=" << (loaded ? 1 : 0)
+                  << " threads=" << data.stats.threads
+                  << " meshes=" << data.stats.meshes
+                  << " vertices=" << data.stats.vertices
+                  << " read_ms=" << data.stats.readMs
+                  << " convert_ms=" << data.stats.convertMs << std::endl;
+        if (!loaded) return;
+    }
+}
+
+static void benchDepthToRgb(uint64_t seed) {
+    const int sizes[][2] = {{1024, 768}, {2048, 2048}};
+    for (const auto &size : sizes) {
+        int pixels = size[0] * size[1];
+        CityRandom rng(seed);
+        std::vector<float> depth(pixels);
+        for (float &d : depth) d = rng.nextFloat();
+        std::vector<unsigned char> rgb(pixels * 3);
+
+        const int ROUNDS = 20;
+        unsigned long checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int round = 0; round < ROUNDS; round++) {
+            ConvertDepthToRgb(depth.data(), pixels, rgb.data());
+            checksum += rgb[(round * 7919) % rgb.size()];
+        }
+        double totalUs = elapsedUs(start);
+
+        std::cout << "bench=depth_to_rgb width=" << size[0]
+                  << " height=" << size[1]
+                  << " ms_per_image=" << totalUs / 1000.0 / ROUNDS
+                  << " mpixels_per_s=" << double(pixels) * ROUNDS / totalUs
+                  << " checksum=" << checksum << std::endl;
+    }
+}
+
+// Random mesh-sized allocations, then random frees and allocations at a
+// steady fill level, like chunks and models streaming in and out
+static void benchGeometryPool(uint64_t seed) {
+    static const int format = geometryPool.registerFormat(GeometryFormat{"bench", 32, 1, {{0, 3, GL_FLOAT, false, 0}}});
+    const int LIVE = 2000;
+    const int OPS = 200000;
+    std::vector<float> vertexData(2048 * 8);
+    std::vector<GLuint> indexData(4096);
+    CityRandom rng(seed);
+
+    std::vector<GeometryHandle> live;
+    auto allocateRandom = [&]() {
+        size_t vertices = 24 + rng.nextInt(2000);
+        live.push_back(geometryPool.allocate(format, vertexData.data(), vertices, indexData.data(), vertices * 2));
+    };
+    for (int i = 0; i < LIVE; i++) allocateRandom();
+
+    mockGL.reset();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < OPS; i++) {
+        size_t victim = rng.nextInt(static_cast<int>(live.size()));
+        geometryPool.release(live[victim]);
+        live[victim] = live.back();
+        live.pop_back();
+        allocateRandom();
+    }
+    double churnUs = elapsedUs(start);
+    const GeometryPool::Arena &arena = geometryPool.arenas[format];
+    float fragmentation = arena.fragmentation();
+    unsigned long churnGrows = arena.grows;
+    unsigned long churnDefragmentations = arena.defragmentations;
+    unsigned long long churnCopied = mockGL.bytesCopied;
+
+    mockGL.reset();
+    start = std::chrono::steady_clock::now();
+    geometryPool.defragment(format);
+    double defragmentUs = elapsedUs(start);
+
+    std::cout << "bench=geometry_pool live=" << LIVE
+              << " ops=" << OPS
+              << " mops_per_s=" << OPS * 2 / churnUs
+              << " bytes_in_use=" << arena.bytesInUse()
+              << " capacity_bytes=" << arena.capacityBytes()
+              << " fragmentation=" << fragmentation
+              << " grows=" << churnGrows
+              << " defragmentations=" << churnDefragmentations
+              << " churn_bytes_copied=" << churnCopied
+              << " defragment_ms=" << defragmentUs / 1000.0
+              << " defragment_bytes_copied=" << mockGL.bytesCopied
+              << " fragmentation_after=" << arena.fragmentation() << std::endl;
+
+    for (GeometryHandle &handle : live) geometryPool.release(handle);
+}
+
+static void reportTextureStream(const char *phase, StreamedTexture *facades, StreamedTexture *sky, int frames) {
+    std::cout << "bench=texture_stream phase=" << phase
+              << " frames=" << frames
+              << " budget_mb=" << textureStreamer.budgetBytes / (1024.0 * 1024.0)
+              << " resident_mb=" << textureStreamer.residentBytes() / (1024.0 * 1024.0)
+              << " facade_level=" << facades->residentLevel
+              << " facade_mb=" << facades->residentBytes / (1024.0 * 1024.0)
+              << " skybox_level=" << sky->residentLevel
+              << " skybox_mb=" << sky->residentBytes / (1024.0 * 1024.0)
+              << " loads=" << facades->loads + sky->loads
+              << " evictions=" << facades->evictions + sky->evictions
+              << " latency_avg_ms=" << textureStreamer.averageLatencyMs()
+              << " latency_max_ms=" << glm::max(facades->maxLatencyMs, sky->maxLatencyMs)
+              << " uploaded_mb=" << mockGL.bytesUploaded / (1024.0 * 1024.0) << std::endl;
+}
+
+// Flies towards the city from 4 km out, one frame per 16 ms, then drains
+// outstanding loads. Then faces away from the city under a 24 MB budget.
+static void benchTextureStream(JobSystem &jobs) {
+    const int APPROACH_FRAMES = 120;
+    textureStreamer.initialize(jobs, 96);
+    textureStreamer.setView(glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 5000.0f), 768);
+
+    mockGL.reset();
+    StreamedTexture *facades = GetFacadeTexture();
+    StreamedTexture *sky = textureStreamer.create("skybox", {"../assignment/assets/cubemap.png"}, GL_TEXTURE_2D);
+    size_t fullChainBytes = 0;
+    for (StreamedTexture *texture : {facades, sky}) fullChainBytes += texture->levelRangeBytes(0, texture->levelCount);
+    std::cout << "bench=texture_stream phase=load full_chain_mb=" << fullChainBytes / (1024.0 * 1024.0)
+              << " resident_mb=" << textureStreamer.residentBytes() / (1024.0 * 1024.0)
+              << " uploaded_mb=" << mockGL.bytesUploaded / (1024.0 * 1024.0) << std::endl;
+
+    mockGL.reset();
+    int frames = 0;
+    for (; frames < APPROACH_FRAMES || textureStreamer.loadsInFlight() > 0; frames++) {
+        float distance = glm::max(4000.0f * (1.0f - float(frames) / APPROACH_FRAMES), 20.0f);
+        textureStreamer.request(facades, 8.0f, distance);
+        textureStreamer.request(sky, 8.0f, 1.0f);
+        textureStreamer.update();
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
+    reportTextureStream("approach", facades, sky, frames);
+
+    mockGL.reset();
+    textureStreamer.budgetBytes = size_t(24) * 1024 * 1024;
+    for (frames = 0; frames < 10; frames++) {
+        textureStreamer.request(sky, 8.0f, 1.0f);
+        textureStreamer.update();
+    }
+    reportTextureStream("turn_away", facades, sky, frames);
+
+    ReleaseFacadeTextures();
+    textureStreamer.cleanup();
+}
+
+// Asks the OS to drop a file's cached pages so the next read goes to disk
+static void dropFromPageCache(const std::string &path) {
+#if defined(__linux__)
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) return;
+    posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+    close(file);
+#else
+    (void)path;
+#endif
+}
+
+// Views every asset and reads all of its bytes, as the decoders would
+static double readAllAssets(const std::vector<std::string> &paths, uint64_t &checksum) {
+    auto start = std::chrono::steady_clock::now();
+    for (const std::string &path : paths) {
+        AssetView asset;
+        if (!assetFiles.view(path, asset)) continue;
+        for (size_t i = 0; i < asset.size; i++) checksum += asset.data[i];
+    }
+    return elapsedUs(start) / 1000.0;
+}
+
+static void benchAssetIO() {
+    const std::string packPath = "bench_assets.pak";
+    std::ostringstream packLog;
+    std::vector<std::string> sources(std::begin(AssetPackSources), std::end(AssetPackSources));
+    if (!WriteAssetPack(packPath, "../assignment", sources, packLog) || !assetFiles.openPack(packPath)) {
+        std::cout << packLog.str();
+        return;
+    }
+    std::vector<std::string> paths;
+    for (const std::string &name : assetFiles.packNames()) paths.push_back("../assignment/" + name);
+    assetFiles.closePack();
+
+    for (int packed = 0; packed < 2; packed++) {
+        for (const std::string &path : paths) dropFromPageCache(path);
+        dropFromPageCache(packPath);
+        assetFiles.resetStats();
+        uint64_t checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        if (packed) assetFiles.openPack(packPath);
+        double openMs = elapsedUs(start) / 1000.0;
+        double cold = readAllAssets(paths, checksum);
+        AssetFiles::Stats coldStats = assetFiles.snapshot();
+        double warm = readAllAssets(paths, checksum);
+        std::cout << "bench=asset_io mode=" << (packed ? "pack" : "loose")
+                  << " assets=" << paths.size()
+                  << " mb=" << (coldStats.packBytes + coldStats.looseBytes) / (1024.0 * 1024.0)
+                  << " open_ms=" << openMs
+                  << " cached_at_open=" << assetFiles.cachedFractionAtOpen()
+                  << " cold_ms=" << openMs + cold
+                  << " cold_io_ms=" << coldStats.ioMs
+                  << " warm_ms=" << warm
+                  << " file_opens=" << coldStats.looseReads + (packed ? 1 : 0)
+                  << " checksum=" << checksum << std::endl;
+        assetFiles.closePack();
+    }
+    remove(packPath.c_str());
+}
+
+// Nearest hit over every active building, to check the BVH against
+static bool bruteForceRaycast(ChunkManager &manager, const glm::ivec2 &centre, int distance, const BvhRay &ray,
+                              float maxDistance, float &nearest) {
+    bool found = false;
+    nearest = maxDistance;
+    for (int z = -distance; z <= distance; z++) {
+        for (int x = -distance; x <= distance; x++) {
+            const Chunk *chunk = manager.findChunk(centre + glm::ivec2(x, z));
+            if (!chunk) continue;
+            for (const Building &b : chunk->buildings) {
+                float t;
+                glm::vec3 normal;
+                if (RayBoxHit(ray, b.position - b.scale, b.position + b.scale, nearest, t, normal)) {
+                    nearest = t;
+                    found = true;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+static void benchBvh(uint64_t seed, JobSystem &jobs) {
+    const int DISTANCE = 12;
+    const int RAYS = 200000;
+    const int SWEEPS = 50000;
+    const int CHECKED = 2000;
+    const float MAX_DISTANCE = 3000.0f;
+
+    ChunkManager manager(DISTANCE, lightPosition, lightIntensity, jobs);
+    glm::ivec2 centre(0, 0);
+    auto start = std::chrono::steady_clock::now();
+    manager.update(chunkCentre(centre));
+    double fullUpdateMs = elapsedUs(start) / 1000.0;
+    ChunkBvhStats full = manager.spatialStats();
+
+    // Street-level camera rays scattered over the inner part of the window
+    CityRandom rng(seed);
+    float extent = (DISTANCE - 2) * CityGenerator::CHUNK_WIDTH;
+    std::vector<glm::vec3> origins, directions;
+    for (int i = 0; i < RAYS; i++) {
+        origins.push_back(chunkCentre(centre) + glm::vec3(rng.range(-extent, extent), rng.range(-230.0f, 150.0f),
+                                                           rng.range(-extent, extent)));
+        directions.push_back(glm::normalize(glm::vec3(rng.range(-1.0f, 1.0f), rng.range(-0.3f, 0.1f), rng.range(-1.0f, 1.0f))));
+    }
+
+    int mismatches = 0;
+    for (int i = 0; i < CHECKED; i++) {
+        CityHit hit;
+        float expected;
+        bool found = manager.raycast(origins[i], directions[i], MAX_DISTANCE, hit);
+        bool expectedFound = bruteForceRaycast(manager, centre, DISTANCE, BvhRay(origins[i], directions[i]),
+                                               MAX_DISTANCE, expected);
+        if (found != expectedFound || (found && fabsf(hit.distance - expected) > 1e-3f)) mismatches++;
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < CHECKED; i++) {
+        float nearest;
+        bruteForceRaycast(manager, centre, DISTANCE, BvhRay(origins[i], directions[i]), MAX_DISTANCE, nearest);
+    }
+    double bruteRaysPerSecond = CHECKED / (elapsedUs(start) / 1e6);
+
+    for (bool simd : {false, true}) {
+        manager.bvhUseSimd = simd;
+        int hits = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < RAYS; i++) {
+            CityHit hit;
+            hits += manager.raycast(origins[i], directions[i], MAX_DISTANCE, hit);
+        }
+        double raysPerSecond = RAYS / (elapsedUs(start) / 1e6);
+
+        const int BATCH = 1024;
+        JobCounter cast;
+        start = std::chrono::steady_clock::now();
+        jobs.parallelFor((RAYS + BATCH - 1) / BATCH, 1, [&](int begin, int end) {
+            for (int i = begin * BATCH; i < glm::min(end * BATCH, RAYS); i++) {
+                CityHit hit;
+                manager.raycast(origins[i], directions[i], MAX_DISTANCE, hit);
+            }
+        }, cast);
+        jobs.wait(cast);
+        double parallelRaysPerSecond = RAYS / (elapsedUs(start) / 1e6);
+
+        // Camera steps of the demo's sweep radius, ten times the key repeat step
+        float moved = 0.0f;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < SWEEPS; i++) {
+            glm::vec3 delta = directions[i] * 200.0f;
+            moved += glm::length(manager.moveSphere(origins[i], delta, 10.0f) - origins[i]);
+        }
+        double sweepsPerSecond = SWEEPS / (elapsedUs(start) / 1e6);
+
+        std::cout << "bench=bvh simd=" << (simd ? 1 : 0)
+                  << " chunks=" << full.chunks
+                  << " buildings=" << full.chunks * ChunkLayout::BUILDING_COUNT
+                  << " nodes=" << full.nodes
+                  << " rays=" << RAYS
+                  << " hit_fraction=" << double(hits) / RAYS
+                  << " rays_per_s=" << raysPerSecond
+                  << " parallel_rays_per_s=" << parallelRaysPerSecond
+                  << " brute_force_rays_per_s=" << bruteRaysPerSecond
+                  << " mismatches=" << mismatches << "/" << CHECKED
+                  << " sweeps_per_s=" << sweepsPerSecond
+                  << " mean_sweep_travel=" << moved / SWEEPS << std::endl;
+    }
+
+    // One-chunk move: only the new edge column builds chunk trees
+    start = std::chrono::steady_clock::now();
+    manager.update(chunkCentre(centre + glm::ivec2(1, 0)));
+    double stepUpdateMs = elapsedUs(start) / 1000.0;
+    const ChunkBvhStats &step = manager.spatialStats();
+    std::cout << "bench=bvh_update full_update_ms=" << fullUpdateMs
+              << " full_chunk_trees=" << full.chunkTrees
+              << " full_top_level_ms=" << full.topLevelMs
+              << " step_update_ms=" << stepUpdateMs
+              << " step_chunk_trees=" << step.chunkTrees
+              << " step_top_level_ms=" << step.topLevelMs << std::endl;
+    manager.cleanup();
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1337;
+    std::string modelPath = argc > 2 ? argv[2] : "../assignment/assets/bugatti.obj";
+    JobSystem jobs;
+
+    std::cout << std::fixed << std::setprecision(3);
+    std::cout << "bench=config threads=" << jobs.workerCount() + 1 << " seed=" << seed << std::endl;
+    benchChunkUpdates(jobs);
+    benchChunkRender(jobs);
+    benchChunkHash(seed);
+    benchCulling(seed);
+    benchProcessMesh();
+    benchMeshResidency();
+    benchModelImport(modelPath, jobs);
+    benchDepthToRgb(seed);
+    benchGeometryPool(seed);
+    benchTextureStream(jobs);
+    benchAssetIO();
+    benchBvh(seed, jobs);
+    return 0;
+}
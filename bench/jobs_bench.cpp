@@ -0,0 +1,121 @@
+// Stress test and scaling benchmark for the work-stealing job system.
+// The stress section checks that every job runs exactly once, that
+// dependencies are respected and that nested waits make progress. The scaling
+// section runs a fixed amount of work on 1..N threads (N-1 workers plus the
+// main thread helping while it waits).
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <atomic>
+#include <cmath>
+
+#include "jobs.cpp"
+
+static bool check(bool condition, const char *what) {
+    if (!condition) std::cerr << "FAILED: " << what << std::endl;
+    return condition;
+}
+
+static bool stressTest(unsigned int workers) {
+    JobSystem jobs(workers);
+    bool ok = true;
+
+    // Many tiny jobs, each must run exactly once
+    const int JOB_COUNT = 200000;
+    std::vector<std::atomic<int>> runs(JOB_COUNT);
+    for (auto &r : runs) r.store(0);
+    JobCounter all;
+    for (int i = 0; i < JOB_COUNT; i++) {
+        jobs.run([&runs, i] { runs[i].fetch_add(1, std::memory_order_relaxed); }, &all);
+    }
+    jobs.wait(all);
+    int wrong = 0;
+    for (auto &r : runs) wrong += r.load() != 1;
+    ok &= check(wrong == 0, "every job runs exactly once");
+
+    // Jobs spawning children and waiting on them from inside a worker
+    std::atomic<int> leaves(0);
+    JobCounter parents;
+    for (int i = 0; i < 64; i++) {
+        jobs.run([&jobs, &leaves] {
+            JobCounter children;
+            for (int j = 0; j < 64; j++) {
+                jobs.run([&leaves] { leaves.fetch_add(1, std::memory_order_relaxed); }, &children);
+            }
+            jobs.wait(children);
+        }, &parents);
+    }
+    jobs.wait(parents);
+    ok &= check(leaves.load() == 64 * 64, "nested waits complete");
+
+    // A chain of stages, each may only start once the previous one finished
+    const int STAGES = 50;
+    const int STAGE_WIDTH = 32;
+    std::vector<JobCounter> stages(STAGES);
+    std::vector<std::atomic<int>> finished(STAGES);
+    for (auto &f : finished) f.store(0);
+    std::atomic<int> orderViolations(0);
+    for (int s = 0; s < STAGES; s++) {
+        for (int j = 0; j < STAGE_WIDTH; j++) {
+            auto job = [&finished, &orderViolations, s] {
+                if (s > 0 && finished[s - 1].load() != STAGE_WIDTH) orderViolations.fetch_add(1);
+                finished[s].fetch_add(1);
+            };
+            if (s == 0) jobs.run(job, &stages[s]);
+            else jobs.runAfter(stages[s - 1], job, &stages[s]);
+        }
+    }
+    jobs.wait(stages[STAGES - 1]);
+    ok &= check(orderViolations.load() == 0, "dependencies respected");
+    ok &= check(finished[STAGES - 1].load() == STAGE_WIDTH, "dependency chain completes");
+
+    return ok;
+}
+
+// Deliberately compute-bound work item
+static float work(int i) {
+    float x = static_cast<float>(i);
+    for (int k = 0; k < 2000; k++) x = std::sqrt(x * x + 1.0f) * 0.999f;
+    return x;
+}
+
+int main() {
+    unsigned int maxThreads = std::thread::hardware_concurrency();
+    if (maxThreads == 0) maxThreads = 1;
+
+    bool ok = true;
+    for (unsigned int workers = 0; workers < maxThreads + 2; workers++) {
+        ok &= stressTest(workers);
+    }
+    std::cout << "stress " << (ok ? "passed" : "FAILED") << std::endl;
+    if (!ok) return 1;
+
+    const int ITEMS = 100000;
+    const int GRAIN = 256;
+    std::vector<float> results(ITEMS);
+    double baseline = 0.0;
+
+    std::cout << std::fixed << std::setprecision(2);
+    for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+        JobSystem jobs(threads - 1);
+
+        auto start = std::chrono::steady_clock::now();
+        JobCounter done;
+        jobs.parallelFor(ITEMS, GRAIN, [&results](int begin, int end) {
+            for (int i = begin; i < end; i++) results[i] = work(i);
+        }, done);
+        jobs.wait(done);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (threads == 1) baseline = seconds;
+        std::cout << "threads=" << threads
+                  << " ms=" << seconds * 1000.0
+                  << " jobs/s=" << (ITEMS / GRAIN) / seconds
+                  << " speedup=" << baseline / seconds
+                  << " stolen=" << jobs.jobsStolen() << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+// Clustered light binning time for 1k and 10k point lights, scalar against
+// SSE2 and on 1..N threads. Lights are scattered over a city-sized block in
+// front of the camera like the streaming city's street lights. Every
+// configuration must produce the same cluster lists as the single-threaded
+// scalar run. Needs no GL context; the in-engine frame time with the same
+// light counts comes from running the demo with --bench-render --lights N.
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "jobs.cpp"
+#include "citygen.cpp"
+#include "lightbinning.cpp"
+
+static const int ITERATIONS = 50;
+
+static std::vector<PointLight> randomLights(int count, uint64_t seed) {
+    CityRandom rng(seed);
+    std::vector<PointLight> lights(count);
+    for (PointLight &light : lights) {
+        light.positionRadius = glm::vec4(rng.range(-2400.0f, 2400.0f), rng.range(5.0f, 60.0f),
+                                         rng.range(-2400.0f, 2400.0f), rng.range(80.0f, 180.0f));
+        light.color = glm::vec4(1.0f, 0.72f, 0.38f, 0.0f);
+    }
+    return lights;
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1337;
+    unsigned int maxThreads = std::thread::hardware_concurrency();
+    if (maxThreads == 0) maxThreads = 1;
+
+    // Same camera and projection as the demo
+    glm::mat4 view = glm::lookAt(glm::vec3(0, 250, 800), glm::vec3(0, 200, 0), glm::vec3(0, 1, 0));
+    const float fovY = glm::radians(45.0f), aspect = 1024.0f / 768.0f, zNear = 50.0f, zFar = 3000.0f;
+
+    std::cout << std::fixed << std::setprecision(3);
+    for (int count : {1000, 10000}) {
+        std::vector<PointLight> lights = randomLights(count, seed);
+
+        LightBinner reference;
+        reference.useSimd = false;
+        reference.bin(lights, view, fovY, aspect, zNear, zFar, nullptr);
+
+        for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+            JobSystem jobs(threads - 1);
+            for (bool simd : {false, true}) {
+                LightBinner binner;
+                binner.useSimd = simd;
+                double transformMs = 0.0, binMs = 0.0;
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < ITERATIONS; i++) {
+                    binner.bin(lights, view, fovY, aspect, zNear, zFar, &jobs);
+                    transformMs += binner.stats.transformMs;
+                    binMs += binner.stats.binMs;
+                }
+                double totalMs = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start).count();
+
+                bool match = binner.clusters == reference.clusters && binner.indices == reference.indices;
+                std::cout << "lights=" << count
+                          << " threads=" << threads
+                          << " simd=" << (simd ? 1 : 0)
+                          << " ms/frame=" << totalMs / ITERATIONS
+                          << " transform_ms=" << transformMs / ITERATIONS
+                          << " bin_ms=" << binMs / ITERATIONS
+                          << " visible=" << binner.stats.lightsVisible
+                          << " indices=" << binner.stats.indices
+                          << " max_per_cluster=" << binner.stats.maxPerCluster
+                          << (match ? "" : " MISMATCH") << std::endl;
+                if (!match) return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,6 @@
+#ifndef _MOCKGL_GLFW3_H_
+#define _MOCKGL_GLFW3_H_
+
+// The engine sources built into benchmarks include GLFW but call nothing from it
+
+#endif
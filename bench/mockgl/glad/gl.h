@@ -0,0 +1,211 @@
+#ifndef _MOCKGL_GL_H_
+#define _MOCKGL_GL_H_
+
+// Stand-in for the glad loader header so engine sources compile and run
+// without a GL context. It is found before the real one only by benchmark
+// targets (see CMakeLists.txt). Every entry point the engine calls is a no-op
+// that counts itself; object names are handed out in sequence, queries always
+// report available and visible, and nothing ever errors. Only what the
+// engine uses is declared, add entries here as new calls appear.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define GLAD_API_PTR
+typedef void (*GLADapiproc)(void);
+typedef GLADapiproc (*GLADloadfunc)(const char *name);
+
+typedef unsigned int GLenum;
+typedef unsigned char GLboolean;
+typedef unsigned int GLbitfield;
+typedef void GLvoid;
+typedef int GLint;
+typedef unsigned int GLuint;
+typedef int GLsizei;
+typedef float GLfloat;
+typedef char GLchar;
+typedef unsigned char GLubyte;
+typedef ptrdiff_t GLintptr;
+typedef ptrdiff_t GLsizeiptr;
+typedef uint64_t GLuint64;
+typedef struct __GLsync *GLsync;
+
+#define GL_FALSE 0
+#define GL_TRUE 1
+#define GL_NO_ERROR 0
+#define GL_TRIANGLES 0x0004
+#define GL_DEPTH_TEST 0x0B71
+#define GL_UNPACK_ALIGNMENT 0x0CF5
+#define GL_TEXTURE_2D 0x0DE1
+#define GL_UNSIGNED_BYTE 0x1401
+#define GL_INT 0x1404
+#define GL_UNSIGNED_INT 0x1405
+#define GL_FLOAT 0x1406
+#define GL_RGB 0x1907
+#define GL_LINEAR 0x2601
+#define GL_LINEAR_MIPMAP_LINEAR 0x2703
+#define GL_TEXTURE_MAG_FILTER 0x2800
+#define GL_TEXTURE_MIN_FILTER 0x2801
+#define GL_TEXTURE_WRAP_S 0x2802
+#define GL_TEXTURE_WRAP_T 0x2803
+#define GL_REPEAT 0x2901
+#define GL_TEXTURE_BASE_LEVEL 0x813C
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#define GL_R32UI 0x8236
+#define GL_RG32UI 0x823C
+#define GL_TEXTURE0 0x84C0
+#define GL_RGBA32F 0x8814
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STREAM_DRAW 0x88E0
+#define GL_STREAM_READ 0x88E1
+#define GL_STATIC_DRAW 0x88E4
+#define GL_DYNAMIC_DRAW 0x88E8
+#define GL_DYNAMIC_COPY 0x88EA
+#define GL_UNIFORM_BUFFER 0x8A11
+#define GL_TEXTURE_2D_ARRAY 0x8C1A
+#define GL_TEXTURE_BUFFER 0x8C2A
+#define GL_ANY_SAMPLES_PASSED 0x8C2F
+#define GL_QUERY_NO_WAIT 0x8E14
+#define GL_COPY_READ_BUFFER 0x8F36
+#define GL_COPY_WRITE_BUFFER 0x8F37
+#define GL_SYNC_GPU_COMMANDS_COMPLETE 0x9117
+#define GL_ALREADY_SIGNALED 0x911A
+#define GL_CONDITION_SATISFIED 0x911C
+#define GL_INVALID_INDEX 0xFFFFFFFF
+
+struct MockGLCounters {
+    unsigned long calls = 0;
+    unsigned long drawCalls = 0;
+    unsigned long textureBinds = 0;
+    unsigned long long bytesUploaded = 0;
+    unsigned long long bytesCopied = 0;     // Buffer to buffer, on the GPU
+    GLuint nextName = 1;
+
+    void reset() {
+        calls = 0;
+        drawCalls = 0;
+        textureBinds = 0;
+        bytesUploaded = 0;
+        bytesCopied = 0;
+    }
+};
+
+// Defined in mockgl.cpp
+extern MockGLCounters mockGL;
+
+inline void mockGLGenNames(GLsizei n, GLuint *names) {
+    mockGL.calls++;
+    for (GLsizei i = 0; i < n; i++) names[i] = mockGL.nextName++;
+}
+
+inline void mockGLCall() { mockGL.calls++; }
+
+inline void glGenBuffers(GLsizei n, GLuint *buffers) { mockGLGenNames(n, buffers); }
+inline void glGenTextures(GLsizei n, GLuint *textures) { mockGLGenNames(n, textures); }
+inline void glGenVertexArrays(GLsizei n, GLuint *arrays) { mockGLGenNames(n, arrays); }
+inline void glGenQueries(GLsizei n, GLuint *ids) { mockGLGenNames(n, ids); }
+inline void glDeleteBuffers(GLsizei, const GLuint *) { mockGLCall(); }
+inline void glDeleteTextures(GLsizei, const GLuint *) { mockGLCall(); }
+inline void glDeleteVertexArrays(GLsizei, const GLuint *) { mockGLCall(); }
+inline void glDeleteQueries(GLsizei, const GLuint *) { mockGLCall(); }
+inline void glDeleteProgram(GLuint) { mockGLCall(); }
+
+inline void glBindBuffer(GLenum, GLuint) { mockGLCall(); }
+inline void glBindBufferBase(GLenum, GLuint, GLuint) { mockGLCall(); }
+inline void glBindTexture(GLenum, GLuint) {
+    mockGLCall();
+    mockGL.textureBinds++;
+}
+inline void glBindVertexArray(GLuint) { mockGLCall(); }
+inline void glActiveTexture(GLenum) { mockGLCall(); }
+inline void glUseProgram(GLuint) { mockGLCall(); }
+
+inline void glBufferData(GLenum, GLsizeiptr size, const void *data, GLenum) {
+    mockGLCall();
+    if (data) mockGL.bytesUploaded += size;
+}
+inline void glBufferSubData(GLenum, GLintptr, GLsizeiptr size, const void *) {
+    mockGLCall();
+    mockGL.bytesUploaded += size;
+}
+inline void glCopyBufferSubData(GLenum, GLenum, GLintptr, GLintptr, GLsizeiptr size) {
+    mockGLCall();
+    mockGL.bytesCopied += size;
+}
+inline void glGetBufferSubData(GLenum, GLintptr, GLsizeiptr, void *) { mockGLCall(); }
+inline void glTexImage2D(GLenum, GLint, GLint, GLsizei width, GLsizei height, GLint, GLenum, GLenum, const void *pixels) {
+    mockGLCall();
+    if (pixels) mockGL.bytesUploaded += size_t(width) * height * 3;
+}
+inline void glTexImage3D(GLenum, GLint, GLint, GLsizei width, GLsizei height, GLsizei depth, GLint, GLenum, GLenum,
+                         const void *pixels) {
+    mockGLCall();
+    if (pixels) mockGL.bytesUploaded += size_t(width) * height * depth * 3;
+}
+inline void glTexSubImage3D(GLenum, GLint, GLint, GLint, GLint, GLsizei width, GLsizei height, GLsizei depth,
+                            GLenum, GLenum, const void *) {
+    mockGLCall();
+    mockGL.bytesUploaded += size_t(width) * height * depth * 3;
+}
+inline void glTexBuffer(GLenum, GLenum, GLuint) { mockGLCall(); }
+inline void glTexParameteri(GLenum, GLenum, GLint) { mockGLCall(); }
+inline void glGenerateMipmap(GLenum) { mockGLCall(); }
+inline void glPixelStorei(GLenum, GLint) { mockGLCall(); }
+
+inline void glEnableVertexAttribArray(GLuint) { mockGLCall(); }
+inline void glDisableVertexAttribArray(GLuint) { mockGLCall(); }
+inline void glVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void *) { mockGLCall(); }
+inline void glVertexAttribIPointer(GLuint, GLint, GLenum, GLsizei, const void *) { mockGLCall(); }
+inline void glVertexAttribDivisor(GLuint, GLuint) { mockGLCall(); }
+
+inline GLint glGetUniformLocation(GLuint, const GLchar *) { mockGLCall(); return 0; }
+inline GLuint glGetUniformBlockIndex(GLuint, const GLchar *) { mockGLCall(); return 0; }
+inline void glUniformBlockBinding(GLuint, GLuint, GLuint) { mockGLCall(); }
+inline void glUniform1i(GLint, GLint) { mockGLCall(); }
+inline void glUniform1ui(GLint, GLuint) { mockGLCall(); }
+inline void glUniform3fv(GLint, GLsizei, const GLfloat *) { mockGLCall(); }
+inline void glUniform4fv(GLint, GLsizei, const GLfloat *) { mockGLCall(); }
+inline void glUniformMatrix4fv(GLint, GLsizei, GLboolean, const GLfloat *) { mockGLCall(); }
+
+inline void glEnable(GLenum) { mockGLCall(); }
+inline void glColorMask(GLboolean, GLboolean, GLboolean, GLboolean) { mockGLCall(); }
+inline void glDepthMask(GLboolean) { mockGLCall(); }
+
+inline void glDrawElements(GLenum, GLsizei, GLenum, const void *) {
+    mockGLCall();
+    mockGL.drawCalls++;
+}
+inline void glDrawElementsInstanced(GLenum, GLsizei, GLenum, const void *, GLsizei) {
+    mockGLCall();
+    mockGL.drawCalls++;
+}
+inline void glDrawElementsBaseVertex(GLenum, GLsizei, GLenum, const void *, GLint) {
+    mockGLCall();
+    mockGL.drawCalls++;
+}
+inline void glDrawElementsInstancedBaseVertex(GLenum, GLsizei, GLenum, const void *, GLsizei, GLint) {
+    mockGLCall();
+    mockGL.drawCalls++;
+}
+inline void glMultiDrawElementsBaseVertex(GLenum, const GLsizei *, GLenum, const void *const *, GLsizei, const GLint *) {
+    mockGLCall();
+    mockGL.drawCalls++;
+}
+
+inline void glBeginQuery(GLenum, GLuint) { mockGLCall(); }
+inline void glEndQuery(GLenum) { mockGLCall(); }
+inline void glBeginConditionalRender(GLuint, GLenum) { mockGLCall(); }
+inline void glEndConditionalRender() { mockGLCall(); }
+inline void glGetQueryObjectiv(GLuint, GLenum, GLint *params) { mockGLCall(); *params = 1; }
+inline void glGetQueryObjectuiv(GLuint, GLenum, GLuint *params) { mockGLCall(); *params = 1; }
+
+inline GLsync glFenceSync(GLenum, GLbitfield) { mockGLCall(); return nullptr; }
+inline GLenum glClientWaitSync(GLsync, GLbitfield, GLuint64) { mockGLCall(); return GL_ALREADY_SIGNALED; }
+inline void glDeleteSync(GLsync) { mockGLCall(); }
+
+inline GLenum glGetError() { mockGLCall(); return GL_NO_ERROR; }
+
+#endif
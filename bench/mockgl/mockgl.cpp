@@ -0,0 +1,66 @@
+// GL-free replacements for render/shader.cpp and render/glext.cpp, linked
+// into benchmarks together with the mock glad/gl.h. Programs get a name but
+// are never compiled, and the GL 4.x extensions report as unavailable so the
+// engine takes its GL 3.3 paths.
+
+#include <glad/gl.h>
+#include <render/shader.h>
+#include <render/glext.h>
+
+MockGLCounters mockGL;
+
+static ShaderSourceProvider SourceProvider = NULL;
+
+void SetShaderSourceProvider(ShaderSourceProvider provider)
+{
+	SourceProvider = provider;
+}
+
+GLuint LoadShadersFromFile(const char *, const char *)
+{
+	return mockGL.nextName++;
+}
+
+GLuint LoadShadersFromString(std::string, std::string)
+{
+	return mockGL.nextName++;
+}
+
+void EnableProgramBinaryCache(const char *)
+{
+}
+
+void FlushProgramBinaryCache()
+{
+}
+
+ProgramCacheStats GetProgramCacheStats()
+{
+	return ProgramCacheStats{0, 0, 0, 0};
+}
+
+GLuint LoadComputeShaderFromFile(const char *)
+{
+	return 0;
+}
+
+PFNGLDISPATCHCOMPUTEPROC glext_DispatchCompute = nullptr;
+PFNGLMEMORYBARRIERPROC glext_MemoryBarrier = nullptr;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glext_MultiDrawElementsIndirect = nullptr;
+PFNGLGETPROGRAMBINARYPROC glext_GetProgramBinary = nullptr;
+PFNGLPROGRAMBINARYPROC glext_ProgramBinary = nullptr;
+PFNGLPROGRAMPARAMETERIPROC glext_ProgramParameteri = nullptr;
+
+void LoadGLExtensions(int, GLADloadfunc)
+{
+}
+
+bool HasGL43()
+{
+	return false;
+}
+
+bool HasProgramBinary()
+{
+	return false;
+}
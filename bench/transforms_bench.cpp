@@ -0,0 +1,80 @@
+// Transforms per second of the SoA transform system for 1k to 100k animated
+// instances, scalar (sinf/cosf per instance) against SSE2 batches of four and
+// on 1..N threads. The SSE2 sine approximation must stay within 1e-3 of the
+// scalar matrices for positions a few thousand units from the origin.
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+
+#include "jobs.cpp"
+#include "citygen.cpp"
+#include "transforms.cpp"
+
+static const int FRAMES = 50;
+
+static void fill(TransformSystem &transforms, int count, uint64_t seed) {
+    CityRandom rng(seed);
+    for (int i = 0; i < count; i++) {
+        glm::vec3 position(rng.range(-2000.0f, 2000.0f), rng.range(200.0f, 600.0f), rng.range(-2000.0f, 2000.0f));
+        int instance = transforms.add(position, rng.range(0.0f, 6.28f), glm::vec3(rng.range(1.0f, 5.0f)));
+        transforms.setOscillation(instance, glm::vec3(0, 0, 1), 100.0f, rng.range(1.0f, 3.0f), i * 0.5f);
+        transforms.setSpin(instance, rng.range(-1.0f, 1.0f));
+    }
+}
+
+static float maxDifference(const std::vector<glm::mat4> &a, const std::vector<glm::mat4> &b) {
+    float difference = 0.0f;
+    for (size_t i = 0; i < a.size(); i++) {
+        for (int column = 0; column < 4; column++) {
+            glm::vec4 d = glm::abs(a[i][column] - b[i][column]);
+            difference = glm::max(difference, glm::max(glm::max(d.x, d.y), glm::max(d.z, d.w)));
+        }
+    }
+    return difference;
+}
+
+int main(int argc, char **argv) {
+    uint64_t seed = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1337;
+    unsigned int maxThreads = std::thread::hardware_concurrency();
+    if (maxThreads == 0) maxThreads = 1;
+    const float time = 12.5f;
+
+    std::cout << std::fixed << std::setprecision(3);
+    for (int count : {1000, 10000, 100000}) {
+        TransformSystem reference;
+        reference.useSimd = false;
+        fill(reference, count, seed);
+        reference.update(time, nullptr);
+
+        for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+            JobSystem jobs(threads - 1);
+            for (bool simd : {false, true}) {
+                TransformSystem transforms;
+                transforms.useSimd = simd;
+                fill(transforms, count, seed);
+
+                double totalMs = 0.0;
+                for (int frame = 0; frame < FRAMES; frame++) {
+                    transforms.update(time, &jobs);
+                    totalMs += transforms.stats.updateMs;
+                }
+
+                float difference = maxDifference(transforms.worldMatrices(), reference.worldMatrices());
+                bool match = difference < 1e-3f;
+                std::cout << "instances=" << count
+                          << " threads=" << threads
+                          << " simd=" << (simd ? 1 : 0)
+                          << " ms/frame=" << totalMs / FRAMES
+                          << " Mtransforms/s=" << count * FRAMES / totalMs / 1000.0
+                          << " max_diff=" << difference
+                          << (match ? "" : " MISMATCH") << std::endl;
+                if (!match) return 1;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+// Bundles the engine's assets into one pack file for AssetFiles to map.
+//   packassets OUTPUT ROOT [INPUT...]
+// Inputs are files or directories relative to ROOT, the assignment
+// directory; without any, AssetPackSources are packed. The build runs this
+// as the asset_pack target, leaving assets.pak next to the executables.
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "assetpack.cpp"
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " OUTPUT ROOT [INPUT...]" << std::endl;
+        return 1;
+    }
+    std::vector<std::string> inputs(argv + 3, argv + argc);
+    if (inputs.empty()) {
+        inputs.assign(std::begin(AssetPackSources), std::end(AssetPackSources));
+    }
+    return WriteAssetPack(argv[1], argv[2], inputs, std::cout) ? 0 : 1;
+}